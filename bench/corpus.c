@@ -0,0 +1,316 @@
+/* Generates a corpus of robot scripts for benchmarking; the same arguments
+ always give the same corpus. Most lines are valid; a fraction have one
+ mistake put in them, the sort that people make: a misspelt keyword, a
+ missing or extra token, a bad number, or an unterminated string. With -u,
+ every line is one of only that many, like a script that was generated.
+
+ Usage: gencorpus [-s <size>] [-e <error rate>] [-l <mean commands>]
+ [-L <long rate>] [-n <long commands>] [-m <command:repeat:while:say:blank>]
+ [-q <message max>] [-u <lines>] [-r <seed>] > corpus.txt
+
+ @author	Neil
+ @version	1; 2016-03
+ @since		1; 2016-03 */
+
+#include <stdio.h>	/* fprintf fwrite sprintf */
+#include <stdlib.h>	/* EXIT_* strtod strtoul realloc */
+#include <string.h>	/* strlen memcpy memmove */
+#include <ctype.h>	/* tolower */
+#include <stdint.h>	/* uint64_t */
+
+/* constants; DETECTMARKER is only valid as the condition of WHILE */
+static const char *const commands[] = { "TAKEASTEP", "LEFT", "RIGHT",
+	"PICKUP", "DROP", "TURNON", "TURNOFF" };
+static const unsigned commands_size = sizeof commands / sizeof *commands;
+static const char *const separators[] = { ", ", ",", " , ", " " };
+static const char *const strays[] = { "END", "DO", "TIMES", "NOT", "SAY",
+	"REPEAT", "WHILE", "42", "\"x\"" };
+static const char message[] = "abcdefghijklmnopqrstuvwxyz  ,.!?0123456789";
+
+enum Kind { K_COMMAND, K_REPEAT, K_WHILE, K_SAY, K_BLANK, K_KIND_NO };
+
+/* the line is built here before it's written */
+struct Line {
+	char *a;
+	size_t size, capacity;
+};
+
+struct Options {
+	unsigned long long size;
+	double error, mean, long_rate;
+	unsigned long long_commands, message_max, distinct, seed;
+	double mix[K_KIND_NO];
+};
+
+/* private */
+static int parse_options(const int argc, char **const argv,
+	struct Options *const o);
+static uint64_t next_random(uint64_t *const x);
+static double uniform(uint64_t *const x);
+static unsigned long below(uint64_t *const x, const unsigned long n);
+static int append(struct Line *const l, const char *const s, const size_t n);
+static int keyword(struct Line *const l, uint64_t *const x,
+	const char *const k);
+static int command_list(struct Line *const l, uint64_t *const x,
+	const struct Options *const o);
+static int generate(struct Line *const l, uint64_t *const x,
+	const struct Options *const o);
+static void mistake(struct Line *const l, uint64_t *const x);
+
+/** Entry point.
+ @param argc	The number of arguments, starting with the programme name.
+ @param argv	The arguments.
+ @return		Either EXIT_SUCCESS or EXIT_FAILURE. */
+int main(int argc, char **argv) {
+	struct Options o;
+	struct Line l = { 0, 0, 0 };
+	unsigned long long written = 0;
+	uint64_t x, y, *r;
+	int is_ok = -1;
+
+	if(!parse_options(argc, argv, &o)) {
+		fprintf(stderr, "Usage: %s [-s <size>[K|M|G]] [-e <error rate>] "
+			"[-l <mean commands>]\n [-L <long rate>] [-n <long commands>] "
+			"[-m <command:repeat:while:say:blank>]\n [-q <message max>] "
+			"[-u <lines>] [-r <seed>] > corpus.txt\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+	x = o.seed * 0x9e3779b97f4a7c15u + 0x2545f4914f6cdd1du;
+	while(written < o.size) {
+		l.size = 0;
+		/* the same seed gives the same line */
+		if(o.distinct) {
+			y = ((uint64_t)below(&x, o.distinct) << 32 ^ o.seed)
+				* 0x9e3779b97f4a7c15u + 0x2545f4914f6cdd1du;
+			r = &y;
+		} else {
+			r = &x;
+		}
+		if(!generate(&l, r, &o)) { is_ok = 0; break; }
+		if(uniform(r) < o.error) mistake(&l, r);
+		if(!append(&l, "\n", 1)) { is_ok = 0; break; }
+		if(fwrite(l.a, 1, l.size, stdout) != l.size) { is_ok = 0; break; }
+		written += l.size;
+	}
+	free(l.a);
+	if(!is_ok || fflush(stdout) == EOF) {
+		perror("gencorpus");
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
+
+/* private */
+
+/** Fills o from the arguments. */
+static int parse_options(const int argc, char **const argv,
+	struct Options *const o) {
+	int arg;
+	unsigned k;
+
+	o->size          = 16 << 20;
+	o->error         = 0.05;
+	o->mean          = 4.0;
+	o->long_rate     = 0.005;
+	o->long_commands = 300;
+	o->message_max   = 40;
+	o->distinct      = 0;
+	o->seed          = 1;
+	o->mix[K_COMMAND] = 20, o->mix[K_REPEAT] = 30, o->mix[K_WHILE] = 25,
+		o->mix[K_SAY] = 15, o->mix[K_BLANK] = 10;
+
+	for(arg = 1; arg < argc; arg++) {
+		const char *const opt = argv[arg];
+		char *end;
+		if(opt[0] != '-' || !opt[1] || opt[2] || ++arg >= argc) return 0;
+		switch(opt[1]) {
+		case 's':
+			o->size = strtoull(argv[arg], &end, 10);
+			switch(*end) {
+				case 'G': o->size <<= 10; /* fall through */
+				case 'M': o->size <<= 10; /* fall through */
+				case 'K': o->size <<= 10; end++; break;
+				default: break;
+			}
+			break;
+		case 'e': o->error = strtod(argv[arg], &end); break;
+		case 'l': o->mean = strtod(argv[arg], &end); break;
+		case 'L': o->long_rate = strtod(argv[arg], &end); break;
+		case 'n': o->long_commands = strtoul(argv[arg], &end, 10); break;
+		case 'q': o->message_max = strtoul(argv[arg], &end, 10); break;
+		case 'u': o->distinct = strtoul(argv[arg], &end, 10); break;
+		case 'r': o->seed = strtoul(argv[arg], &end, 10); break;
+		case 'm':
+			end = argv[arg];
+			for(k = 0; k < K_KIND_NO; k++) {
+				o->mix[k] = strtod(end, &end);
+				if(k + 1 < K_KIND_NO && *end++ != ':') return 0;
+			}
+			break;
+		default: return 0;
+		}
+		if(*end) return 0;
+	}
+	if(o->error < 0.0 || o->error > 1.0 || o->mean < 1.0 || o->long_rate < 0.0
+		|| o->long_rate > 1.0 || !o->long_commands) return 0;
+	for(k = 0; k < K_KIND_NO; k++) if(o->mix[k] < 0.0) return 0;
+	for(k = 0; k < K_KIND_NO && !(o->mix[k] > 0.0); k++);
+	return k < K_KIND_NO;
+}
+
+/** xorshift64*. */
+static uint64_t next_random(uint64_t *const x) {
+	*x ^= *x >> 12;
+	*x ^= *x << 25;
+	*x ^= *x >> 27;
+	return *x * 0x2545f4914f6cdd1du;
+}
+
+/** @return [0, 1). */
+static double uniform(uint64_t *const x) {
+	return (next_random(x) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+/** @return [0, n). */
+static unsigned long below(uint64_t *const x, const unsigned long n) {
+	return (unsigned long)((next_random(x) >> 32) % n);
+}
+
+/** Appends n bytes of s to l. */
+static int append(struct Line *const l, const char *const s, const size_t n) {
+	while(l->size + n > l->capacity) {
+		const size_t c = l->capacity ? l->capacity << 1 : 256;
+		char *const a = realloc(l->a, c);
+		if(!a) return 0;
+		l->a        = a;
+		l->capacity = c;
+	}
+	memcpy(l->a + l->size, s, n);
+	l->size += n;
+	return -1;
+}
+
+/** Appends the keyword k in mostly capitals, sometimes mixed case. */
+static int keyword(struct Line *const l, uint64_t *const x,
+	const char *const k) {
+	const size_t n = strlen(k);
+	const uint64_t r = next_random(x);
+	size_t i;
+
+	if(!append(l, k, n)) return 0;
+	switch(r & 3) {
+	case 0: /* lower */
+		for(i = l->size - n; i < l->size; i++)
+			l->a[i] = (char)tolower((unsigned char)l->a[i]);
+		break;
+	case 1: /* mixed */
+		for(i = l->size - n; i < l->size; i++) if((r >> (8 + i % 48)) & 1)
+			l->a[i] = (char)tolower((unsigned char)l->a[i]);
+		break;
+	default: break;
+	}
+	return -1;
+}
+
+/** Appends a list of commands; the length is geometric with o->mean, except
+ for o->long_rate of them that are o->long_commands long. */
+static int command_list(struct Line *const l, uint64_t *const x,
+	const struct Options *const o) {
+	const char *const sep = separators[below(x, sizeof separators
+		/ sizeof *separators)];
+	unsigned long n = 1, i;
+
+	if(uniform(x) < o->long_rate) n = o->long_commands;
+	else while(uniform(x) > 1.0 / o->mean) n++;
+	for(i = 0; i < n; i++) {
+		if(i && !append(l, sep, strlen(sep))) return 0;
+		if(!keyword(l, x, commands[below(x, commands_size)])) return 0;
+	}
+	return -1;
+}
+
+/** Generates a valid line of a kind picked by o->mix. */
+static int generate(struct Line *const l, uint64_t *const x,
+	const struct Options *const o) {
+	double total = 0.0, r;
+	unsigned k;
+	char number[32];
+
+	for(k = 0; k < K_KIND_NO; k++) total += o->mix[k];
+	r = uniform(x) * total;
+	for(k = 0; k + 1 < K_KIND_NO && r >= o->mix[k]; k++) r -= o->mix[k];
+	switch(k) {
+	case K_COMMAND:
+		return keyword(l, x, commands[below(x, commands_size)]);
+	case K_REPEAT:
+		sprintf(number, " %lu ", 1 + below(x, below(x, 8) ? 99 : 100000));
+		return keyword(l, x, "REPEAT") && append(l, number, strlen(number))
+			&& keyword(l, x, "TIMES") && append(l, " ", 1)
+			&& command_list(l, x, o) && append(l, " ", 1)
+			&& keyword(l, x, "END");
+	case K_WHILE:
+		return keyword(l, x, "WHILE") && append(l, " ", 1)
+			&& keyword(l, x, "NOT") && append(l, " ", 1)
+			&& keyword(l, x, "DETECTMARKER") && append(l, " ", 1)
+			&& keyword(l, x, "DO") && append(l, " ", 1)
+			&& command_list(l, x, o) && append(l, " ", 1)
+			&& keyword(l, x, "END");
+	case K_SAY: {
+		unsigned long n = below(x, o->message_max + 1), i;
+		if(!keyword(l, x, "SAY") || !append(l, " \"", 2)) return 0;
+		for(i = 0; i < n; i++) {
+			if(!append(l, message + below(x, sizeof message - 1), 1))
+				return 0;
+		}
+		return append(l, "\"", 1);
+	}
+	default:
+		return -1;
+	}
+}
+
+/** Puts one mistake in l, which has room for it from the new line that's
+ appended after; a blank line gets a stray token. */
+static void mistake(struct Line *const l, uint64_t *const x) {
+	size_t i, j, start, end;
+
+	if(!l->size) {
+		const char *const s = strays[below(x, sizeof strays / sizeof *strays)];
+		append(l, s, strlen(s));
+		return;
+	}
+	/* a word: from a random place back to its start and forward to its end */
+	i = below(x, l->size);
+	for(start = i; start && l->a[start - 1] != ' ' && l->a[start - 1] != ',';
+		start--);
+	for(end = i; end < l->size && l->a[end] != ' ' && l->a[end] != ',';
+		end++);
+	switch(below(x, 5)) {
+	case 0: /* misspelt: two letters swapped, or one dropped */
+		if(end - start >= 2) {
+			const char c = l->a[start];
+			l->a[start] = l->a[start + 1], l->a[start + 1] = c;
+			if(l->a[start] != l->a[start + 1]) break;
+		}
+		/* fall through */
+	case 1: /* missing */
+		memmove(l->a + start, l->a + end, l->size - end);
+		l->size -= end - start;
+		break;
+	case 2: { /* extra */
+		const char *const s = strays[below(x, sizeof strays / sizeof *strays)];
+		append(l, " ", 1);
+		append(l, s, strlen(s));
+		break;
+	}
+	case 3: /* a letter in a number, or a number in a word */
+		append(l, " ", 1);
+		append(l, "3x", 2);
+		break;
+	case 4: /* unterminated string */
+		for(j = 0; j < l->size && l->a[j] != '\"'; j++);
+		if(j < l->size) l->size = j + 1 + (l->size - j - 1) / 2;
+		else append(l, " \"hi", 4);
+		break;
+	}
+}
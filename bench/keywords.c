@@ -0,0 +1,232 @@
+/* Microbenchmark of keyword lookup in syntax.c: the perfect hash in
+ match_keyword against bsearch over tokens[] with tokstrcmp, which is what it
+ replaced; and of suggest_token, the bit-parallel edit distance to all the
+ keywords, against the textbook matrix for each keyword. It includes syntax.c
+ to get at the private functions, and checks that both ways agree on every
+ word first.
+
+ Usage: keybench [repetitions]
+
+ @author	Neil
+ @version	1; 2016-03
+ @since		1; 2016-03 */
+
+#define _POSIX_C_SOURCE 200809L /* clock_gettime */
+
+#include <stdlib.h>	/* bsearch strtoul */
+#include <time.h>	/* clock_gettime */
+#include "../src/syntax.c"
+
+static const int tokens_size = sizeof tokens / sizeof *tokens;
+
+/* constants */
+static const char *const others[] = { "lfet", "trunon", "TURNO", "repeatt",
+	"walk", "x", "detectmarkers", "takeastepp", "Do", "en", "sayy", "pick" };
+#define WORDS 4096
+
+/* key for bsearch; tokens are not null-terminated */
+struct Key {
+	const char *string;
+	size_t length;
+};
+
+/* private */
+static const struct Token *bsearch_keyword(const char *const token,
+	const size_t length);
+static int token_compare(const void *a, const void *b);
+static int tokstrcmp(const char *a, size_t n, const char *b);
+static void typo(char *const word, size_t *const length, unsigned long x);
+static const char *matrix_suggest(const char *const token,
+	const size_t length);
+static unsigned distance(const char *const a, const size_t a_size,
+	const char *const b, const size_t b_size);
+static double now(void);
+
+/** Entry point.
+ @param argc	The number of arguments, starting with the programme name.
+ @param argv	The arguments.
+ @return		Either EXIT_SUCCESS or EXIT_FAILURE. */
+int main(int argc, char **argv) {
+	static char store[WORDS][32];
+	static size_t length[WORDS];
+	const unsigned long reps = argc > 1 ? strtoul(argv[1], 0, 10) : 2000;
+	static char typos[WORDS][32];
+	static size_t typos_length[WORDS];
+	unsigned long r, x = 1, found = 0, suggested = 0;
+	unsigned i, j;
+	double t0, t_hash, t_bsearch, t_bits, t_matrix;
+
+	/* the keywords must agree with tokens[] */
+	for(i = tok_keywords - tokens; i < (unsigned)tokens_size; i++) {
+		if(match_keyword(tokens[i].string, strlen(tokens[i].string))
+			== tokens + i) continue;
+		fprintf(stderr, "%s: not in keywords.h.\n", tokens[i].string);
+		return EXIT_FAILURE;
+	}
+
+	/* about 3/4 keywords in mixed case, the rest not */
+	for(i = 0; i < WORDS; i++) {
+		const char *w;
+		x = x * 6364136223846793005u + 1442695040888963407u;
+		if((x >> 33) & 3) {
+			w = tok_keywords[(x >> 40) % (tokens + tokens_size - tok_keywords)].string;
+		} else {
+			w = others[(x >> 40) % (sizeof others / sizeof *others)];
+		}
+		for(j = 0; w[j]; j++) store[i][j] = (x >> (20 + j % 20)) & 1
+			? (char)tolower((unsigned char)w[j]) : w[j];
+		length[i] = j;
+	}
+	for(i = 0; i < WORDS; i++) {
+		if(match_keyword(store[i], length[i])
+			== bsearch_keyword(store[i], length[i])) continue;
+		fprintf(stderr, "%.*s: perfect hash and bsearch disagree.\n",
+			(int)length[i], store[i]);
+		return EXIT_FAILURE;
+	}
+
+	t0 = now();
+	for(r = 0; r < reps; r++) for(i = 0; i < WORDS; i++)
+		found += !!match_keyword(store[i], length[i]);
+	t_hash = now() - t0;
+	t0 = now();
+	for(r = 0; r < reps; r++) for(i = 0; i < WORDS; i++)
+		found += !!bsearch_keyword(store[i], length[i]);
+	t_bsearch = now() - t0;
+
+	/* keywords with one to three mistakes, and the other words */
+	for(i = 0; i < WORDS; i++) {
+		x = x * 6364136223846793005u + 1442695040888963407u;
+		if((x >> 33) & 7) {
+			const char *const w
+				= tok_keywords[(x >> 40) % (tokens + tokens_size - tok_keywords)].string;
+			typos_length[i] = strlen(w);
+			memcpy(typos[i], w, typos_length[i]);
+			for(j = 0; j <= ((x >> 36) & 3) % 3; j++)
+				x = x * 6364136223846793005u + 1442695040888963407u,
+				typo(typos[i], typos_length + i, x);
+		} else {
+			const char *const w
+				= others[(x >> 40) % (sizeof others / sizeof *others)];
+			typos_length[i] = strlen(w);
+			memcpy(typos[i], w, typos_length[i]);
+		}
+	}
+	for(i = 0; i < WORDS; i++) {
+		if(suggest_token(typos[i], typos_length[i])
+			== matrix_suggest(typos[i], typos_length[i])) continue;
+		fprintf(stderr, "%.*s: bit-parallel %s and matrix %s disagree.\n",
+			(int)typos_length[i], typos[i],
+			suggest_token(typos[i], typos_length[i]),
+			matrix_suggest(typos[i], typos_length[i]));
+		return EXIT_FAILURE;
+	}
+	t0 = now();
+	for(r = 0; r < reps; r++) for(i = 0; i < WORDS; i++)
+		suggested += !!suggest_token(typos[i], typos_length[i]);
+	t_bits = now() - t0;
+	t0 = now();
+	for(r = 0; r < reps / 10 + 1; r++) for(i = 0; i < WORDS; i++)
+		suggested += !!matrix_suggest(typos[i], typos_length[i]);
+	t_matrix = now() - t0;
+
+	printf("%lu lookups (%lu found)\n", reps * WORDS, found / 2);
+	printf("perfect hash: %6.2f ns/lookup\n", t_hash * 1e9 / (reps * WORDS));
+	printf("bsearch:      %6.2f ns/lookup\n",
+		t_bsearch * 1e9 / (reps * WORDS));
+	printf("%lu suggestions (%lu found)\n", reps * WORDS,
+		suggested * reps / (reps + reps / 10 + 1));
+	printf("bit-parallel: %6.2f ns/suggestion\n",
+		t_bits * 1e9 / (reps * WORDS));
+	printf("matrix:       %6.2f ns/suggestion\n",
+		t_matrix * 1e9 / ((reps / 10 + 1) * WORDS));
+	return EXIT_SUCCESS;
+}
+
+/* private */
+
+/** The old {@see match_keyword}. */
+static const struct Token *bsearch_keyword(const char *const token,
+	const size_t length) {
+	struct Key key;
+	key.string = token;
+	key.length = length;
+	return bsearch(&key, tok_keywords, tokens_size - (tok_keywords - tokens),
+		sizeof(struct Token), &token_compare);
+}
+
+/** This is used in {@see bsearch_keyword}. */
+static int token_compare(const void *a, const void *b) {
+	const struct Key *key = a;
+	const struct Token *elem = b;
+	return tokstrcmp(key->string, key->length, elem->string);
+}
+
+/** Case-insensitive compare of a, which is n characters, not containing
+ null, with b, which is null-terminated and in capitals. */
+static int tokstrcmp(const char *a, size_t n, const char *b) {
+	for( ; n && toupper((unsigned char)*a) == *b; a++, b++, n--);
+	return (n ? toupper((unsigned char)*a) : 0) - *b;
+}
+
+/** Makes one mistake in word, up to 31 characters, chosen by x: changing,
+ leaving out, or putting in a letter, or swapping two. */
+static void typo(char *const word, size_t *const length, unsigned long x) {
+	const size_t i = *length ? (x >> 20) % *length : 0;
+	const char c = (char)('A' + (x >> 40) % 26);
+
+	switch((x >> 33) & 3) {
+	case 0: if(*length) word[i] = c; break;
+	case 1: if(*length > 1) memmove(word + i, word + i + 1, *length - i - 1),
+		(*length)--; break;
+	case 2: if(*length < 31) memmove(word + i + 1, word + i, *length - i),
+		word[i] = c, (*length)++; break;
+	case 3: if(i + 1 < *length) { const char t = word[i];
+		word[i] = word[i + 1], word[i + 1] = t; } break;
+	}
+}
+
+/** The same as {@see suggest_token}, with a matrix for every keyword. */
+static const char *matrix_suggest(const char *const token,
+	const size_t length) {
+	const struct Token *t, *best = 0;
+	unsigned d, best_distance = suggest_max + 1;
+
+	for(t = tok_keywords; t < tokens + tokens_size; t++) {
+		const size_t m = strlen(t->string);
+		d = distance(token, length, t->string, m);
+		if(d <= suggest_cutoff((unsigned)m) && d < best_distance)
+			best = t, best_distance = d;
+	}
+	return best ? best->string : 0;
+}
+
+/** @return	The optimal string alignment distance between a and b, ignoring
+			case. */
+static unsigned distance(const char *const a, const size_t a_size,
+	const char *const b, const size_t b_size) {
+	unsigned d[33][33];
+	size_t i, j;
+
+	for(i = 0; i <= a_size; i++) d[i][0] = (unsigned)i;
+	for(j = 0; j <= b_size; j++) d[0][j] = (unsigned)j;
+	for(i = 1; i <= a_size; i++) for(j = 1; j <= b_size; j++) {
+		const int ai = toupper((unsigned char)a[i - 1]),
+			bj = toupper((unsigned char)b[j - 1]);
+		unsigned v = d[i - 1][j - 1] + (ai != bj);
+		if(d[i - 1][j] + 1 < v) v = d[i - 1][j] + 1;
+		if(d[i][j - 1] + 1 < v) v = d[i][j - 1] + 1;
+		if(i > 1 && j > 1 && ai == toupper((unsigned char)b[j - 2])
+			&& toupper((unsigned char)a[i - 2]) == bj
+			&& d[i - 2][j - 2] + 1 < v) v = d[i - 2][j - 2] + 1;
+		d[i][j] = v;
+	}
+	return d[a_size][b_size];
+}
+
+/** @return Seconds. */
+static double now(void) {
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec + t.tv_nsec * 1e-9;
+}
@@ -0,0 +1,327 @@
+/* Benchmark of the phases of checking a corpus, in isolation and end-to-end:
+ reading the lines, next_token, match_token, the symbol grouping,
+ match_expression (the transition[] DFA,) formatting the diagnostics as text
+ and as JSON Lines with emit.c, accept_line, the fast path that only says
+ whether a line is valid, and checkLine, which does all but the first and
+ last. Each phase works on what the one before it left in memory, so it's
+ timed alone. It includes syntax.c to get at the private functions.
+
+ Usage: phasebench <corpus> [repetitions]
+
+ @author	Neil
+ @version	1; 2016-03
+ @since		1; 2016-03 */
+
+#define _POSIX_C_SOURCE 200809L /* clock_gettime */
+
+#include <stdlib.h>	/* malloc realloc free strtoul */
+#include <time.h>		/* clock_gettime */
+#include <errno.h>		/* errno */
+#include "../src/syntax.c"
+#include "../src/input.h"	/* openInput readBlock closeInput */
+#include "../src/emit.h"	/* initEmit emitDiagnostic endEmit */
+
+struct Span {
+	const char *a;
+	size_t size;
+};
+
+/* everything the phases leave for the next */
+struct Corpus {
+	const char *block;
+	size_t size;
+	struct Span *lines;
+	size_t lines_size;
+	struct Span *tokens;
+	size_t tokens_size;
+	size_t *line_tokens; /* index of the first token of each line, and end */
+	unsigned char *symbols;
+	struct Error *errors; /* of the lines that are not valid */
+	size_t *invalid;
+	size_t invalid_size;
+	struct Arena arena; /* for checking the lines that are not valid */
+};
+
+/* a phase is called repetitions times and the fastest is reported; it
+ returns something that depends on all the work so it can't be left out */
+typedef size_t (*Phase)(struct Corpus *const c);
+
+/* private */
+static size_t phase_read(struct Corpus *const c);
+static size_t phase_next_token(struct Corpus *const c);
+static size_t phase_match_token(struct Corpus *const c);
+static size_t phase_group(struct Corpus *const c);
+static size_t phase_match_expression(struct Corpus *const c);
+static size_t phase_format(struct Corpus *const c);
+static size_t phase_format_jsonl(struct Corpus *const c);
+static size_t format(struct Corpus *const c, const enum EmitFormat format);
+static size_t phase_accept_line(struct Corpus *const c);
+static size_t phase_check_line(struct Corpus *const c);
+static int prepare(struct Corpus *const c);
+static void *grow(void *const a, size_t *const capacity, const size_t size,
+	const size_t item);
+static double now(void);
+
+static FILE *sink;
+
+/** Entry point.
+ @param argc	The number of arguments, starting with the programme name.
+ @param argv	The arguments.
+ @return		Either EXIT_SUCCESS or EXIT_FAILURE. */
+int main(int argc, char **argv) {
+	static const struct { const char *name; Phase phase; } phases[] = {
+		{ "read lines",       &phase_read },
+		{ "next_token",       &phase_next_token },
+		{ "match_token",      &phase_match_token },
+		{ "symbol grouping",  &phase_group },
+		{ "match_expression", &phase_match_expression },
+		{ "format",           &phase_format },
+		{ "format jsonl",     &phase_format_jsonl },
+		{ "accept_line",      &phase_accept_line },
+		{ "checkLine",        &phase_check_line }
+	};
+	struct Corpus c;
+	struct Input input;
+	const unsigned long reps = argc > 2 ? strtoul(argv[2], 0, 10) : 5;
+	unsigned long r;
+	unsigned i;
+	volatile size_t check = 0; /* so the work of the phases is kept */
+	double t0, t, best;
+	int is_input = 0, is_ok = 0;
+
+	memset(&c, 0, sizeof c);
+	initArena(&c.arena);
+	if(argc < 2 || argc > 3 || !reps) {
+		fprintf(stderr, "Usage: %s <corpus> [repetitions]\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	/* try */ do {
+
+		if(!openInput(&input, argv[1])) break;
+		is_input = -1;
+		if(!input.map) { errno = EINVAL; break; } /* a regular file */
+		if(!(c.block = readBlock(&input, &c.size))) break;
+		if(!(sink = fopen("/dev/null", "w"))) break;
+		setvbuf(sink, 0, _IOFBF, 1 << 16);
+		if(!prepare(&c)) break;
+
+		printf("%s: %lu bytes, %lu lines, %lu tokens, %lu not valid; "
+			"classify %s; best of %lu\n", argv[1], (unsigned long)c.size,
+			(unsigned long)c.lines_size, (unsigned long)c.tokens_size,
+			(unsigned long)c.invalid_size, classifyName(), reps);
+		printf("%-18s %10s %10s %12s %9s\n", "phase", "s", "MB/s",
+			"lines/s", "ns/line");
+		for(i = 0; i < sizeof phases / sizeof *phases; i++) {
+			for(best = 0.0, r = 0; r < reps; r++) {
+				t0 = now();
+				check += phases[i].phase(&c);
+				t = now() - t0;
+				if(!r || t < best) best = t;
+			}
+			printf("%-18s %10.4f %10.1f %12.0f %9.2f\n", phases[i].name, best,
+				best > 0.0 ? c.size / best * 1e-6 : 0.0,
+				best > 0.0 ? c.lines_size / best : 0.0,
+				c.lines_size ? best * 1e9 / c.lines_size : 0.0);
+		}
+		is_ok = -1;
+
+	} while(0); /* finally */ {
+
+		if(!is_ok) perror(argv[1]);
+		if(is_input) closeInput(&input);
+		if(sink) fclose(sink);
+		free(c.lines);
+		free(c.tokens);
+		free(c.line_tokens);
+		free(c.symbols);
+		free(c.errors);
+		free(c.invalid);
+		freeArena(&c.arena);
+
+	}
+	return is_ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/* private */
+
+/** Splits the block into lines. */
+static size_t phase_read(struct Corpus *const c) {
+	const char *line, *eol;
+	const char *const end = c->block + c->size;
+	size_t n = 0;
+
+	for(line = c->block; line < end; line = eol, n++) {
+		eol = memchr(line, '\n', end - line);
+		eol = eol ? eol + 1 : end;
+		c->lines[n].a    = line;
+		c->lines[n].size = eol - line;
+	}
+	return n;
+}
+
+/** Tokenises every line. */
+static size_t phase_next_token(struct Corpus *const c) {
+	struct Scan scan;
+	struct Error e;
+	size_t i, n = 0, length;
+
+	for(i = 0; i < c->lines_size; i++) {
+		initScan(&scan, &e, c->lines[i].a, c->lines[i].size);
+		while(nextScan(&scan, &length)) n += length;
+	}
+	return n;
+}
+
+/** Matches every token. */
+static size_t phase_match_token(struct Corpus *const c) {
+	const struct Token *t;
+	struct Error e;
+	size_t i, n = 0;
+
+	for(i = 0; i < c->tokens_size; i++) {
+		t = match_token(&e, c->tokens[i].a, c->tokens[i].size);
+		c->symbols[i] = t ? t->symbol : Y_SYMBOL_NO;
+		n += c->symbols[i];
+	}
+	return n;
+}
+
+/** Groups the symbols of every line as they would be for a diagnostic. */
+static size_t phase_group(struct Corpus *const c) {
+	struct Group g;
+	size_t i, j, n = 0;
+
+	for(i = 0; i < c->lines_size; i++) {
+		g.prefix_size = g.size = g.run = 0;
+		for(j = c->line_tokens[i]; j < c->line_tokens[i + 1]; j++)
+			if(c->symbols[j] < Y_SYMBOL_NO) group_push(&g, c->symbols[j]);
+		group_end(&g);
+		n += g.size;
+	}
+	return n;
+}
+
+/** Runs the symbols of every line through transition[]. */
+static size_t phase_match_expression(struct Corpus *const c) {
+	size_t i, j, n = 0;
+	unsigned state;
+
+	for(i = 0; i < c->lines_size; i++) {
+		state = S_START;
+		for(j = c->line_tokens[i]; j < c->line_tokens[i + 1]; j++) {
+			state = c->symbols[j] < Y_SYMBOL_NO
+				? transition[state][c->symbols[j]] : S_DEAD;
+		}
+		n += !!(accept & (1u << state));
+	}
+	return n;
+}
+
+/** Formats the diagnostics as main.c does, to /dev/null. */
+static size_t phase_format(struct Corpus *const c) {
+	return format(c, EMIT_TEXT);
+}
+
+static size_t phase_format_jsonl(struct Corpus *const c) {
+	return format(c, EMIT_JSONL);
+}
+
+/** Writes the diagnostics in format to /dev/null.
+ @return	The number of them, or 0 if the buffer couldn't be allocated. */
+static size_t format(struct Corpus *const c, const enum EmitFormat format) {
+	struct Emit emit;
+	size_t i;
+
+	if(!initEmit(&emit, sink, format, "q1", "bench")) return 0;
+	emit.name_max = 16;
+	for(i = 0; i < c->invalid_size; i++) {
+		const struct Span *const l = c->lines + c->invalid[i];
+		const struct Error *const e = c->errors + i;
+		emitDiagnostic(&emit, "corpus.txt", c->invalid[i] + 1, l->a, l->size,
+			e->index, e->error, e->expected, e->suggestion);
+	}
+	endEmit(&emit);
+	return c->invalid_size;
+}
+
+/** Only the fast path, which needs nothing from the phases before. */
+static size_t phase_accept_line(struct Corpus *const c) {
+	size_t i, n = 0;
+
+	for(i = 0; i < c->lines_size; i++)
+		n += !accept_line(c->lines[i].a, c->lines[i].size, 0);
+	return n;
+}
+
+/** All but reading and formatting. */
+static size_t phase_check_line(struct Corpus *const c) {
+	struct Error e;
+	size_t i, n = 0;
+
+	e.arena = &c->arena;
+	for(i = 0; i < c->lines_size; i++)
+		n += !checkLine(&e, c->lines[i].a, c->lines[i].size);
+	return n;
+}
+
+/** Runs the phases once, keeping what they find, so they can be timed
+ alone. */
+static int prepare(struct Corpus *const c) {
+	struct Scan scan;
+	struct Error e;
+	const char *tok, *eol;
+	const char *const end = c->block + c->size;
+	size_t i, length, lines_capacity = 0, tokens_capacity = 0,
+		invalid_capacity = 0, errors_capacity = 0;
+
+	e.arena = &c->arena;
+	for(tok = c->block; tok < end; tok = eol, c->lines_size++)
+		eol = (eol = memchr(tok, '\n', end - tok)) ? eol + 1 : end;
+	if(!(c->lines = grow(0, &lines_capacity, c->lines_size, sizeof *c->lines))
+		|| !(c->line_tokens = malloc((c->lines_size + 1)
+		* sizeof *c->line_tokens))) return 0;
+	phase_read(c);
+
+	for(i = 0; i < c->lines_size; i++) {
+		c->line_tokens[i] = c->tokens_size;
+		initScan(&scan, &e, c->lines[i].a, c->lines[i].size);
+		while((tok = nextScan(&scan, &length))) {
+			if(!(c->tokens = grow(c->tokens, &tokens_capacity,
+				c->tokens_size + 1, sizeof *c->tokens))) return 0;
+			c->tokens[c->tokens_size].a      = tok;
+			c->tokens[c->tokens_size++].size = length;
+		}
+		if(checkLine(&e, c->lines[i].a, c->lines[i].size)) continue;
+		if(!(c->invalid = grow(c->invalid, &invalid_capacity,
+			c->invalid_size + 1, sizeof *c->invalid))
+			|| !(c->errors = grow(c->errors, &errors_capacity,
+			c->invalid_size + 1, sizeof *c->errors))) return 0;
+		c->invalid[c->invalid_size]  = i;
+		c->errors[c->invalid_size++] = e;
+	}
+	c->line_tokens[c->lines_size] = c->tokens_size;
+	if(!(c->symbols = malloc(c->tokens_size + 1))) return 0;
+	phase_match_token(c);
+	return -1;
+}
+
+/** Makes a, of items, at least size; capacity is the size now. */
+static void *grow(void *const a, size_t *const capacity, const size_t size,
+	const size_t item) {
+	size_t c = *capacity ? *capacity : 1024;
+	void *b;
+
+	if(size <= *capacity) return a;
+	while(c < size) c <<= 1;
+	if(!(b = realloc(a, c * item))) { free(a); return 0; }
+	*capacity = c;
+	return b;
+}
+
+/** @return Seconds. */
+static double now(void) {
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec + t.tv_nsec * 1e-9;
+}
@@ -0,0 +1,506 @@
+/* Generates the tables of the robot language at build-time from grammar.txt,
+ so that syntax.c doesn't have hand-sorted tables that have to agree with each
+ other: the ids of the tokens, tokens[] in the order that keywords.h ranks
+ them, the names that tokens and symbols are printed with, and the DFA of the
+ forms of a line, with its closure for repairs.
+
+ The forms are an NFA with a position before each symbol and one at the end;
+ a symbol with * stays where it is, and can be skipped. It's made
+ deterministic by the subset construction, over sets of positions, and then
+ minimised by splitting the accepting and not accepting states until no two
+ states in a class go to different classes on any symbol. The states are
+ numbered in the order that they're first reached from S_START, with the
+ dead state first, and named by the symbols on the way there. insert[][] is
+ the fewest symbols from one state to another, by Floyd-Warshall.
+
+ Usage: gengrammar <grammar.txt> > grammar.h
+
+ @author	Neil
+ @version	1; 2016-03
+ @since		1; 2016-03 */
+
+#include <stdio.h>	/* printf fprintf fopen fgets */
+#include <stdlib.h>	/* EXIT_* qsort */
+#include <string.h>	/* strcmp strcpy strchr strtok memcmp memcpy memset */
+#include <ctype.h>	/* isupper isdigit */
+#include <stdint.h>	/* uint64_t */
+
+/* the sizes of the tables; transition[] is bytes, and accept is a bit for
+ each state */
+#define WORD_MAX     32
+#define SYMBOLS_MAX  32
+#define KEYWORDS_MAX 256
+#define FORMS_MAX    32
+#define FORM_MAX     15
+#define DFA_MAX      256
+#define STATES_MAX   32
+#define POSITIONS    (FORMS_MAX * (FORM_MAX + 1) + 1)
+#define SET_WORDS    ((POSITIONS + 63) / 64)
+
+/* the last position is only in S_START, because a blank line is valid */
+static const unsigned blank = POSITIONS - 1;
+static const unsigned char none = 255;
+
+/* the names that syntax.c uses */
+static const char *const needs[] = { "COMMAND", "NUMBER", "STRING", "WHILE",
+	"END" };
+
+struct Set { uint64_t bit[SET_WORDS]; };
+
+struct Grammar {
+	struct Symbol {
+		char name[WORD_MAX], printed[WORD_MAX];
+	} symbols[SYMBOLS_MAX];
+	unsigned symbols_size;
+	char group[WORD_MAX];
+	struct Keyword {
+		char name[WORD_MAX], op[WORD_MAX];
+		unsigned symbol;
+	} keywords[KEYWORDS_MAX], *sorted[KEYWORDS_MAX];
+	unsigned keywords_size;
+	struct Form {
+		unsigned char symbol[FORM_MAX], is_star[FORM_MAX];
+		unsigned size;
+	} forms[FORMS_MAX];
+	unsigned forms_size;
+	/* the subset construction */
+	struct Set sets[DFA_MAX];
+	unsigned dfa[DFA_MAX][SYMBOLS_MAX], dfa_size, class[DFA_MAX];
+	int is_final[DFA_MAX];
+	/* minimised */
+	unsigned transition[STATES_MAX][SYMBOLS_MAX], states_size, accept,
+		parent[DFA_MAX], via[DFA_MAX];
+	unsigned char insert[STATES_MAX][STATES_MAX];
+	char names[STATES_MAX][64];
+	uint64_t hash; /* of every byte of the file, FNV-1a */
+};
+
+/* private */
+static int load(const char *const fn, struct Grammar *const g);
+static int load_line(struct Grammar *const g, char *const line);
+static int is_name(const char *const s);
+static unsigned symbol_index(const struct Grammar *const g,
+	const char *const name);
+static int determinise(struct Grammar *const g);
+static void closure(const struct Grammar *const g, struct Set *const set);
+static int is_set(const struct Set *const set, const unsigned p);
+static void minimise(struct Grammar *const g);
+static void name_states(struct Grammar *const g);
+static void shortest(struct Grammar *const g);
+static void print(const struct Grammar *const g, const char *const fn);
+static int keyword_compare(const void *a, const void *b);
+
+/** Entry point.
+ @param argc	The number of arguments, starting with the programme name.
+ @param argv	The arguments.
+ @return		Either EXIT_SUCCESS or EXIT_FAILURE. */
+int main(int argc, char **argv) {
+	static struct Grammar g;
+	unsigned i;
+
+	if(argc != 2) {
+		fprintf(stderr, "Usage: %s <grammar.txt> > grammar.h\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+	if(!load(argv[1], &g)) return EXIT_FAILURE;
+	for(i = 0; i < g.keywords_size; i++) g.sorted[i] = g.keywords + i;
+	qsort(g.sorted, g.keywords_size, sizeof *g.sorted, &keyword_compare);
+	if(!determinise(&g)) {
+		fprintf(stderr, "%s: more than %u states before minimising.\n",
+			argv[1], DFA_MAX);
+		return EXIT_FAILURE;
+	}
+	minimise(&g);
+	if(g.states_size > STATES_MAX) {
+		fprintf(stderr, "%s: %u states; at most %u.\n", argv[1],
+			g.states_size, STATES_MAX);
+		return EXIT_FAILURE;
+	}
+	name_states(&g);
+	shortest(&g);
+	print(&g, argv[1]);
+	return EXIT_SUCCESS;
+}
+
+/* private */
+
+/** Reads fn into g and checks that it's all there.
+ @return	Success, or it's printed why not. */
+static int load(const char *const fn, struct Grammar *const g) {
+	FILE *fp;
+	char line[256];
+	unsigned line_no = 0, i, j;
+	size_t len;
+	const char *c;
+	int is_ok = -1;
+
+	if(!(fp = fopen(fn, "r"))) { perror(fn); return 0; }
+	g->hash = 0xcbf29ce484222325u;
+	while(fgets(line, sizeof line, fp)) {
+		for(c = line; *c; c++)
+			g->hash = (g->hash ^ (unsigned char)*c) * 0x100000001b3u;
+		line_no++;
+		for(len = strlen(line); len && strchr(" \t\r\n", line[len - 1]); len--);
+		line[len] = '\0';
+		if(!len || *line == '#') continue;
+		if(!load_line(g, line)) {
+			fprintf(stderr, "%s:%u: not understood or too many; see the top "
+				"of the file.\n", fn, line_no);
+			is_ok = 0;
+			break;
+		}
+	}
+	if(ferror(fp)) { perror(fn); is_ok = 0; }
+	fclose(fp);
+	if(!is_ok) return 0;
+	for(i = 0; i < sizeof needs / sizeof *needs; i++) {
+		if(symbol_index(g, needs[i]) < g->symbols_size) continue;
+		fprintf(stderr, "%s: symbol %s is needed by syntax.c.\n", fn, needs[i]);
+		return 0;
+	}
+	for(i = 0; i < g->keywords_size; i++) {
+		const struct Keyword *const k = g->keywords + i;
+		if(!strcmp(k->name, "NUMBER") || !strcmp(k->name, "STRING")
+			|| !strcmp(k->name, "NOT_TOKEN")) {
+			fprintf(stderr, "%s: %s is a token already.\n", fn, k->name);
+			return 0;
+		}
+		for(j = 0; j < i; j++) if(!strcmp(g->keywords[j].name, k->name)) {
+			fprintf(stderr, "%s: %s is repeated.\n", fn, k->name);
+			return 0;
+		}
+		if((k->symbol == symbol_index(g, "COMMAND")) != !!*k->op) {
+			fprintf(stderr, "%s: %s: a COMMAND, and only a COMMAND, has an "
+				"op.\n", fn, k->name);
+			return 0;
+		}
+	}
+	for(i = 0; i < g->symbols_size; i++) for(j = 0; j < i; j++)
+		if(!strcmp(g->symbols[j].name, g->symbols[i].name)) {
+		fprintf(stderr, "%s: symbol %s is repeated.\n", fn, g->symbols[i].name);
+		return 0;
+	}
+	if(!*g->group || !g->keywords_size || !g->forms_size) {
+		fprintf(stderr, "%s: needs a group, keywords, and forms.\n", fn);
+		return 0;
+	}
+	return -1;
+}
+
+/** Adds the directive in line to g.
+ @return	Whether it was one, and there was room. */
+static int load_line(struct Grammar *const g, char *const line) {
+	char *word[FORM_MAX + 2];
+	unsigned n, i;
+
+	for(n = 0, word[0] = strtok(line, " \t"); word[n] && n <= FORM_MAX;
+		word[++n] = strtok(0, " \t"));
+	if(n < 2 || word[n]) return 0;
+	if(!strcmp(word[0], "symbol")) {
+		struct Symbol *const s = g->symbols + g->symbols_size;
+		if(n > 3 || g->symbols_size >= SYMBOLS_MAX || !is_name(word[1])
+			|| (n == 3 && strlen(word[2]) >= WORD_MAX)) return 0;
+		strcpy(s->name, word[1]);
+		strcpy(s->printed, word[n - 1]);
+		g->symbols_size++;
+	} else if(!strcmp(word[0], "group")) {
+		if(n > 2 || strlen(word[1]) >= WORD_MAX) return 0;
+		strcpy(g->group, word[1]);
+	} else if(!strcmp(word[0], "keyword")) {
+		struct Keyword *const k = g->keywords + g->keywords_size;
+		if(n < 3 || n > 4 || g->keywords_size >= KEYWORDS_MAX
+			|| !is_name(word[1]) || strchr(word[1], '_')
+			|| strlen(word[1]) > 16
+			|| (k->symbol = symbol_index(g, word[2])) >= g->symbols_size
+			|| (n == 4 && !is_name(word[3]))) return 0;
+		strcpy(k->name, word[1]);
+		strcpy(k->op, n == 4 ? word[3] : "");
+		g->keywords_size++;
+	} else if(!strcmp(word[0], "form")) {
+		struct Form *const f = g->forms + g->forms_size;
+		if(g->forms_size >= FORMS_MAX) return 0;
+		for(f->size = 0, i = 1; i < n; i++, f->size++) {
+			const size_t len = strlen(word[i]);
+			unsigned y;
+			if((f->is_star[f->size] = len && word[i][len - 1] == '*'))
+				word[i][len - 1] = '\0';
+			if((y = symbol_index(g, word[i])) >= g->symbols_size) return 0;
+			f->symbol[f->size] = (unsigned char)y;
+		}
+		g->forms_size++;
+	} else {
+		return 0;
+	}
+	return -1;
+}
+
+/** @return	Whether s is a name in C that starts with a capital. */
+static int is_name(const char *const s) {
+	const char *x;
+	if(strlen(s) >= WORD_MAX || !isupper((unsigned char)*s)) return 0;
+	for(x = s; *x; x++) if(!isupper((unsigned char)*x)
+		&& !isdigit((unsigned char)*x) && *x != '_') return 0;
+	return -1;
+}
+
+/** @return	The index of name in the symbols, or symbols_size. */
+static unsigned symbol_index(const struct Grammar *const g,
+	const char *const name) {
+	unsigned y;
+	for(y = 0; y < g->symbols_size && strcmp(g->symbols[y].name, name); y++);
+	return y;
+}
+
+/** The subset construction: set 0 is empty, the dead state, and set 1 is the
+ start of every form, and a blank line.
+ @return	Whether there was room. */
+static int determinise(struct Grammar *const g) {
+	unsigned s, y, f, p, t;
+
+	memset(g->sets, 0, 2 * sizeof *g->sets);
+	for(f = 0; f < g->forms_size; f++) p = f * (FORM_MAX + 1),
+		g->sets[1].bit[p >> 6] |= (uint64_t)1 << (p & 63);
+	g->sets[1].bit[blank >> 6] |= (uint64_t)1 << (blank & 63);
+	closure(g, g->sets + 1);
+	g->dfa_size = 2;
+	for(s = 0; s < g->dfa_size; s++) {
+		for(y = 0; y < g->symbols_size; y++) {
+			struct Set *const next = g->sets + g->dfa_size;
+			if(g->dfa_size >= DFA_MAX) return 0;
+			memset(next, 0, sizeof *next);
+			for(f = 0; f < g->forms_size; f++) {
+				const struct Form *const form = g->forms + f;
+				for(p = 0; p < form->size; p++) {
+					unsigned q = f * (FORM_MAX + 1) + p;
+					if(!is_set(g->sets + s, q) || form->symbol[p] != y) continue;
+					if(!form->is_star[p]) q++;
+					next->bit[q >> 6] |= (uint64_t)1 << (q & 63);
+				}
+			}
+			closure(g, next);
+			for(t = 0; t < g->dfa_size
+				&& memcmp(g->sets + t, next, sizeof *next); t++);
+			if(t == g->dfa_size) g->dfa_size++;
+			g->dfa[s][y] = t;
+		}
+	}
+	for(s = 0; s < g->dfa_size; s++) {
+		g->is_final[s] = is_set(g->sets + s, blank);
+		for(f = 0; f < g->forms_size; f++) if(is_set(g->sets + s,
+			f * (FORM_MAX + 1) + g->forms[f].size)) g->is_final[s] = -1;
+	}
+	return -1;
+}
+
+/** Adds to set the positions after every symbol with * in it. */
+static void closure(const struct Grammar *const g, struct Set *const set) {
+	unsigned f, p, q;
+	for(f = 0; f < g->forms_size; f++) {
+		for(p = 0; p < g->forms[f].size; p++) {
+			q = f * (FORM_MAX + 1) + p;
+			if(!g->forms[f].is_star[p] || !is_set(set, q)) continue;
+			q++;
+			set->bit[q >> 6] |= (uint64_t)1 << (q & 63);
+		}
+	}
+}
+
+/** @return	Whether position p is in set. */
+static int is_set(const struct Set *const set, const unsigned p) {
+	return set->bit[p >> 6] >> (p & 63) & 1 ? -1 : 0;
+}
+
+/** Splits the classes of the subset construction until they're states, and
+ numbers them from S_START in breadth-first order. */
+static void minimise(struct Grammar *const g) {
+	unsigned next[DFA_MAX], number[DFA_MAX], rep[DFA_MAX];
+	unsigned s, r, y, size = 2, next_size, i;
+
+	for(s = 0; s < g->dfa_size; s++) g->class[s] = g->is_final[s] ? 1 : 0;
+	for( ; ; ) {
+		for(next_size = 0, s = 0; s < g->dfa_size; s++) {
+			for(r = 0; r < s; r++) {
+				if(g->class[r] != g->class[s]) continue;
+				for(y = 0; y < g->symbols_size && g->class[g->dfa[r][y]]
+					== g->class[g->dfa[s][y]]; y++);
+				if(y == g->symbols_size) break;
+			}
+			next[s] = r < s ? next[r] : next_size++;
+		}
+		memcpy(g->class, next, sizeof *next * g->dfa_size);
+		if(next_size == size) break;
+		size = next_size;
+	}
+	for(i = 0; i < size; i++) number[i] = DFA_MAX;
+	for(s = g->dfa_size; s; s--) rep[g->class[s - 1]] = s - 1;
+	number[g->class[0]] = 0, number[g->class[1]] = 1;
+	g->parent[0] = g->parent[1] = 0;
+	g->states_size = 2;
+	/* breadth-first from the start; the queue is the states themselves */
+	{
+		unsigned queue[DFA_MAX];
+		queue[0] = g->class[0], queue[1] = g->class[1];
+		for(i = 1; i < g->states_size; i++) {
+			for(y = 0; y < g->symbols_size; y++) {
+				const unsigned c = g->class[g->dfa[rep[queue[i]]][y]];
+				if(number[c] == DFA_MAX) {
+					number[c] = g->states_size, queue[g->states_size] = c;
+					g->parent[g->states_size] = i, g->via[g->states_size] = y;
+					g->states_size++;
+				}
+			}
+		}
+		if(g->states_size > STATES_MAX) return;
+		g->accept = 0;
+		for(i = 0; i < g->states_size; i++) {
+			for(y = 0; y < g->symbols_size; y++) g->transition[i][y]
+				= number[g->class[g->dfa[rep[queue[i]]][y]]];
+			if(g->is_final[rep[queue[i]]]) g->accept |= 1u << i;
+		}
+	}
+}
+
+/** Names the states by the symbols that first reach them, or by number if
+ that's too long or the same as another. */
+static void name_states(struct Grammar *const g) {
+	unsigned s, t;
+
+	strcpy(g->names[0], "S_DEAD");
+	strcpy(g->names[1], "S_START");
+	for(s = 2; s < g->states_size; s++) {
+		const char *const name = g->symbols[g->via[s]].name;
+		const unsigned p = g->parent[s];
+		if(p > 1 && strlen(g->names[p]) + 1 + strlen(name) < 40)
+			sprintf(g->names[s], "%s_%s", g->names[p], name);
+		else if(p == 1)
+			sprintf(g->names[s], "S_%s", name);
+		else
+			sprintf(g->names[s], "S_%u", s);
+		for(t = 0; t < s && strcmp(g->names[t], g->names[s]); t++);
+		if(t < s || !strcmp(g->names[s], "S_STATE_NO"))
+			sprintf(g->names[s], "S_%u", s);
+	}
+}
+
+/** Fills in insert[][], the least symbols from a state to another. */
+static void shortest(struct Grammar *const g) {
+	unsigned s, t, u, y;
+
+	for(s = 0; s < g->states_size; s++) {
+		for(t = 0; t < g->states_size; t++)
+			g->insert[s][t] = s == t ? 0 : none;
+		for(y = 0; y < g->symbols_size; y++)
+			if((t = g->transition[s][y]) && t != s) g->insert[s][t] = 1;
+	}
+	for(u = 0; u < g->states_size; u++) for(s = 0; s < g->states_size; s++)
+		for(t = 0; t < g->states_size; t++) {
+		if(g->insert[s][u] == none || g->insert[u][t] == none) continue;
+		if(g->insert[s][u] + g->insert[u][t] < g->insert[s][t])
+			g->insert[s][t] = (unsigned char)(g->insert[s][u] + g->insert[u][t]);
+	}
+}
+
+/** Writes grammar.h, from fn, to stdout. */
+static void print(const struct Grammar *const g, const char *const fn) {
+	const unsigned number = symbol_index(g, "NUMBER"),
+		string = symbol_index(g, "STRING");
+	unsigned i, s, y, last;
+
+	printf("/* Generated by gen/grammar.c from %s; do not edit. It needs "
+		"robot.h. */\n\n", fn);
+
+	printf("/* a hash of %s, so that what was found with\n another "
+		"grammar, like results in a cache, can be told apart */\n"
+		"#define GRAMMAR_HASH 0x%016llxu\n\n", fn,
+		(unsigned long long)g->hash);
+
+	printf("/* every token */\nenum Tokens { NOT_TOKEN,");
+	for(i = 0; i < g->keywords_size; i++)
+		printf("%s%s,", i % 6 ? " " : "\n\t", g->keywords[i].name);
+	printf("\n\tNUMBER, STRING };\n#define TOKEN_NO %u\n\n",
+		g->keywords_size + 3);
+
+	printf("/* what the grammar sees of a token; the columns of transition[]; "
+		"Y_GROUP is\n a run of commands followed by END, for diagnostics */\n"
+		"enum Symbol {");
+	for(y = 0; y < g->symbols_size; y++) printf("%sY_%s,",
+		y % 6 ? " " : "\n\t", g->symbols[y].name);
+	printf("\n\tY_SYMBOL_NO, Y_GROUP = Y_SYMBOL_NO };\n\n");
+
+	printf("/* the tokens that are not words, then the keywords alphabetised, "
+		"as keywords.h\n ranks them; op is what a command compiles to */\n"
+		"static const struct Token {\n\tchar *string;\n\tint id;\n"
+		"\tunsigned char symbol, op;\n} tokens[] = {\n");
+	printf("\t{ \"\", NUMBER, Y_NUMBER, ROBOT_HALT },\n");
+	printf("\t{ \"\", STRING, Y_STRING, ROBOT_HALT },\n");
+	for(i = 0; i < g->keywords_size; i++) {
+		const struct Keyword *const k = g->sorted[i];
+		printf("\t{ \"%s\", %s, Y_%s, ROBOT_%s }%s\n", k->name, k->name,
+			g->symbols[k->symbol].name, *k->op ? k->op : "HALT",
+			i + 1 < g->keywords_size ? "," : "");
+	}
+	printf("};\nstatic const struct Token *const tok_number   = tokens + 0;\n"
+		"static const struct Token *const tok_string   = tokens + 1;\n"
+		"static const struct Token *const tok_keywords = tokens + 2;\n\n");
+
+	printf("/* how the tokens are printed, by enum Tokens */\n"
+		"static const char *const token_names[TOKEN_NO] = { \"<not a token>\",");
+	for(i = 0; i < g->keywords_size; i++)
+		printf("%s\"%s\",", i % 6 ? " " : "\n\t", g->keywords[i].name);
+	printf("\n\t\"%s\", \"%s\" };\n\n", g->symbols[number].printed,
+		g->symbols[string].printed);
+
+	printf("/* how the symbols are printed in the expected tokens, and "
+		"Y_GROUP */\n"
+		"static const char *const symbols[Y_SYMBOL_NO + 1] = {");
+	for(y = 0; y < g->symbols_size; y++)
+		printf("%s\"%s\",", y % 6 ? " " : "\n\t", g->symbols[y].printed);
+	printf("\n\t\"%s\" };\n\n", g->group);
+
+	printf("/* the valid lines as a DFA over the symbols, from the forms:\n");
+	for(i = 0; i < g->forms_size; i++) {
+		printf(" ");
+		for(s = 0; s < g->forms[i].size; s++)
+			printf(" %s%s", g->symbols[g->forms[i].symbol[s]].name,
+			g->forms[i].is_star[s] ? "*" : "");
+		printf("%s\n", i + 1 < g->forms_size ? "," : ";");
+	}
+	printf(" and a blank line; anything not here goes to S_DEAD */\n"
+		"enum State {");
+	for(s = 0; s < g->states_size; s++)
+		printf("%s%s,", s % 4 ? " " : "\n\t", g->names[s]);
+	printf("\n\tS_STATE_NO };\n");
+	printf("static const unsigned char "
+		"transition[S_STATE_NO][Y_SYMBOL_NO] = {\n");
+	for(s = 0; s < g->states_size; s++) {
+		for(last = g->symbols_size; last && !g->transition[s][last - 1];
+			last--);
+		printf("\t/* %s */ {", g->names[s]);
+		if(!last) printf(" 0");
+		for(y = 0; y < last; y++) printf("%s %s", y ? "," : "",
+			g->transition[s][y] ? g->names[g->transition[s][y]] : "0");
+		printf(" }%s\n", s + 1 < g->states_size ? "," : "");
+	}
+	printf("};\nstatic const unsigned accept =");
+	for(i = 0, s = 0; s < g->states_size; s++) if(g->accept & (1u << s))
+		printf("%s 1u << %s", i++ ? " |" : "", g->names[s]);
+	printf(";\n\n");
+
+	printf("/* the least number of symbols that take transition[] from the row "
+		"to the\n column, or none; it's the closure of transition[], for "
+		"repairs */\n"
+		"static const unsigned char insert[S_STATE_NO][S_STATE_NO] = {\n");
+	for(s = 0; s < g->states_size; s++) {
+		printf("\t/* %s */ {", g->names[s]);
+		for(i = 0; i < g->states_size; i++) printf("%s %u", i ? "," : "",
+			g->insert[s][i]);
+		printf(" }%s\n", s + 1 < g->states_size ? "," : "");
+	}
+	printf("};\n");
+}
+
+/** {@see qsort} on struct Keyword *. */
+static int keyword_compare(const void *a, const void *b) {
+	const struct Keyword *const*ka = a, *const*kb = b;
+	return strcmp((*ka)->name, (*kb)->name);
+}
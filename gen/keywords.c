@@ -0,0 +1,259 @@
+/* Generates a perfect hash of the keywords at build-time, so that syntax.c
+ can recognise a keyword with one hash and one compare instead of bsearch
+ over tokens[] with tokstrcmp.
+
+ A word of up to keyword_max characters is copied into two 64-bit words,
+ padded with zeros, and folded to capitals by clearing bit 5 of every byte;
+ that's exact for letters, and any other byte that it changes can't be in a
+ keyword. The hash is
+ ((word[0] ^ word[1] * keyword_mix) * keyword_multiply) >> keyword_shift;
+ this tries multipliers until no two keywords collide, doubling the table if
+ it can't find one. The table entry holds the rank of the keyword in
+ alphabetical order, which is its place in tokens[] after the tokens that are
+ not words, {@see gen/grammar.c}.
+
+ For suggestions, the keywords are also packed side by side into as few 64-bit
+ words as they fit, longest first, a lane of bits for each; suggest_eq has,
+ for every byte, in either case, the bits of the letters of every lane that
+ are that byte, so syntax.c can compute the edit distance from a token to all
+ of them at once. suggest_length is the length of every keyword in four bit
+ planes, at the top bit of its lane, which is where syntax.c counts the
+ distance, starting from the length.
+
+ Usage: genkeywords <grammar.txt> > keywords.h
+
+ @author	Neil
+ @version	1; 2016-03
+ @since		1; 2016-03 */
+
+#include <stdio.h>	/* fprintf fgets */
+#include <stdlib.h>	/* EXIT_* qsort */
+#include <string.h>	/* strlen strcmp strncmp strchr memcpy */
+#include <stdint.h>	/* uint64_t */
+
+/* constants */
+static const unsigned keyword_max  = 16;
+static const unsigned keywords_max = 256;
+static const uint64_t keyword_mix  = 0x9e3779b97f4a7c15u;
+static const unsigned long tries   = 1000000;
+
+struct Keyword {
+	char string[17];
+	uint64_t word[2];
+	unsigned length, rank, lane_word, lane_shift;
+};
+
+/* private */
+static int load(const char *const fn, struct Keyword *const k,
+	unsigned *const k_size);
+static uint64_t next_random(uint64_t *const x);
+static int string_compare(const void *a, const void *b);
+static int length_compare(const void *a, const void *b);
+
+/** Entry point.
+ @param argc	The number of arguments, starting with the programme name.
+ @param argv	The arguments.
+ @return		Either EXIT_SUCCESS or EXIT_FAILURE. */
+int main(int argc, char **argv) {
+	struct Keyword k[256], *sorted[256];
+	unsigned k_size = 0, bits, i, j, max = 0, words = 0, c;
+	unsigned word_bits[256];
+	uint64_t low[256], high[256], row[256], any;
+	unsigned char used[1 << 12];
+	uint64_t multiply = 0, x = 0x2545f4914f6cdd1du;
+	unsigned long t;
+	int is_found = 0;
+
+	if(argc != 2) {
+		fprintf(stderr, "Usage: %s <grammar.txt> > keywords.h\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+	if(!load(argv[1], k, &k_size)) return EXIT_FAILURE;
+
+	/* the rank is the order in tokens[] */
+	for(i = 0; i < k_size; i++) sorted[i] = k + i;
+	qsort(sorted, k_size, sizeof *sorted, &string_compare);
+	for(i = 0; i < k_size; i++) sorted[i]->rank = i;
+	for(i = 0; i < k_size; i++) if(k[i].length > max) max = k[i].length;
+
+	/* find a multiplier with no collisions in the smallest table */
+	for(bits = 1; (1u << bits) < k_size; bits++);
+	for( ; !is_found && bits <= 12; bits++) {
+		for(t = 0; t < tries; t++) {
+			multiply = next_random(&x) | 1;
+			memset(used, 0, 1u << bits);
+			for(i = 0; i < k_size; i++) {
+				const unsigned h = (unsigned)(((k[i].word[0] ^ k[i].word[1]
+					* keyword_mix) * multiply) >> (64 - bits));
+				if(used[h]) break;
+				used[h] = 1;
+			}
+			if(i == k_size) { is_found = -1; break; }
+		}
+		if(is_found) break;
+	}
+	if(!is_found) {
+		fprintf(stderr, "%s: no perfect hash found.\n", argv[1]);
+		return EXIT_FAILURE;
+	}
+
+	printf("/* Generated by gen/keywords.c from %s; do not edit. */\n\n",
+		argv[1]);
+	printf("#define KEYWORD_MAX %u\n", max);
+	printf("#define KEYWORD_SHIFT %u\n", 64 - bits);
+	printf("#define KEYWORD_MIX 0x%016llxu\n", (unsigned long long)keyword_mix);
+	printf("#define KEYWORD_MULTIPLY 0x%016llxu\n\n",
+		(unsigned long long)multiply);
+	printf("static const struct Keyword {\n"
+		"\tuint64_t word[2];\n"
+		"\tunsigned char length, rank;\n"
+		"} keywords[] = {\n");
+	for(j = 0; j < (1u << bits); j++) {
+		for(i = 0; i < k_size; i++) {
+			if((unsigned)(((k[i].word[0] ^ k[i].word[1] * keyword_mix)
+				* multiply) >> (64 - bits)) == j) break;
+		}
+		if(i < k_size) {
+			printf("\t{ { 0x%016llxu, 0x%016llxu }, %2u, %2u }%s /* %s */\n",
+				(unsigned long long)k[i].word[0],
+				(unsigned long long)k[i].word[1], k[i].length, k[i].rank,
+				j + 1 < (1u << bits) ? "," : "", k[i].string);
+		} else {
+			printf("\t{ { 0, 0 }, 0, 0 }%s\n", j + 1 < (1u << bits) ? "," :"");
+		}
+	}
+	printf("};\n");
+
+	/* the lanes for suggestions, first fit in order of length */
+	qsort(sorted, k_size, sizeof *sorted, &length_compare);
+	for(i = 0; i < k_size; i++) {
+		struct Keyword *const s = sorted[i];
+		for(j = 0; j < words && word_bits[j] + s->length > 64; j++);
+		if(j == words) word_bits[words] = 0, low[words] = high[words] = 0,
+			words++;
+		s->lane_word  = j;
+		s->lane_shift = word_bits[j];
+		word_bits[j] += s->length;
+		low[j]  |= (uint64_t)1 << s->lane_shift;
+		high[j] |= (uint64_t)1 << (s->lane_shift + s->length - 1);
+	}
+	qsort(sorted, k_size, sizeof *sorted, &string_compare);
+	printf("\n#define SUGGEST_WORDS %u\n\n", words);
+	printf("static const struct SuggestLane {\n"
+		"\tunsigned char word, shift, length;\n"
+		"} suggest_lanes[] = {\n");
+	for(i = 0; i < k_size; i++) printf("\t{ %u, %2u, %2u }%s /* %s */\n",
+		sorted[i]->lane_word, sorted[i]->lane_shift, sorted[i]->length,
+		i + 1 < k_size ? "," : "", sorted[i]->string);
+	printf("};\n");
+	printf("static const uint64_t suggest_low[] = {");
+	for(j = 0; j < words; j++) printf("%s 0x%016llxu", j ? "," : "",
+		(unsigned long long)low[j]);
+	printf(" };\nstatic const uint64_t suggest_high[] = {");
+	for(j = 0; j < words; j++) printf("%s 0x%016llxu", j ? "," : "",
+		(unsigned long long)high[j]);
+	printf(" };\nstatic const uint64_t suggest_length[4][SUGGEST_WORDS] = {\n");
+	for(c = 0; c < 4; c++) {
+		printf("\t{");
+		for(j = 0; j < words; j++) {
+			uint64_t plane = 0;
+			for(i = 0; i < k_size; i++) if(k[i].lane_word == j
+				&& k[i].length >> c & 1) plane |= (uint64_t)1
+				<< (k[i].lane_shift + k[i].length - 1);
+			printf("%s 0x%016llxu", j ? "," : "", (unsigned long long)plane);
+		}
+		printf(" }%s\n", c < 3 ? "," : "");
+	}
+	printf("};\nstatic const uint64_t suggest_eq[256][SUGGEST_WORDS] = {\n");
+	for(c = 'A'; c <= 'Z'; c++) {
+		unsigned w;
+		for(any = 0, w = 0; w < words; w++) {
+			for(row[w] = 0, i = 0; i < k_size; i++) {
+				if(k[i].lane_word != w) continue;
+				for(j = 0; j < k[i].length; j++) if(k[i].string[j] == (char)c)
+					row[w] |= (uint64_t)1 << (k[i].lane_shift + j);
+			}
+			any |= row[w];
+		}
+		if(!any) continue;
+		for(i = 0; i < 2; i++) {
+			printf("\t['%c'] = {", i ? c - 'A' + 'a' : c);
+			for(w = 0; w < words; w++) printf("%s 0x%016llxu", w ? "," : "",
+				(unsigned long long)row[w]);
+			printf(" },\n");
+		}
+	}
+	printf("};\n");
+
+	return EXIT_SUCCESS;
+}
+
+/* private */
+
+/** Reads the keywords in fn into k, the first word after keyword at the
+ start of a line, {@see grammar.txt}; the rest is gen/grammar.c's. */
+static int load(const char *const fn, struct Keyword *const k,
+	unsigned *const k_size) {
+	FILE *fp;
+	char buffer[256], *line;
+	unsigned line_no = 0, i;
+	size_t len;
+	int is_ok = -1;
+
+	if(!(fp = fopen(fn, "r"))) { perror(fn); return 0; }
+	while(fgets(buffer, sizeof buffer, fp)) {
+		line_no++;
+		if(strncmp(buffer, "keyword", 7) || !strchr(" \t", buffer[7]))
+			continue;
+		for(line = buffer + 8; *line == ' ' || *line == '\t'; line++);
+		for(len = 0; line[len] && !strchr(" \t\r\n", line[len]); len++);
+		line[len] = '\0';
+		for(i = 0; i < len && line[i] >= 'A' && line[i] <= 'Z'; i++);
+		if(!len || i < len || len > keyword_max || *k_size >= keywords_max) {
+			fprintf(stderr, "%s:%u: keywords are 1-%u capitals, at most %u.\n",
+				fn, line_no, keyword_max, keywords_max);
+			is_ok = 0;
+			break;
+		}
+		for(i = 0; i < *k_size; i++) if(!strcmp(k[i].string, line)) break;
+		if(i < *k_size) {
+			fprintf(stderr, "%s:%u: %s is repeated.\n", fn, line_no, line);
+			is_ok = 0;
+			break;
+		}
+		strcpy(k[*k_size].string, line);
+		k[*k_size].word[0] = k[*k_size].word[1] = 0;
+		memcpy(k[*k_size].word, line, len);
+		k[*k_size].length = len;
+		(*k_size)++;
+	}
+	if(ferror(fp)) { perror(fn); is_ok = 0; }
+	fclose(fp);
+	if(is_ok && !*k_size) {
+		fprintf(stderr, "%s: no keywords.\n", fn);
+		is_ok = 0;
+	}
+	return is_ok;
+}
+
+/** xorshift64*; the same every build. */
+static uint64_t next_random(uint64_t *const x) {
+	*x ^= *x >> 12;
+	*x ^= *x << 25;
+	*x ^= *x >> 27;
+	return *x * 0x2545f4914f6cdd1du;
+}
+
+/** {@see qsort} on struct Keyword *. */
+static int string_compare(const void *a, const void *b) {
+	const struct Keyword *const*ka = a, *const*kb = b;
+	return strcmp((*ka)->string, (*kb)->string);
+}
+
+/** {@see qsort} on struct Keyword *, longest first. */
+static int length_compare(const void *a, const void *b) {
+	const struct Keyword *const*ka = a, *const*kb = b;
+	return (*ka)->length != (*kb)->length
+		? ((*ka)->length < (*kb)->length ? 1 : -1)
+		: strcmp((*ka)->string, (*kb)->string);
+}
@@ -0,0 +1,123 @@
+/* What a script costs the robot before it's run, from the lines that
+ {@see analyzeLine} has read: the commands it executes and the steps it
+ takes, in all and for the lines that cost the most. A count of a REPEAT is
+ up to 2^64 - 1 and a line has a bounded number of commands, so a line is
+ exact in 128 bits, and the total of the lines goes up to 2^128 - 1 and
+ stops there. The lines are added as they're checked, one at a time, and
+ nothing is kept of them but the few at the top.
+
+ @author	Neil
+ @version	1; 2016-03
+ @since		1; 2016-03 */
+
+#include <string.h>		/* memcpy memmove */
+#include "analyze.h"
+
+/* private prototypes */
+static uint32_t divide(struct Cost *const a, const uint32_t d);
+
+/* public */
+
+/** @return	The exact product of a and b. */
+struct Cost costProduct(const uint64_t a, const uint64_t b) {
+	const uint64_t a_lo = a & 0xffffffffu, a_hi = a >> 32,
+		b_lo = b & 0xffffffffu, b_hi = b >> 32,
+		ll = a_lo * b_lo, lh = a_lo * b_hi, hl = a_hi * b_lo, hh = a_hi * b_hi,
+		mid = (ll >> 32) + (lh & 0xffffffffu) + (hl & 0xffffffffu);
+	struct Cost c;
+
+	c.lo = (mid << 32) | (ll & 0xffffffffu);
+	c.hi = hh + (lh >> 32) + (hl >> 32) + (mid >> 32);
+	return c;
+}
+
+/** Adds b to a; if it's more than 2^128 - 1, that's what it is. */
+void costAdd(struct Cost *const a, const struct Cost *const b) {
+	const uint64_t lo = a->lo + b->lo, carry = lo < a->lo;
+
+	if(a->hi > UINT64_MAX - b->hi || a->hi + b->hi > UINT64_MAX - carry) {
+		a->hi = a->lo = UINT64_MAX;
+	} else {
+		a->hi += b->hi + carry;
+		a->lo  = lo;
+	}
+}
+
+/** @return	Less than, equal to, or greater than zero as a is to b. */
+int costCompare(const struct Cost *const a, const struct Cost *const b) {
+	if(a->hi != b->hi) return a->hi < b->hi ? -1 : 1;
+	return a->lo < b->lo ? -1 : a->lo > b->lo;
+}
+
+/** @return	a, about. */
+double costDouble(const struct Cost *const a) {
+	return a->hi * 18446744073709551616.0 + a->lo;
+}
+
+/** Writes a in decimal to s, which has room for 40 bytes.
+ @return	s. */
+char *costString(char *const s, const struct Cost *const a) {
+	struct Cost q = *a;
+	char digits[40], *d = digits + sizeof digits;
+
+	*--d = '\0';
+	do *--d = (char)('0' + divide(&q, 10)); while(q.hi || q.lo);
+	memcpy(s, d, (size_t)(digits + sizeof digits - d));
+	return s;
+}
+
+/** Initialises a to nothing. */
+void initAnalysis(struct Analysis *const a) {
+	a->lines     = 0;
+	a->unbounded = 0;
+	a->commands.hi = a->commands.lo = 0;
+	a->steps.hi    = a->steps.lo    = 0;
+	a->top_size  = 0;
+}
+
+/** Adds the next line of the script, of length, to a; if it's not valid,
+ cost is null. */
+void addAnalysis(struct Analysis *const a, const char *const line,
+	const size_t length, const struct LineCost *const cost) {
+	struct AnalysisLine *t;
+	size_t i, n;
+
+	a->lines++;
+	if(!cost) return;
+	costAdd(&a->commands, &cost->commands);
+	costAdd(&a->steps, &cost->steps);
+	if(cost->is_unbounded) a->unbounded++;
+	if(!cost->commands.hi && !cost->commands.lo) return;
+	/* the first of the lines that cost the same stays first */
+	for(i = a->top_size; i && costCompare(&a->top[i - 1].cost.commands,
+		&cost->commands) < 0; i--);
+	if(i >= ANALYSIS_TOP) return;
+	if(a->top_size < ANALYSIS_TOP) a->top_size++;
+	memmove(a->top + i + 1, a->top + i, (a->top_size - 1 - i) * sizeof *t);
+	t = a->top + i;
+	t->line = a->lines;
+	t->cost = *cost;
+	for(n = 0; n < length && n < sizeof t->text - 1
+		&& line[n] != '\n' && line[n] != '\r'; n++);
+	memcpy(t->text, line, n);
+	t->text[n] = '\0';
+}
+
+/* private */
+
+/** Divides a by d in place, a 32-bit piece at a time.
+ @return	The remainder. */
+static uint32_t divide(struct Cost *const a, const uint32_t d) {
+	const uint64_t p[4] = { a->hi >> 32, a->hi & 0xffffffffu, a->lo >> 32,
+		a->lo & 0xffffffffu };
+	uint64_t q[4], r = 0;
+	unsigned i;
+
+	for(i = 0; i < 4; i++) {
+		const uint64_t n = r << 32 | p[i];
+		q[i] = n / d, r = n % d;
+	}
+	a->hi = q[0] << 32 | q[1];
+	a->lo = q[2] << 32 | q[3];
+	return (uint32_t)r;
+}
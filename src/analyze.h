@@ -0,0 +1,42 @@
+#include <stddef.h> /* size_t */
+#include <stdint.h> /* uint64_t */
+
+/* a number of things the robot does; it goes up to 2^128 - 1 and stays
+ there */
+struct Cost {
+	uint64_t hi, lo;
+};
+
+/* what a line costs when it runs: the commands it executes, including SAY,
+ and the steps, which are TAKEASTEP; a WHILE goes on until there's a marker,
+ so it's counted once through, and is_unbounded */
+struct LineCost {
+	struct Cost commands, steps;
+	int is_unbounded;
+};
+
+#define ANALYSIS_TOP 10
+
+/* one of the lines that cost the most, and how it starts */
+struct AnalysisLine {
+	unsigned long line;
+	struct LineCost cost;
+	char text[48];
+};
+
+/* what the lines of a script cost, {@see addAnalysis} */
+struct Analysis {
+	unsigned long lines, unbounded;
+	struct Cost commands, steps;
+	struct AnalysisLine top[ANALYSIS_TOP]; /* by commands, the most first */
+	size_t top_size;
+};
+
+struct Cost costProduct(const uint64_t a, const uint64_t b);
+void costAdd(struct Cost *const a, const struct Cost *const b);
+int costCompare(const struct Cost *const a, const struct Cost *const b);
+double costDouble(const struct Cost *const a);
+char *costString(char *const s, const struct Cost *const a);
+void initAnalysis(struct Analysis *const a);
+void addAnalysis(struct Analysis *const a, const char *const line,
+	const size_t length, const struct LineCost *const cost);
@@ -0,0 +1,98 @@
+/* Scratch memory for the work that grows with a line, like repairing one
+ that's not valid, {@see expression_error} in syntax.c. It's given out by
+ bumping a pointer in a block, and it's all taken back at once when the next
+ line starts, so there's nothing to free for each of the things in it and no
+ malloc for each token. A block that's full is followed by one at least twice
+ as big, and a reset keeps only that, so a thread that has checked a long line
+ has room for the next one like it, and it's O(1) from then on. There's no
+ limit but the memory.
+
+ @author	Neil
+ @version	1; 2016-03
+ @since		1; 2016-03 */
+
+#include <stdlib.h>		/* malloc free */
+#include <stdint.h>		/* SIZE_MAX uint64_t */
+#include <errno.h>		/* errno */
+#include "stats.h"		/* STATS_* */
+#include "arena.h"
+
+/* the size of the first block, about what the repairs of lines of a few
+ hundred tokens take */
+static const size_t arena_min = 1 << 14;
+
+/* whatever is given out is aligned for any of these */
+union ArenaAlign {
+	void *p;
+	long double f;
+	uint64_t u;
+};
+
+/* a block of memory, which is capacity bytes of data */
+struct ArenaBlock {
+	struct ArenaBlock *prev;
+	size_t capacity;
+	union ArenaAlign data[];
+};
+
+/* public */
+
+/** Initialises arena to have no memory; the first {@see arenaAlloc} gets
+ some. */
+void initArena(struct Arena *const arena) {
+	arena->block = 0;
+	arena->used  = arena->bytes = 0;
+}
+
+/** @return	Room for n of size in arena, until the next
+			{@see resetArena}, or null and errno is set. */
+void *arenaAlloc(struct Arena *const arena, const size_t n,
+	const size_t size) {
+	const size_t align = sizeof(union ArenaAlign),
+		max = SIZE_MAX - sizeof(struct ArenaBlock);
+	struct ArenaBlock *b = arena->block;
+	size_t bytes, capacity;
+	void *x;
+
+	if(size && n > (max - align) / size) { errno = ENOMEM; return 0; }
+	bytes = (n * size + align - 1) / align * align;
+	if(!b || b->capacity - arena->used < bytes) {
+		capacity = !b ? arena_min
+			: b->capacity > max / 2 ? max : b->capacity * 2;
+		if(capacity < bytes) capacity = bytes;
+		if(!(b = malloc(sizeof *b + capacity))) { errno = ENOMEM; return 0; }
+		b->prev      = arena->block;
+		b->capacity  = capacity;
+		arena->block = b;
+		arena->used  = 0;
+		STATS_ONLY(STATS_THIS->arena_blocks++;)
+	}
+	x = (char *)b->data + arena->used;
+	arena->used  += bytes;
+	arena->bytes += bytes;
+	STATS_ONLY({
+		struct Stats *const s = STATS_THIS;
+		if(arena->bytes > s->arena_peak) s->arena_peak = arena->bytes;
+	})
+	return x;
+}
+
+/** Takes back everything that arena has given out. The blocks but the
+ newest, which is the biggest, are freed, so after the first reset there's
+ one, and nothing is freed. */
+void resetArena(struct Arena *const arena) {
+	struct ArenaBlock *b, *prev;
+
+	if(!arena->block) return;
+	for(b = arena->block->prev; b; b = prev) prev = b->prev, free(b);
+	arena->block->prev = 0;
+	arena->used = arena->bytes = 0;
+}
+
+/** Frees the memory of arena and initialises it. */
+void freeArena(struct Arena *const arena) {
+	struct ArenaBlock *b, *prev;
+
+	for(b = arena->block; b; b = prev) prev = b->prev, free(b);
+	initArena(arena);
+}
@@ -0,0 +1,14 @@
+#include <stddef.h> /* size_t */
+
+/* memory that's given out by bumping a pointer and taken back all at once,
+ {@see arenaAlloc} */
+struct Arena {
+	struct ArenaBlock *block; /* the newest and biggest, or null */
+	size_t used, bytes; /* in block, and given out since the reset */
+};
+
+void initArena(struct Arena *const arena);
+void *arenaAlloc(struct Arena *const arena, const size_t n,
+	const size_t size);
+void resetArena(struct Arena *const arena);
+void freeArena(struct Arena *const arena);
@@ -0,0 +1,692 @@
+/* Checks many files in one process, for when there are too many scripts to
+ start q1 on each one. Every thread has a deque of tasks: opening a file, or
+ checking a piece of a large one. A thread takes from the back of its own deque
+ and, when that's empty, steals from the front of the others, so a few huge
+ files among many tiny ones don't leave threads idle. The diagnostics are
+ copied out of the file, which is closed as soon as it's checked, and printed
+ by the calling thread in the order of the files. With a cache, a
+ memory-mapped file that has been seen before is only hashed, and what's
+ stored is printed instead.
+
+ @author	Neil
+ @version	1; 2016-03
+ @since		1; 2016-03 */
+
+#define _POSIX_C_SOURCE 200809L /* pthreads, lstat, getline, strdup */
+
+#include <stdio.h>		/* FILE fopen getline */
+#include <stdlib.h>		/* malloc calloc realloc free qsort */
+#include <string.h>		/* strlen strcmp strerror memcpy memchr */
+#include <errno.h>		/* errno */
+#include <pthread.h>	/* pthread_* */
+#include <dirent.h>		/* opendir readdir closedir */
+#include <sys/stat.h>	/* stat lstat */
+#include "libq1.h"		/* q1* */
+#include "input.h"		/* openInput readBlock closeInput */
+#include "cache.h"		/* keyCache getCache replayCache *Cache */
+#include "batch.h"
+
+/* constants */
+static const size_t piece_size = 1 << 20;
+
+/* a line that's not valid, copied out of the file */
+struct Diagnostic {
+	unsigned long line; /* in the piece, starting at one */
+	long column;
+	size_t text, length; /* the line in the pool */
+	size_t message, expected, suggestion; /* strings in the pool */
+};
+
+struct Piece {
+	const char *begin, *end;
+	unsigned long lines;
+	struct Diagnostic *diagnostics;
+	size_t diagnostics_size, diagnostics_capacity;
+	char *pool;
+	size_t pool_size, pool_capacity;
+	int error; /* errno if it stopped before the end */
+};
+
+struct File {
+	const char *fn;
+	struct Input input;
+	int is_input, is_unterminated, is_done, error, is_keyed;
+	struct CacheKey key;
+	const struct CacheRecord *record; /* if it was in the cache */
+	struct Piece *pieces;
+	size_t pieces_size, pieces_left;
+};
+
+/* opens the file if piece is null, otherwise checks the piece */
+struct Task {
+	struct File *file;
+	struct Piece *piece;
+};
+
+struct Deque {
+	pthread_mutex_t lock;
+	struct Task *tasks;
+	size_t head, tail, capacity;
+};
+
+struct Pool {
+	struct Cache *cache; /* only looked up by the workers */
+	int is_nested;       /* then files are not split */
+	pthread_mutex_t lock;
+	pthread_cond_t work, done;
+	long queued;    /* in the deques */
+	size_t pending; /* queued or running */
+	struct Deque *deques;
+	unsigned deques_size;
+};
+
+struct Worker {
+	struct Pool *pool;
+	unsigned id;
+	struct Q1 *q1;
+	pthread_t thread;
+};
+
+/* private prototypes */
+static int add_path(struct Batch *const batch, const char *const path);
+static int add_directory(struct Batch *const batch, const char *const dir);
+static int string_compare(const void *a, const void *b);
+static int push(struct Pool *const pool, const unsigned d,
+	const struct Task task);
+static int take(struct Worker *const w, struct Task *const task);
+static void *work(void *const param);
+static void open_file(struct Worker *const w, struct File *const f);
+static size_t terminate(struct File *const f, const char *const block,
+	const size_t size);
+static int check_block(struct Worker *const w, struct Piece *const p,
+	const char *const block, const size_t size);
+static int end_file(struct Worker *const w, struct File *const f);
+static int add(struct Piece *const p, const unsigned long line,
+	const long column, const char *const text, const size_t length,
+	const char *const message, const char *const expected,
+	const char *const suggestion);
+static void finish(struct Pool *const pool, struct File *const f);
+static void report(struct File *const f, struct Cache *const cache,
+	const BatchPrint print, struct BatchSummary *const s);
+
+/* public */
+
+/** Initialises an empty batch. */
+void initBatch(struct Batch *const batch) {
+	batch->paths          = 0;
+	batch->paths_size     = 0;
+	batch->paths_capacity = 0;
+	batch->is_nested      = 0;
+	batch->memo           = 0;
+}
+
+/** Releases the paths of batch. */
+void freeBatch(struct Batch *const batch) {
+	size_t i;
+
+	for(i = 0; i < batch->paths_size; i++) free(batch->paths[i]);
+	free(batch->paths);
+	initBatch(batch);
+}
+
+/** Adds path to batch; if is_recursive and path is a directory, adds every
+ regular file under it instead, in order of name. Symbolic links to
+ directories are not followed, so there can't be a cycle.
+ @return	True on success; otherwise errno is set. */
+int addBatchPath(struct Batch *const batch, const char *const path,
+	const int is_recursive) {
+	struct stat st;
+
+	if(is_recursive && strcmp(path, "-") && stat(path, &st) != -1
+		&& S_ISDIR(st.st_mode)) return add_directory(batch, path);
+	return add_path(batch, path);
+}
+
+/** Adds the paths in fn, one per line, with {@see addBatchPath}; fn can be -
+ for standard input.
+ @return	True on success; otherwise errno is set. */
+int addBatchList(struct Batch *const batch, const char *const fn,
+	const int is_recursive) {
+	FILE *const fp = strcmp(fn, "-") ? fopen(fn, "r") : stdin;
+	char *line = 0;
+	size_t capacity = 0;
+	ssize_t length;
+	int is_ok = -1;
+
+	if(!fp) return 0;
+	while((length = getline(&line, &capacity, fp)) != -1) {
+		while(length && (line[length - 1] == '\n' || line[length - 1] == '\r'))
+			line[--length] = '\0';
+		if(!length) continue;
+		if(!addBatchPath(batch, line, is_recursive)) { is_ok = 0; break; }
+	}
+	if(is_ok && ferror(fp)) is_ok = 0;
+	free(line);
+	if(fp != stdin && fclose(fp) == EOF) is_ok = 0;
+	return is_ok;
+}
+
+/** Checks all the files in batch on threads, calling print for every line
+ that's not valid, grouped by file in the order of batch. Files that can't be
+ checked are reported to print with a null line in their place. If cache is
+ not null, files are looked up in it, and the ones that are not there are
+ added.
+ @return	True on success, even if files failed; otherwise errno is set. */
+int checkBatch(const struct Batch *const batch, const unsigned threads,
+	struct Cache *const cache, const BatchPrint print,
+	struct BatchSummary *const summary) {
+	struct Pool pool;
+	struct File *files = 0;
+	struct Worker *workers = 0;
+	const unsigned n = threads ? threads : 1;
+	unsigned w, started = 0, deques = 0;
+	size_t i;
+	int is_lock = 0, e = 0;
+
+	summary->files = summary->invalid = summary->failed = summary->cached
+		= summary->lines = 0;
+	summary->bytes = 0;
+	summary->memo.hits = summary->memo.misses = summary->memo.collisions
+		= summary->memo.evictions = 0;
+	pool.cache  = cache;
+	pool.is_nested = batch->is_nested;
+	pool.deques = 0;
+	if(!batch->paths_size) return -1;
+
+	/* try */ do {
+
+		if(!(files = calloc(batch->paths_size, sizeof *files))
+			|| !(workers = calloc(n, sizeof *workers))
+			|| !(pool.deques = calloc(n, sizeof *pool.deques)))
+			{ e = errno; break; }
+		if((e = pthread_mutex_init(&pool.lock, 0))) break;
+		if((e = pthread_cond_init(&pool.work, 0))) {
+			pthread_mutex_destroy(&pool.lock);
+			break;
+		}
+		if((e = pthread_cond_init(&pool.done, 0))) {
+			pthread_cond_destroy(&pool.work);
+			pthread_mutex_destroy(&pool.lock);
+			break;
+		}
+		is_lock = -1;
+		pool.queued  = 0;
+		pool.pending = 0;
+		for( ; deques < n; deques++) {
+			if((e = pthread_mutex_init(&pool.deques[deques].lock, 0))) break;
+		}
+		if(e) break;
+		pool.deques_size = n;
+
+		/* dealt round so they're opened roughly in order; the last pushed is
+		 the first taken */
+		for(i = 0; i < batch->paths_size; i++) files[i].fn = batch->paths[i];
+		for(i = batch->paths_size; i; i--) {
+			struct Task t;
+			t.file = files + i - 1, t.piece = 0;
+			if(!push(&pool, (unsigned)((i - 1) % n), t)) { e = errno; break; }
+		}
+		if(e) break;
+
+		for(w = 0; w < n; w++) {
+			workers[w].pool = &pool;
+			workers[w].id   = w;
+			if(!(workers[w].q1 = q1Context())) { e = errno; break; }
+			q1Nested(workers[w].q1, batch->is_nested);
+			q1Memo(workers[w].q1, batch->memo);
+		}
+		if(e) break;
+		/* the others steal the deques of threads that didn't start */
+		for( ; started < n; started++) {
+			if(pthread_create(&workers[started].thread, 0, &work,
+				workers + started)) break;
+		}
+		if(!started) { e = EAGAIN; break; }
+
+		/* print in order as the files are done */
+		for(i = 0; i < batch->paths_size; i++) {
+			struct File *const f = files + i;
+			pthread_mutex_lock(&pool.lock);
+			while(!f->is_done) pthread_cond_wait(&pool.done, &pool.lock);
+			pthread_mutex_unlock(&pool.lock);
+			report(f, cache, print, summary);
+		}
+
+	} while(0); /* finally */ {
+
+		for(w = 0; w < started; w++) pthread_join(workers[w].thread, 0);
+		if(workers) for(w = 0; w < n; w++) {
+			struct MemoCount c;
+			if(!workers[w].q1) continue;
+			q1MemoCount(workers[w].q1, &c);
+			summary->memo.hits       += c.hits;
+			summary->memo.misses     += c.misses;
+			summary->memo.collisions += c.collisions;
+			summary->memo.evictions  += c.evictions;
+			q1Free(workers[w].q1);
+		}
+		free(workers);
+		for(w = 0; w < deques; w++) {
+			free(pool.deques[w].tasks);
+			pthread_mutex_destroy(&pool.deques[w].lock);
+		}
+		free(pool.deques);
+		if(is_lock) {
+			pthread_cond_destroy(&pool.done);
+			pthread_cond_destroy(&pool.work);
+			pthread_mutex_destroy(&pool.lock);
+		}
+		if(files) for(i = 0; i < batch->paths_size; i++) {
+			struct File *const f = files + i;
+			size_t j;
+			if(f->is_input) closeInput(&f->input);
+			for(j = 0; j < f->pieces_size; j++) {
+				free(f->pieces[j].diagnostics);
+				free(f->pieces[j].pool);
+			}
+			free(f->pieces);
+		}
+		free(files);
+
+	} /* catch */ if(e) {
+		errno = e;
+		return 0;
+	}
+	return -1;
+}
+
+/* private */
+
+/** Appends a copy of path to batch. */
+static int add_path(struct Batch *const batch, const char *const path) {
+	char *copy;
+
+	if(batch->paths_size >= batch->paths_capacity) {
+		const size_t c = batch->paths_capacity
+			? batch->paths_capacity << 1 : 64;
+		char **const paths = realloc(batch->paths, c * sizeof *paths);
+		if(!paths) return 0;
+		batch->paths          = paths;
+		batch->paths_capacity = c;
+	}
+	if(!(copy = strdup(path))) return 0;
+	batch->paths[batch->paths_size++] = copy;
+	return -1;
+}
+
+/** Adds the regular files under dir in order of name; one that can't be
+ read is added as it is, so the error is reported in its place. */
+static int add_directory(struct Batch *const batch, const char *const dir) {
+	DIR *d;
+	struct dirent *de;
+	struct stat st;
+	char **names = 0, *path = 0;
+	size_t names_size = 0, names_capacity = 0, path_capacity = 0, i;
+	const size_t dir_size = strlen(dir);
+	const int is_slash = dir_size && dir[dir_size - 1] == '/';
+	int is_ok = 0;
+
+	if(!(d = opendir(dir))) return add_path(batch, dir);
+
+	/* try */ do {
+
+		for( ; ; ) {
+			errno = 0;
+			if(!(de = readdir(d))) break;
+			if(!strcmp(de->d_name, ".") || !strcmp(de->d_name, "..")) continue;
+			if(names_size >= names_capacity) {
+				const size_t c = names_capacity ? names_capacity << 1 : 64;
+				char **const n = realloc(names, c * sizeof *n);
+				if(!n) break;
+				names          = n;
+				names_capacity = c;
+			}
+			if(!(names[names_size] = strdup(de->d_name))) break;
+			names_size++;
+		}
+		if(errno) break;
+		qsort(names, names_size, sizeof *names, &string_compare);
+
+		for(i = 0; i < names_size; i++) {
+			const size_t size = dir_size + !is_slash + strlen(names[i]) + 1;
+			if(size > path_capacity) {
+				char *const p = realloc(path, size);
+				if(!p) break;
+				path          = p;
+				path_capacity = size;
+			}
+			memcpy(path, dir, dir_size);
+			if(!is_slash) path[dir_size] = '/';
+			strcpy(path + dir_size + !is_slash, names[i]);
+			if(lstat(path, &st) == -1) {
+				if(!add_path(batch, path)) break;
+			} else if(S_ISDIR(st.st_mode)) {
+				if(!add_directory(batch, path)) break;
+			} else if(S_ISREG(st.st_mode) || (S_ISLNK(st.st_mode)
+				&& stat(path, &st) != -1 && S_ISREG(st.st_mode))) {
+				if(!add_path(batch, path)) break;
+			}
+		}
+		if(i < names_size) break;
+		is_ok = -1;
+
+	} while(0); /* finally */ {
+
+		const int e = errno;
+		for(i = 0; i < names_size; i++) free(names[i]);
+		free(names);
+		free(path);
+		closedir(d);
+		errno = e;
+
+	}
+	return is_ok;
+}
+
+/** {@see qsort} on strings. */
+static int string_compare(const void *a, const void *b) {
+	const char *const*sa = a, *const*sb = b;
+	return strcmp(*sa, *sb);
+}
+
+/** Pushes task on the back of deque d and wakes a thread to take it. Only the
+ calling thread or a running task pushes, so pending can't fall to zero
+ while it's being pushed. */
+static int push(struct Pool *const pool, const unsigned d,
+	const struct Task task) {
+	struct Deque *const q = pool->deques + d;
+
+	pthread_mutex_lock(&q->lock);
+	if(q->tail >= q->capacity) {
+		if(q->head) {
+			memmove(q->tasks, q->tasks + q->head,
+				(q->tail - q->head) * sizeof *q->tasks);
+			q->tail -= q->head, q->head = 0;
+		} else {
+			const size_t c = q->capacity ? q->capacity << 1 : 64;
+			struct Task *const tasks = realloc(q->tasks, c * sizeof *tasks);
+			if(!tasks) { pthread_mutex_unlock(&q->lock); return 0; }
+			q->tasks    = tasks;
+			q->capacity = c;
+		}
+	}
+	q->tasks[q->tail++] = task;
+	pthread_mutex_unlock(&q->lock);
+
+	pthread_mutex_lock(&pool->lock);
+	pool->queued++, pool->pending++;
+	pthread_cond_signal(&pool->work);
+	pthread_mutex_unlock(&pool->lock);
+	return -1;
+}
+
+/** Takes from the back of w's deque, or steals from the front of another.
+ @return	Whether there was a task. */
+static int take(struct Worker *const w, struct Task *const task) {
+	struct Pool *const pool = w->pool;
+	unsigned i;
+	int is_task = 0;
+
+	for(i = 0; !is_task && i < pool->deques_size; i++) {
+		struct Deque *const q = pool->deques
+			+ (w->id + i) % pool->deques_size;
+		pthread_mutex_lock(&q->lock);
+		if(q->head < q->tail) {
+			*task   = i ? q->tasks[q->head++] : q->tasks[--q->tail];
+			is_task = -1;
+			if(q->head == q->tail) q->head = q->tail = 0;
+		}
+		pthread_mutex_unlock(&q->lock);
+	}
+	if(!is_task) return 0;
+	pthread_mutex_lock(&pool->lock);
+	pool->queued--;
+	pthread_mutex_unlock(&pool->lock);
+	return -1;
+}
+
+/** Runs tasks until there are none queued or running. */
+static void *work(void *const param) {
+	struct Worker *const w = param;
+	struct Pool *const pool = w->pool;
+	struct Task task;
+	int is_end;
+
+	for( ; ; ) {
+		if(!take(w, &task)) {
+			pthread_mutex_lock(&pool->lock);
+			while(pool->queued <= 0 && pool->pending)
+				pthread_cond_wait(&pool->work, &pool->lock);
+			is_end = !pool->pending;
+			pthread_mutex_unlock(&pool->lock);
+			if(is_end) break;
+			continue;
+		}
+		if(task.piece) {
+			check_block(w, task.piece, task.piece->begin,
+				task.piece->end - task.piece->begin);
+			finish(pool, task.file);
+		} else {
+			open_file(w, task.file);
+		}
+		pthread_mutex_lock(&pool->lock);
+		if(!--pool->pending) pthread_cond_broadcast(&pool->work);
+		pthread_mutex_unlock(&pool->lock);
+	}
+	return 0;
+}
+
+/** Opens f. A memory-mapped file is looked up in the cache, and if it's
+ large, split at new lines into pieces that are pushed for any thread to
+ check; otherwise it's checked here. In the nested dialect, the lines depend
+ on the ones before, so it's all checked here. */
+static void open_file(struct Worker *const w, struct File *const f) {
+	const char *block, *a, *end, *nl;
+	size_t size, i;
+
+	if(!openInput(&f->input, f->fn))
+		{ f->error = errno; finish(w->pool, f); return; }
+	f->is_input = -1;
+
+	if(f->input.map) {
+		block = readBlock(&f->input, &size);
+		if(w->pool->cache) {
+			keyCache(&f->key, block, size);
+			f->is_keyed = -1;
+			if((f->record = getCache(w->pool->cache, &f->key)))
+				{ finish(w->pool, f); return; }
+		}
+		end = block + terminate(f, block, size);
+		if(!w->pool->is_nested && size > piece_size << 1
+			&& (f->pieces = calloc(size / piece_size + 1, sizeof *f->pieces))) {
+			for(a = block; a < end; a = f->pieces[f->pieces_size++].end) {
+				f->pieces[f->pieces_size].begin = a;
+				f->pieces[f->pieces_size].end = (size_t)(end - a) <= piece_size
+					|| !(nl = memchr(a + piece_size, '\n', end - a
+					- piece_size)) ? end : nl + 1;
+			}
+			f->pieces_left = f->pieces_size;
+			for(i = f->pieces_size; i; i--) {
+				struct Task t;
+				t.file = f, t.piece = f->pieces + i - 1;
+				if(push(w->pool, w->id, t)) continue;
+				check_block(w, t.piece, t.piece->begin, t.piece->end
+					- t.piece->begin);
+				finish(w->pool, f);
+			}
+			return;
+		}
+		if(!(f->pieces = calloc(1, sizeof *f->pieces)))
+			{ f->error = errno; finish(w->pool, f); return; }
+		f->pieces_size = f->pieces_left = 1;
+		check_block(w, f->pieces, block, end - block);
+		end_file(w, f);
+		finish(w->pool, f);
+		return;
+	}
+
+	if(!(f->pieces = calloc(1, sizeof *f->pieces)))
+		{ f->error = errno; finish(w->pool, f); return; }
+	f->pieces_size = f->pieces_left = 1;
+	while((block = readBlock(&f->input, &size))) {
+		if(!check_block(w, f->pieces, block, terminate(f, block, size))) break;
+	}
+	if(f->input.is_error) f->error = errno;
+	end_file(w, f);
+	finish(w->pool, f);
+}
+
+/** Only the last block of a file can be missing the new line at the end; the
+ line without one is left out and f is marked.
+ @return	The size of the block up to the last new line. */
+static size_t terminate(struct File *const f, const char *const block,
+	const size_t size) {
+	const char *last = block + size;
+
+	if(!size || last[-1] == '\n' || last[-1] == '\r') return size;
+	while(last > block && last[-1] != '\n') last--;
+	f->is_unterminated = -1;
+	return last - block;
+}
+
+/** Checks the lines of block and copies the diagnostics to p.
+ @return	Success; otherwise p->error is set. */
+static int check_block(struct Worker *const w, struct Piece *const p,
+	const char *const block, const size_t size) {
+	const struct Q1Diagnostic *d;
+	size_t d_size, i;
+
+	if(!q1CheckBuffer(w->q1, block, size)) { p->error = errno; return 0; }
+	for(d = q1Diagnostics(w->q1, &d_size), i = 0; i < d_size; i++, d++) {
+		if(!add(p, p->lines + d->line, d->column, block + d->offset,
+			d->length, q1Message(w->q1, d), q1Expected(w->q1, d),
+			q1Suggestion(w->q1, d))) { p->error = ENOMEM; return 0; }
+	}
+	p->lines += q1LinesChecked(w->q1);
+	return -1;
+}
+
+/** The file f, in one piece, has been checked as far as it could be; the
+ blocks that are still open in the nested dialect are added where they start,
+ if it got to the end, and the context of w is ready for the next file.
+ @return	Success; otherwise the piece's error is set. */
+static int end_file(struct Worker *const w, struct File *const f) {
+	struct Piece *const p = f->pieces;
+	const struct Q1Diagnostic *d;
+	size_t d_size, i;
+
+	if(!q1End(w->q1)) { if(!p->error) p->error = errno; return 0; }
+	if(p->error || f->error || f->is_unterminated) return -1;
+	for(d = q1Diagnostics(w->q1, &d_size), i = 0; i < d_size; i++, d++) {
+		if(!add(p, d->line, d->column, "", 0, q1Message(w->q1, d),
+			q1Expected(w->q1, d), q1Suggestion(w->q1, d)))
+			{ p->error = ENOMEM; return 0; }
+	}
+	return -1;
+}
+
+/** Appends a diagnostic to p with copies of the line and strings. */
+static int add(struct Piece *const p, const unsigned long line,
+	const long column, const char *const text, const size_t length,
+	const char *const message, const char *const expected,
+	const char *const suggestion) {
+	struct Diagnostic *d;
+	const size_t m = strlen(message) + 1, x = strlen(expected) + 1,
+		s = strlen(suggestion) + 1;
+
+	if(p->diagnostics_size >= p->diagnostics_capacity) {
+		const size_t c = p->diagnostics_capacity
+			? p->diagnostics_capacity << 1 : 64;
+		if(!(d = realloc(p->diagnostics, c * sizeof *d))) return 0;
+		p->diagnostics          = d;
+		p->diagnostics_capacity = c;
+	}
+	while(p->pool_size + length + m + x + s > p->pool_capacity) {
+		const size_t c = p->pool_capacity ? p->pool_capacity << 1 : 4096;
+		char *const pool = realloc(p->pool, c);
+		if(!pool) return 0;
+		p->pool          = pool;
+		p->pool_capacity = c;
+	}
+	d = p->diagnostics + p->diagnostics_size++;
+	d->line       = line;
+	d->column     = column;
+	d->text       = p->pool_size;
+	d->length     = length;
+	d->message    = d->text + length;
+	d->expected   = d->message + m;
+	d->suggestion = d->expected + x;
+	memcpy(p->pool + d->text, text, length);
+	memcpy(p->pool + d->message, message, m);
+	memcpy(p->pool + d->expected, expected, x);
+	memcpy(p->pool + d->suggestion, suggestion, s);
+	p->pool_size += length + m + x + s;
+	return -1;
+}
+
+/** Called once for every piece of f, or once if it couldn't be opened; the
+ last closes the file and hands it to the printing thread. */
+static void finish(struct Pool *const pool, struct File *const f) {
+	int is_last;
+
+	pthread_mutex_lock(&pool->lock);
+	is_last = !f->pieces_left || !--f->pieces_left;
+	pthread_mutex_unlock(&pool->lock);
+	if(!is_last) return;
+	if(f->is_input && !closeInput(&f->input) && !f->error) f->error = errno;
+	f->is_input = 0;
+	pthread_mutex_lock(&pool->lock);
+	f->is_done = -1;
+	pthread_cond_broadcast(&pool->done);
+	pthread_mutex_unlock(&pool->lock);
+}
+
+/** Prints the diagnostics of f, from the cache if it was there, and why it
+ failed if it did, then frees them. A file that was checked all the way is
+ added to the cache. */
+static void report(struct File *const f, struct Cache *const cache,
+	const BatchPrint print, struct BatchSummary *const s) {
+	const struct Diagnostic *d;
+	unsigned long line_no = 0;
+	int error = f->error, is_invalid = 0;
+	size_t i, j;
+
+	if(f->record) {
+		is_invalid = !!replayCache(cache, f->record, f->fn, print, &line_no,
+			&f->is_unterminated);
+		s->cached++;
+	} else {
+		for(i = 0; i < f->pieces_size; i++) {
+			const struct Piece *const p = f->pieces + i;
+			if(p->error) { error = p->error; break; }
+		}
+		if(f->is_keyed && !error) beginCache(cache, &f->key);
+	}
+	for(i = 0; i < f->pieces_size; i++) {
+		struct Piece *const p = f->pieces + i;
+		for(d = p->diagnostics, j = 0; j < p->diagnostics_size; j++, d++) {
+			print(f->fn, line_no + d->line, p->pool + d->text, d->length,
+				d->column, p->pool + d->message, p->pool + d->expected,
+				p->pool + d->suggestion);
+			if(f->is_keyed && !error) addCache(cache, line_no + d->line,
+				d->column, p->pool + d->text, d->length, p->pool + d->message,
+				p->pool + d->expected, p->pool + d->suggestion);
+		}
+		if(p->diagnostics_size) is_invalid = -1;
+		line_no += p->lines;
+		free(p->diagnostics), p->diagnostics = 0, p->diagnostics_size = 0;
+		free(p->pool), p->pool = 0;
+		if(p->error) break;
+	}
+	if(f->is_keyed && !error && !f->record)
+		endCache(cache, line_no, f->is_unterminated);
+	s->files++;
+	s->lines += line_no;
+	s->bytes += f->input.bytes;
+	if(is_invalid) s->invalid++;
+	if(!error && !f->is_unterminated) return;
+	s->failed++;
+	if(error) print(f->fn, line_no, 0, 0, -1, strerror(error), "", "");
+	else print(f->fn, line_no + 1, 0, 0, -1, "not followed by new line.", "",
+		"");
+}
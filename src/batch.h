@@ -0,0 +1,39 @@
+#include <stddef.h> /* size_t */
+#include "memo.h"   /* struct MemoCount */
+
+struct Cache;
+
+/* prints a line that's not valid; the same as for one file in main.c; if line
+ is null, the file failed at line_no for the reason in message */
+typedef void (*BatchPrint)(const char *const fn, const unsigned long line_no,
+	const char *const line, const size_t length, const long column,
+	const char *const message, const char *const expected,
+	const char *const suggestion);
+
+/* the files to check, in the order that their diagnostics come out,
+ whether they're in the nested dialect, and the bytes each thread remembers
+ lines in, {@see q1Memo} */
+struct Batch {
+	char **paths;
+	size_t paths_size, paths_capacity;
+	int is_nested;
+	size_t memo;
+};
+
+/* what checkBatch found; a file that couldn't be read to the end, or is
+ missing the last new line, has failed */
+struct BatchSummary {
+	unsigned long files, invalid, failed, cached, lines;
+	size_t bytes;
+	struct MemoCount memo;
+};
+
+void initBatch(struct Batch *const batch);
+void freeBatch(struct Batch *const batch);
+int addBatchPath(struct Batch *const batch, const char *const path,
+	const int is_recursive);
+int addBatchList(struct Batch *const batch, const char *const fn,
+	const int is_recursive);
+int checkBatch(const struct Batch *const batch, const unsigned threads,
+	struct Cache *const cache, const BatchPrint print,
+	struct BatchSummary *const summary);
@@ -0,0 +1,530 @@
+/* A cache of the results of checking files, so that re-checking a tree where
+ few files have changed costs little more than hashing it. A file is known by
+ the hash of its contents, which is seeded with a hash of the grammar, and
+ its size, and a record holds the diagnostics that it had with this version of
+ q1, which can be printed again without tokenising it; so if grammar.txt is
+ changed, even with the same version, nothing that was found before is used.
+
+ The records are in one log, <dir>/q1.cache, that is only ever appended to.
+ It's read all at once when the cache is opened, and the records written in a
+ run are buffered and appended with one write under an fcntl lock, so many
+ processes can share a cache. Every record has a hash of itself, so one that
+ was cut off by a crash is passed over. When the log gets too large, the
+ records that weren't used in the run are dropped by writing a new log and
+ renaming it over the old; processes with the old one open notice that the
+ file has changed when they next lock it.
+
+ @author	Neil
+ @version	1; 2016-03
+ @since		1; 2016-03 */
+
+#define _POSIX_C_SOURCE 200809L /* mmap, fcntl, mkstemp, fdopen */
+
+#include <stdio.h>		/* fdopen fwrite rename */
+#include <stdlib.h>		/* malloc calloc realloc free qsort bsearch mkstemp */
+#include <string.h>		/* strlen strcpy strcat memcpy memcmp memset */
+#include <errno.h>		/* errno */
+#include <fcntl.h>		/* open fcntl */
+#include <unistd.h>		/* write pread close ftruncate unlink */
+#include <sys/types.h>	/* off_t */
+#include <sys/stat.h>	/* stat fstat fchmod mkdir */
+#include <sys/mman.h>	/* mmap munmap */
+#include "hash.h"		/* hash64 */
+#include "syntax.h"		/* grammarHash */
+#include "cache.h"
+
+/* constants */
+static const char cache_name[] = "/q1.cache";
+static const char header[16] = "q1 cache 2\n";
+static const uint32_t record_magic = 0x32723171; /* "q1r2" */
+static const uint64_t check_seed   = 0x7131;
+static const size_t flush_size     = 1 << 20;
+static const size_t compact_size   = 64 << 20;
+/* a file with so many diagnostics is not worth keeping; it would push out
+ everything else */
+static const size_t record_max     = 16 << 20;
+
+/* a file; it's followed by its diagnostics, and is a multiple of eight */
+struct CacheRecord {
+	uint32_t magic, size;
+	uint64_t check; /* the hash of everything after it */
+	uint64_t hash, file_size;
+	uint32_t version, diagnostics;
+	uint64_t lines;
+	uint32_t flags, reserved;
+};
+
+enum { F_UNTERMINATED = 1 };
+
+/* followed by the line, and the null-terminated message, expected tokens
+ and suggestion, then padding to eight; the sizes include the nulls */
+struct CacheDiagnostic {
+	uint64_t line;
+	int64_t column;
+	uint32_t length, message, expected, suggestion;
+};
+
+/* the records in the log by key; offset zero is empty */
+struct CacheSlot {
+	uint64_t hash, size;
+	size_t offset;
+};
+
+/* private prototypes */
+static int lock_log(struct Cache *const c, const short type);
+static void unlock_log(struct Cache *const c);
+static int write_all(const int fd, const char *a, size_t size);
+static int load(struct Cache *const c);
+static const struct CacheRecord *record_at(const char *const map,
+	const size_t size, const size_t pos);
+static size_t pad(const size_t size);
+static int flush(struct Cache *const c);
+static int compact(struct Cache *const c);
+static int reserve(struct Cache *const c, const size_t size);
+static int keep(struct Cache *const c, const struct CacheKey *const key);
+static int key_compare(const void *a, const void *b);
+
+/* public */
+
+/** Opens the cache in dir, making dir if it doesn't exist, for results from
+ version major.minor.
+ @return	True on success; otherwise errno is set. */
+int openCache(struct Cache *const cache, const char *const dir,
+	const unsigned major, const unsigned minor) {
+	cache->fd            = -1;
+	cache->path          = 0;
+	cache->map           = 0;
+	cache->map_size      = 0;
+	cache->version       = (uint32_t)(major << 16 | (minor & 0xffff));
+	cache->slots         = 0;
+	cache->slots_mask    = 0;
+	cache->kept          = 0;
+	cache->kept_size     = cache->kept_capacity = 0;
+	cache->out           = 0;
+	cache->out_size      = cache->out_capacity = cache->record = 0;
+	cache->is_record     = 0;
+	cache->is_error      = 0;
+
+	/* try */ do {
+		if(mkdir(dir, 0777) == -1 && errno != EEXIST) break;
+		if(!(cache->path = malloc(strlen(dir) + sizeof cache_name))) break;
+		strcpy(cache->path, dir);
+		strcat(cache->path, cache_name);
+		if(!lock_log(cache, F_RDLCK)) break;
+		if(!load(cache)) { unlock_log(cache); break; }
+		unlock_log(cache);
+		return -1;
+	} while(0); /* catch */ {
+		const int e = errno;
+		cache->is_error = -1; /* so it's not written */
+		closeCache(cache);
+		errno = e;
+	}
+	return 0;
+}
+
+/** Writes the records that are buffered, compacts the log if it's too large,
+ and releases cache.
+ @return	True if everything that was written made it; otherwise errno is
+			set. */
+int closeCache(struct Cache *const cache) {
+	int is_ok = !cache->is_error, e = 0;
+
+	cache->is_record = 0;
+	/* if there was an error, it's safer not to write anything */
+	if(cache->fd != -1 && is_ok) {
+		if(!flush(cache) || !compact(cache)) is_ok = 0, e = errno;
+	}
+	if(cache->map) munmap(cache->map, cache->map_size);
+	if(cache->fd != -1) close(cache->fd);
+	free(cache->path);
+	free(cache->slots);
+	free(cache->kept);
+	free(cache->out);
+	cache->fd   = -1;
+	cache->path = cache->map = cache->out = 0;
+	cache->slots = 0, cache->kept = 0;
+	if(e) errno = e;
+	return is_ok;
+}
+
+/** Sets key from the contents of a file and the grammar that it's checked
+ with, {@see grammarHash}. */
+void keyCache(struct CacheKey *const key, const char *const data,
+	const size_t size) {
+	key->hash = hash64(data, size, grammarHash());
+	key->size = size;
+}
+
+/** It doesn't change cache, so threads can look up at the same time.
+ @return	The record of the file with key, or null if it's not in the
+			cache. */
+const struct CacheRecord *getCache(const struct Cache *const cache,
+	const struct CacheKey *const key) {
+	size_t i;
+
+	if(!cache->slots) return 0;
+	for(i = key->hash & cache->slots_mask; cache->slots[i].offset;
+		i = (i + 1) & cache->slots_mask) {
+		if(cache->slots[i].hash == key->hash
+			&& cache->slots[i].size == key->size)
+			return (const struct CacheRecord *)(cache->map
+			+ cache->slots[i].offset);
+	}
+	return 0;
+}
+
+/** Prints the diagnostics of record as if fn had been checked, and sets the
+ number of lines that were checked and whether the last had no new line.
+ @return	The number of diagnostics. */
+size_t replayCache(struct Cache *const cache,
+	const struct CacheRecord *const record, const char *const fn,
+	const CachePrint print, unsigned long *const lines,
+	int *const is_unterminated) {
+	const char *a = (const char *)(record + 1);
+	const struct CacheDiagnostic *d;
+	struct CacheKey key;
+	uint32_t i;
+
+	for(i = 0; i < record->diagnostics; i++) {
+		d = (const struct CacheDiagnostic *)a;
+		a += sizeof *d;
+		print(fn, (unsigned long)d->line, a, d->length, (long)d->column,
+			a + d->length, a + d->length + d->message,
+			a + d->length + d->message + d->expected);
+		a += pad(d->length + d->message + d->expected + d->suggestion);
+	}
+	*lines           = (unsigned long)record->lines;
+	*is_unterminated = record->flags & F_UNTERMINATED ? -1 : 0;
+	key.hash = record->hash, key.size = record->file_size;
+	if(!keep(cache, &key)) cache->is_error = -1;
+	return record->diagnostics;
+}
+
+/** Starts a record of the file with key; the diagnostics are added in order
+ with {@see addCache}, and {@see endCache} finishes it. */
+void beginCache(struct Cache *const cache, const struct CacheKey *const key) {
+	struct CacheRecord *r;
+
+	cache->is_record = 0;
+	if(cache->is_error || !reserve(cache, sizeof *r)) return;
+	cache->record = cache->out_size;
+	r = (struct CacheRecord *)(cache->out + cache->record);
+	memset(r, 0, sizeof *r);
+	r->hash      = key->hash;
+	r->file_size = key->size;
+	cache->out_size += sizeof *r;
+	cache->is_record = -1;
+}
+
+/** Adds a diagnostic to the record; if it can't, or the record would be larger
+ than record_max, the record is dropped. */
+void addCache(struct Cache *const cache, const unsigned long line,
+	const long column, const char *const text, const size_t length,
+	const char *const message, const char *const expected,
+	const char *const suggestion) {
+	struct CacheDiagnostic d;
+	const size_t m = strlen(message) + 1, x = strlen(expected) + 1,
+		s = strlen(suggestion) + 1, strings = length + m + x + s,
+		size = sizeof d + pad(strings);
+	char *a;
+
+	if(!cache->is_record) return;
+	if(length > record_max || cache->out_size - cache->record + size
+		> record_max || !reserve(cache, size)) {
+		cache->out_size  = cache->record;
+		cache->is_record = 0;
+		return;
+	}
+	d.line       = line;
+	d.column     = column;
+	d.length     = (uint32_t)length;
+	d.message    = (uint32_t)m;
+	d.expected   = (uint32_t)x;
+	d.suggestion = (uint32_t)s;
+	a = cache->out + cache->out_size;
+	memcpy(a, &d, sizeof d), a += sizeof d;
+	memcpy(a, text, length), a += length;
+	memcpy(a, message, m), a += m;
+	memcpy(a, expected, x), a += x;
+	memcpy(a, suggestion, s), a += s;
+	memset(a, 0, size - sizeof d - strings);
+	cache->out_size += size;
+	((struct CacheRecord *)(cache->out + cache->record))->diagnostics++;
+}
+
+/** Finishes the record; the file had lines and maybe no new line at the end.
+ The records are written when there are enough of them. */
+void endCache(struct Cache *const cache, const unsigned long lines,
+	const int is_unterminated) {
+	struct CacheRecord *r;
+	struct CacheKey key;
+
+	if(!cache->is_record) return;
+	cache->is_record = 0;
+	r = (struct CacheRecord *)(cache->out + cache->record);
+	r->magic   = record_magic;
+	r->size    = (uint32_t)(cache->out_size - cache->record);
+	r->version = cache->version;
+	r->lines   = lines;
+	r->flags   = is_unterminated ? F_UNTERMINATED : 0;
+	r->check   = hash64((const char *)r + 16, r->size - 16, check_seed);
+	key.hash = r->hash, key.size = r->file_size;
+	if(!keep(cache, &key)) { cache->is_error = -1; return; }
+	if(cache->out_size >= flush_size && !flush(cache)) cache->is_error = -1;
+}
+
+/* private */
+
+/** Locks the log, opening it if it isn't, or if another process has replaced
+ it since. A log that's empty, cut off in the header, or not in this format
+ is started again with a header; that needs a write lock. */
+static int lock_log(struct Cache *const c, const short type) {
+	struct stat st, path_st;
+	struct flock l;
+	char h[sizeof header];
+	short t = type;
+
+	for( ; ; ) {
+		if(c->fd == -1 && (c->fd = open(c->path, O_RDWR | O_CREAT | O_APPEND,
+			0666)) == -1) return 0;
+		l.l_type = t, l.l_whence = SEEK_SET, l.l_start = 0, l.l_len = 0;
+		while(fcntl(c->fd, F_SETLKW, &l) == -1) if(errno != EINTR) return 0;
+		if(fstat(c->fd, &st) == -1) break;
+		if(stat(c->path, &path_st) == -1 || path_st.st_ino != st.st_ino
+			|| path_st.st_dev != st.st_dev) {
+			close(c->fd), c->fd = -1;
+			continue;
+		}
+		if(st.st_size >= (off_t)sizeof header
+			&& pread(c->fd, h, sizeof h, 0) == (ssize_t)sizeof h
+			&& !memcmp(h, header, sizeof header)) return -1;
+		if(t == F_WRLCK) {
+			if(ftruncate(c->fd, 0) == -1
+				|| !write_all(c->fd, header, sizeof header)) break;
+			return -1;
+		}
+		t = F_WRLCK;
+	}
+	unlock_log(c);
+	return 0;
+}
+
+/** Releases the lock from {@see lock_log}. */
+static void unlock_log(struct Cache *const c) {
+	struct flock l;
+	l.l_type = F_UNLCK, l.l_whence = SEEK_SET, l.l_start = 0, l.l_len = 0;
+	fcntl(c->fd, F_SETLK, &l);
+}
+
+/** Writes all of a to fd. */
+static int write_all(const int fd, const char *a, size_t size) {
+	ssize_t w;
+
+	while(size) {
+		if((w = write(fd, a, size)) == -1) {
+			if(errno == EINTR) continue;
+			return 0;
+		}
+		a += w, size -= (size_t)w;
+	}
+	return -1;
+}
+
+/** Maps the log and puts the records of this version in the table; the
+ log must be locked. */
+static int load(struct Cache *const c) {
+	const struct CacheRecord *r;
+	struct stat st;
+	size_t pos, *found = 0, found_size = 0, found_capacity = 0, capacity, i, j;
+
+	if(fstat(c->fd, &st) == -1) return 0;
+	if((off_t)(size_t)st.st_size != st.st_size) { errno = EFBIG; return 0; }
+	if((size_t)st.st_size <= sizeof header) return -1;
+	c->map = mmap(0, st.st_size, PROT_READ, MAP_SHARED, c->fd, 0);
+	if(c->map == MAP_FAILED) { c->map = 0; return 0; }
+	c->map_size = st.st_size;
+
+	/* a record that's not whole is passed over */
+	for(pos = sizeof header; pos < c->map_size; ) {
+		if(!(r = record_at(c->map, c->map_size, pos))) { pos += 8; continue; }
+		if(r->version == c->version) {
+			if(found_size >= found_capacity) {
+				const size_t fc = found_capacity ? found_capacity << 1 : 256;
+				size_t *const f = realloc(found, fc * sizeof *f);
+				if(!f) { free(found); return 0; }
+				found          = f;
+				found_capacity = fc;
+			}
+			found[found_size++] = pos;
+		}
+		pos += r->size;
+	}
+	if(!found_size) return -1;
+	for(capacity = 16; capacity < found_size << 1; capacity <<= 1);
+	if(!(c->slots = calloc(capacity, sizeof *c->slots)))
+		{ free(found); return 0; }
+	c->slots_mask = capacity - 1;
+	/* the last one with a key is the one that's kept */
+	for(j = 0; j < found_size; j++) {
+		r = (const struct CacheRecord *)(c->map + found[j]);
+		for(i = r->hash & c->slots_mask; c->slots[i].offset
+			&& (c->slots[i].hash != r->hash
+			|| c->slots[i].size != r->file_size);
+			i = (i + 1) & c->slots_mask);
+		c->slots[i].hash   = r->hash;
+		c->slots[i].size   = r->file_size;
+		c->slots[i].offset = found[j];
+	}
+	free(found);
+	return -1;
+}
+
+/** @return	The record at pos in the map if it's whole, or null. */
+static const struct CacheRecord *record_at(const char *const map,
+	const size_t size, const size_t pos) {
+	const struct CacheRecord *r;
+	const struct CacheDiagnostic *d;
+	size_t a, end;
+	uint32_t i;
+
+	if(size - pos < sizeof *r) return 0;
+	r = (const struct CacheRecord *)(map + pos);
+	if(r->magic != record_magic || r->size < sizeof *r || r->size & 7
+		|| r->size > size - pos
+		|| hash64((const char *)r + 16, r->size - 16, check_seed) != r->check)
+		return 0;
+	end = pos + r->size;
+	for(a = pos + sizeof *r, i = 0; i < r->diagnostics; i++) {
+		if(end - a < sizeof *d) return 0;
+		d = (const struct CacheDiagnostic *)(map + a);
+		a += sizeof *d;
+		if(!d->message || !d->expected || !d->suggestion
+			|| (uint64_t)d->length + d->message + d->expected + d->suggestion
+			> end - a || map[a + d->length + d->message - 1]
+			|| map[a + d->length + d->message + d->expected - 1]
+			|| map[a + d->length + d->message + d->expected + d->suggestion
+			- 1]) return 0;
+		a += pad(d->length + d->message + d->expected + d->suggestion);
+	}
+	return a == end ? r : 0;
+}
+
+/** @return	size rounded up to eight. */
+static size_t pad(const size_t size) {
+	return (size + 7) & ~(size_t)7;
+}
+
+/** Appends the records that are buffered to the log in one write. */
+static int flush(struct Cache *const c) {
+	int is_ok;
+
+	if(!c->out_size) return -1;
+	if(!lock_log(c, F_WRLCK)) return 0;
+	is_ok = write_all(c->fd, c->out, c->out_size);
+	unlock_log(c);
+	c->out_size = 0;
+	return is_ok;
+}
+
+/** If the log is larger than compact_size, writes a new one with only the
+ records of this version that were used or written in this run, or are in the
+ newest half of compact_size, and renames it over the old. */
+static int compact(struct Cache *const c) {
+	const struct CacheRecord *r;
+	struct CacheKey key, *k;
+	struct stat st;
+	char *map = 0, *tmp = 0, *is_written = 0;
+	size_t size = 0, pos;
+	FILE *fp = 0;
+	int fd = -1, is_ok = 0;
+
+	if(!lock_log(c, F_WRLCK)) return 0;
+
+	/* try */ do {
+
+		if(fstat(c->fd, &st) == -1) break;
+		if((size_t)st.st_size <= compact_size) { is_ok = -1; break; }
+		size = st.st_size;
+		if((map = mmap(0, size, PROT_READ, MAP_SHARED, c->fd, 0))
+			== MAP_FAILED) { map = 0; break; }
+		qsort(c->kept, c->kept_size, sizeof *c->kept, &key_compare);
+		if(!(is_written = calloc(c->kept_size + 1, 1))
+			|| !(tmp = malloc(strlen(c->path) + sizeof ".XXXXXX"))) break;
+		strcpy(tmp, c->path);
+		strcat(tmp, ".XXXXXX");
+		if((fd = mkstemp(tmp)) == -1
+			|| fchmod(fd, st.st_mode & 0777) == -1) break;
+		if(!(fp = fdopen(fd, "w"))) break;
+		fd = -1;
+		if(fwrite(header, sizeof header, 1, fp) != 1) break;
+		for(pos = sizeof header; pos < size; ) {
+			const size_t age = size - pos;
+			if(!(r = record_at(map, size, pos))) { pos += 8; continue; }
+			pos += r->size;
+			if(r->version != c->version) continue;
+			key.hash = r->hash, key.size = r->file_size;
+			if((k = bsearch(&key, c->kept, c->kept_size, sizeof *c->kept,
+				&key_compare))) {
+				if(is_written[k - c->kept]) continue;
+				is_written[k - c->kept] = 1;
+			} else if(age > compact_size >> 1) continue;
+			if(fwrite(r, r->size, 1, fp) != 1) break;
+		}
+		if(ferror(fp)) break;
+		if(fclose(fp) == EOF) { fp = 0; break; }
+		fp = 0;
+		if(rename(tmp, c->path) == -1) break;
+		free(tmp), tmp = 0;
+		is_ok = -1;
+
+	} while(0); /* finally */ {
+
+		const int e = errno;
+		if(fp) fclose(fp);
+		if(fd != -1) close(fd);
+		if(tmp) unlink(tmp);
+		free(tmp);
+		free(is_written);
+		if(map) munmap(map, size);
+		unlock_log(c);
+		errno = e;
+
+	}
+	return is_ok;
+}
+
+/** Makes room for size more bytes in the output. */
+static int reserve(struct Cache *const c, const size_t size) {
+	size_t capacity = c->out_capacity ? c->out_capacity : 4096;
+	char *out;
+
+	if(c->out_size + size <= c->out_capacity) return -1;
+	while(capacity < c->out_size + size) capacity <<= 1;
+	if(!(out = realloc(c->out, capacity))) return 0;
+	c->out          = out;
+	c->out_capacity = capacity;
+	return -1;
+}
+
+/** Remembers that key was used, so it's kept when compacting. */
+static int keep(struct Cache *const c, const struct CacheKey *const key) {
+	if(c->kept_size >= c->kept_capacity) {
+		const size_t capacity = c->kept_capacity ? c->kept_capacity << 1 : 64;
+		struct CacheKey *const kept = realloc(c->kept,
+			capacity * sizeof *kept);
+		if(!kept) return 0;
+		c->kept          = kept;
+		c->kept_capacity = capacity;
+	}
+	c->kept[c->kept_size++] = *key;
+	return -1;
+}
+
+/** {@see qsort} on struct CacheKey. */
+static int key_compare(const void *a, const void *b) {
+	const struct CacheKey *const ka = a, *const kb = b;
+	if(ka->hash != kb->hash) return ka->hash < kb->hash ? -1 : 1;
+	if(ka->size != kb->size) return ka->size < kb->size ? -1 : 1;
+	return 0;
+}
@@ -0,0 +1,54 @@
+#include <stddef.h> /* size_t */
+#include <stdint.h> /* uint64_t */
+
+/* prints a diagnostic that was stored; the same as for a file in main.c */
+typedef void (*CachePrint)(const char *const fn, const unsigned long line_no,
+	const char *const line, const size_t length, const long column,
+	const char *const message, const char *const expected,
+	const char *const suggestion);
+
+/* what a file is known by: the hash of its contents, seeded with the hash of
+ the grammar, and its size */
+struct CacheKey {
+	uint64_t hash, size;
+};
+
+struct CacheRecord;
+struct CacheSlot;
+
+/* the results of checking files, in an append-only log in a directory that
+ can be shared by many processes; records that are written are buffered until
+ there are enough of them, or the cache is closed */
+struct Cache {
+	int fd;
+	char *path;
+	char *map;
+	size_t map_size;
+	uint32_t version;
+	struct CacheSlot *slots;
+	size_t slots_mask;
+	struct CacheKey *kept; /* used or written, for compacting the log */
+	size_t kept_size, kept_capacity;
+	char *out;
+	size_t out_size, out_capacity, record;
+	int is_record, is_error;
+};
+
+int openCache(struct Cache *const cache, const char *const dir,
+	const unsigned major, const unsigned minor);
+int closeCache(struct Cache *const cache);
+void keyCache(struct CacheKey *const key, const char *const data,
+	const size_t size);
+const struct CacheRecord *getCache(const struct Cache *const cache,
+	const struct CacheKey *const key);
+size_t replayCache(struct Cache *const cache,
+	const struct CacheRecord *const record, const char *const fn,
+	const CachePrint print, unsigned long *const lines,
+	int *const is_unterminated);
+void beginCache(struct Cache *const cache, const struct CacheKey *const key);
+void addCache(struct Cache *const cache, const unsigned long line,
+	const long column, const char *const text, const size_t length,
+	const char *const message, const char *const expected,
+	const char *const suggestion);
+void endCache(struct Cache *const cache, const unsigned long lines,
+	const int is_unterminated);
@@ -0,0 +1,167 @@
+/* Classifies characters for the tokeniser in parse.c a window at a time,
+ instead of calling strchr(delimiters, c) for every character. The result is
+ a bit mask for every class, so parse.c can find the end of a token with a
+ count of trailing zeros. The widest of AVX2, SSE2, or plain C is picked at
+ run-time; they all give the same masks. The environment variable Q1_CLASSIFY
+ can be "scalar" or "sse2" to pick a narrower one, and compiling with
+ -DQ1_SCALAR leaves out the intrinsics entirely.
+
+ @author	Neil
+ @version	1; 2016-03
+ @since		1; 2016-03 */
+
+#define _POSIX_C_SOURCE 200809L /* pthread_once */
+
+#include <stdlib.h>		/* getenv */
+#include <string.h>		/* strcmp */
+#include <pthread.h>	/* pthread_once */
+#include "classify.h"
+
+#if !defined(Q1_SCALAR) && defined(__GNUC__) \
+	&& (defined(__x86_64__) || defined(__i386__)) && defined(__SSE2__)
+#define Q1_X86
+#include <immintrin.h>	/* _mm_* _mm256_* */
+#endif
+
+/* the bits of classes[] */
+#define B_DELIMITER (1 << C_DELIMITER)
+#define B_QUOTE     (1 << C_QUOTE)
+#define B_DIGIT     (1 << C_DIGIT)
+#define D B_DELIMITER
+#define Q B_QUOTE
+#define N B_DIGIT
+
+/** The class bits of every character; it must agree with delimiters and quote
+ in parse.c. The null terminator counts as a delimiter, as it did with
+ strpbrk. */
+const unsigned char classes[256] = {
+	D, 0, 0, 0, 0, 0, 0, 0, 0, D, D, 0, 0, D, 0, 0, /* \0 \t \n \r */
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	D, 0, Q, 0, 0, 0, 0, 0, 0, 0, 0, 0, D, 0, 0, 0, /* ' ' " , */
+	N, N, N, N, N, N, N, N, N, N, 0, 0, 0, 0, 0, 0, /* 0-9 */
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+};
+
+#undef D
+#undef Q
+#undef N
+
+/* static data */
+static pthread_once_t once = PTHREAD_ONCE_INIT;
+static Classify best;
+static const char *best_name;
+
+/* private prototypes */
+static void choose(void);
+static void classify_scalar(const char *const a, struct Classes *const c);
+#ifdef Q1_X86
+static void classify_sse2(const char *const a, struct Classes *const c);
+static void classify_avx2(const char *const a, struct Classes *const c);
+#endif
+
+/* public */
+
+/** @return	The fastest classifier on this processor. */
+Classify classifyFunction(void) {
+	pthread_once(&once, &choose);
+	return best;
+}
+
+/** @return	The name of {@see classifyFunction}. */
+const char *classifyName(void) {
+	pthread_once(&once, &choose);
+	return best_name;
+}
+
+/* private */
+
+static void choose(void) {
+	const char *const env = getenv("Q1_CLASSIFY");
+	const int is_scalar = env && !strcmp(env, "scalar");
+
+	best = &classify_scalar, best_name = "scalar";
+	if(is_scalar) return;
+#ifdef Q1_X86
+	best = &classify_sse2, best_name = "sse2";
+	if(env && !strcmp(env, "sse2")) return;
+	if(__builtin_cpu_supports("avx2"))
+		best = &classify_avx2, best_name = "avx2";
+#endif
+}
+
+/** A character at a time with classes[]. */
+static void classify_scalar(const char *const a, struct Classes *const c) {
+	unsigned i, k;
+	uint32_t bit;
+
+	for(k = 0; k < C_CLASS_NO; k++) c->mask[k] = 0;
+	for(i = 0, bit = 1; i < classify_size; i++, bit <<= 1) {
+		const unsigned char x = classes[(unsigned char)a[i]];
+		if(!x) continue;
+		for(k = 0; k < C_CLASS_NO; k++) if(x & (1 << k)) c->mask[k] |= bit;
+	}
+}
+
+#ifdef Q1_X86
+
+/** Half a window with SSE2; shift is 0 or 16. */
+static void classify_sse2_16(const char *const a, struct Classes *const c,
+	const unsigned shift) {
+	const __m128i x = _mm_loadu_si128((const __m128i *)a);
+	const __m128i delim = _mm_or_si128(
+		_mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(x, _mm_set1_epi8(' ')),
+		_mm_cmpeq_epi8(x, _mm_set1_epi8(','))),
+		_mm_or_si128(_mm_cmpeq_epi8(x, _mm_set1_epi8('\t')),
+		_mm_cmpeq_epi8(x, _mm_set1_epi8('\n')))),
+		_mm_or_si128(_mm_cmpeq_epi8(x, _mm_set1_epi8('\r')),
+		_mm_cmpeq_epi8(x, _mm_setzero_si128())));
+	/* signed compare; '0'-'9' are positive and the top half is negative */
+	const __m128i digit = _mm_and_si128(
+		_mm_cmpgt_epi8(x, _mm_set1_epi8('0' - 1)),
+		_mm_cmplt_epi8(x, _mm_set1_epi8('9' + 1)));
+	c->mask[C_DELIMITER] |= (uint32_t)_mm_movemask_epi8(delim) << shift;
+	c->mask[C_QUOTE] |= (uint32_t)_mm_movemask_epi8(
+		_mm_cmpeq_epi8(x, _mm_set1_epi8('\"'))) << shift;
+	c->mask[C_DIGIT]     |= (uint32_t)_mm_movemask_epi8(digit) << shift;
+}
+
+/** Two 16-byte halves. */
+static void classify_sse2(const char *const a, struct Classes *const c) {
+	c->mask[C_DELIMITER] = c->mask[C_QUOTE] = c->mask[C_DIGIT] = 0;
+	classify_sse2_16(a, c, 0);
+	classify_sse2_16(a + 16, c, 16);
+}
+
+/** The whole window at once. */
+__attribute__((target("avx2")))
+static void classify_avx2(const char *const a, struct Classes *const c) {
+	const __m256i x = _mm256_loadu_si256((const __m256i *)a);
+	const __m256i delim = _mm256_or_si256(
+		_mm256_or_si256(_mm256_or_si256(
+		_mm256_cmpeq_epi8(x, _mm256_set1_epi8(' ')),
+		_mm256_cmpeq_epi8(x, _mm256_set1_epi8(','))),
+		_mm256_or_si256(_mm256_cmpeq_epi8(x, _mm256_set1_epi8('\t')),
+		_mm256_cmpeq_epi8(x, _mm256_set1_epi8('\n')))),
+		_mm256_or_si256(_mm256_cmpeq_epi8(x, _mm256_set1_epi8('\r')),
+		_mm256_cmpeq_epi8(x, _mm256_setzero_si256())));
+	const __m256i digit = _mm256_and_si256(
+		_mm256_cmpgt_epi8(x, _mm256_set1_epi8('0' - 1)),
+		_mm256_cmpgt_epi8(_mm256_set1_epi8('9' + 1), x));
+	c->mask[C_DELIMITER] = (uint32_t)_mm256_movemask_epi8(delim);
+	c->mask[C_QUOTE]     = (uint32_t)_mm256_movemask_epi8(
+		_mm256_cmpeq_epi8(x, _mm256_set1_epi8('\"')));
+	c->mask[C_DIGIT]     = (uint32_t)_mm256_movemask_epi8(digit);
+}
+
+#endif
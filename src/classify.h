@@ -0,0 +1,20 @@
+#include <stdint.h> /* uint32_t */
+
+/* what a character can be to parse.c; a character can be more than one */
+enum Class { C_DELIMITER, C_QUOTE, C_DIGIT, C_CLASS_NO };
+
+/* one bit per character of a window of classify_size characters, the first
+ character in the lowest bit, for each class */
+struct Classes {
+	uint32_t mask[C_CLASS_NO];
+};
+
+/* classifies the classify_size characters at a, which must all be readable */
+typedef void (*Classify)(const char *const a, struct Classes *const c);
+
+enum { classify_size = 32 };
+
+extern const unsigned char classes[256];
+
+Classify classifyFunction(void);
+const char *classifyName(void);
@@ -0,0 +1,330 @@
+/* Writes the diagnostics as text, the way they always have been, or as JSON
+ Lines or SARIF for tools, with the file, line, column, the tokens that were
+ expected, and the suggestion as fields instead of in the message. Everything
+ is copied into one large buffer by hand, without printf, and the buffer goes
+ out in one write when it's full, so a file that's mostly errors isn't held
+ up by formatting.
+
+ Failures of whole files are always on stderr, after what came before them
+ has been written; the structured formats also have them as results.
+
+ @author	Neil
+ @version	1; 2016-03
+ @since		1; 2016-03 */
+
+#include <stdlib.h>	/* malloc free */
+#include <string.h>	/* strlen memcpy */
+#include <limits.h>	/* INT_MAX */
+#include "emit.h"
+#include "utf8.h"	/* utf8Length */
+#include "stats.h"	/* STATS_* */
+
+/* constants */
+static const size_t buffer_size = 1 << 20;
+static const char hex[] = "0123456789abcdef";
+
+/* private prototypes */
+static void put_diagnostic(struct Emit *const emit, const char *const fn,
+	const unsigned long line_no, const char *const line, const size_t length,
+	const long column, const char *const message, const char *const expected,
+	const char *const suggestion, const int is_fixed);
+static void put(struct Emit *const e, const char *a, size_t n);
+static void put_string(struct Emit *const e, const char *const s);
+static void put_ulong(struct Emit *const e, unsigned long x);
+static void put_json(struct Emit *const e, const char *a, const size_t n);
+static void put_json_string(struct Emit *const e, const char *const s);
+static void put_expected(struct Emit *const e, const char *const expected);
+static void put_uri(struct Emit *const e, const char *const fn);
+static size_t trim(const char *const line, size_t length);
+
+/* public */
+
+/** Starts writing diagnostics to fp in format; SARIF says they're from tool
+ at version.
+ @return	Success; otherwise errno is set. */
+int initEmit(struct Emit *const emit, FILE *const fp,
+	const enum EmitFormat format, const char *const tool,
+	const char *const version) {
+	emit->fp       = fp;
+	emit->format   = format;
+	emit->name_max = INT_MAX;
+	emit->fn       = 0;
+	emit->fn_size  = 0;
+	emit->size     = 0;
+	emit->capacity = buffer_size;
+	emit->results  = emit->failures = 0;
+	emit->is_error = 0;
+	if(!(emit->buffer = malloc(buffer_size))) return 0;
+	if(format != EMIT_SARIF) return -1;
+	put_string(emit, "{\"version\":\"2.1.0\",\"$schema\":"
+		"\"https://json.schemastore.org/sarif-2.1.0.json\",\"runs\":[{"
+		"\"tool\":{\"driver\":{\"name\":");
+	put_json_string(emit, tool);
+	put_string(emit, ",\"version\":");
+	put_json_string(emit, version);
+	put_string(emit, ",\"rules\":[{\"id\":\"syntax\",\"shortDescription\":"
+		"{\"text\":\"A line that is not a valid robot expression.\"}},"
+		"{\"id\":\"failure\",\"shortDescription\":{\"text\":"
+		"\"A file that could not be checked to the end.\"}}]}},"
+		"\"results\":[\n");
+	return -1;
+}
+
+/** Finishes the output, writes it, and frees emit.
+ @return	Whether everything was written; otherwise errno is set. */
+int endEmit(struct Emit *const emit) {
+	int is_ok;
+
+	if(emit->format == EMIT_SARIF) {
+		put_string(emit, "],\"invocations\":[{\"executionSuccessful\":");
+		put_string(emit, emit->failures ? "false" : "true");
+		put_string(emit, "}]}]}\n");
+	}
+	is_ok = flushEmit(emit);
+	free(emit->buffer), emit->buffer = 0;
+	return is_ok;
+}
+
+/** Writes what's in the buffer.
+ @return	Whether everything so far was written; otherwise errno is set. */
+int flushEmit(struct Emit *const emit) {
+	if(emit->size && fwrite(emit->buffer, emit->size, 1, emit->fp) != 1)
+		emit->is_error = -1;
+	emit->size = 0;
+	if(fflush(emit->fp) == EOF) emit->is_error = -1;
+	return !emit->is_error;
+}
+
+/** Writes that line, line_no of fn, which is length and includes the new
+ line, is not valid at column, or -1 if it's the whole line. expected is the
+ tokens that could have been there, separated by spaces, and suggestion is
+ what it could have been; either can be empty. */
+void emitDiagnostic(struct Emit *const emit, const char *const fn,
+	const unsigned long line_no, const char *const line, const size_t length,
+	const long column, const char *const message, const char *const expected,
+	const char *const suggestion) {
+	put_diagnostic(emit, fn, line_no, line, length, column, message, expected,
+		suggestion, 0);
+}
+
+/** Writes that a diagnostic that was written before, {@see emitDiagnostic},
+ has gone away, for --watch: the text says fixed instead of syntax error,
+ JSON Lines has "fixed":true, and SARIF has the baselineState absent. */
+void emitFixed(struct Emit *const emit, const char *const fn,
+	const unsigned long line_no, const char *const line, const size_t length,
+	const long column, const char *const message, const char *const expected,
+	const char *const suggestion) {
+	put_diagnostic(emit, fn, line_no, line, length, column, message, expected,
+		suggestion, -1);
+}
+
+/** Reports that fn couldn't be checked past line_no because of message. */
+void emitFailure(struct Emit *const emit, const char *const fn,
+	const unsigned long line_no, const char *const message) {
+	STATS_COUNT(errors, ERROR_FAILURE);
+	emit->failures++;
+	if(emit->format == EMIT_JSONL) {
+		put_string(emit, "{\"file\":");
+		put_json_string(emit, fn);
+		put_string(emit, ",\"line\":");
+		put_ulong(emit, line_no);
+		put_string(emit, ",\"failure\":");
+		put_json_string(emit, message);
+		put_string(emit, "}\n");
+	} else if(emit->format == EMIT_SARIF) {
+		if(emit->results++) put(emit, ",\n", 2);
+		put_string(emit, "{\"ruleId\":\"failure\",\"level\":\"error\","
+			"\"message\":{\"text\":");
+		put_json_string(emit, message);
+		put_string(emit, "},\"locations\":[{\"physicalLocation\":{"
+			"\"artifactLocation\":{\"uri\":\"");
+		put_uri(emit, fn);
+		put_string(emit, "\"},\"region\":{\"startLine\":");
+		put_ulong(emit, line_no ? line_no : 1);
+		put_string(emit, "}}}]}");
+	}
+	flushEmit(emit);
+	fprintf(stderr, "%s line %lu: %s\n", fn, line_no, message);
+}
+
+/* private */
+
+/** {@see emitDiagnostic} and {@see emitFixed}. */
+static void put_diagnostic(struct Emit *const emit, const char *const fn,
+	const unsigned long line_no, const char *const line, const size_t length,
+	const long column, const char *const message, const char *const expected,
+	const char *const suggestion, const int is_fixed) {
+	const size_t c = column >= 0 ? (size_t)column : 0;
+	STATS_DECLARE(t);
+
+	STATS_START(t);
+	if(fn != emit->fn) emit->fn = fn, emit->fn_size = strlen(fn);
+	switch(emit->format) {
+	case EMIT_TEXT:
+		if(emit->fn_size > (size_t)emit->name_max) {
+			put(emit, fn, emit->name_max);
+			put(emit, "...", 3);
+		} else {
+			put(emit, fn, emit->fn_size);
+		}
+		put(emit, ":", 1);
+		put_ulong(emit, line_no);
+		put(emit, ": ", 2);
+		if(!length) {
+			put(emit, "\n", 1); /* a block open at the end has no text */
+		} else {
+			if(column >= 0) put(emit, line, c), put(emit, "***", 3);
+			put(emit, line + c, length - c);
+		}
+		if(is_fixed) put(emit, "fixed: ", 7);
+		else put(emit, "syntax error: ", 14);
+		put_string(emit, message);
+		put(emit, "\n\n", 2);
+		break;
+	case EMIT_JSONL:
+		put_string(emit, "{\"file\":");
+		put_json(emit, fn, emit->fn_size);
+		put_string(emit, ",\"line\":");
+		put_ulong(emit, line_no);
+		put_string(emit, ",\"column\":");
+		if(column >= 0) put_ulong(emit, c);
+		else put_string(emit, "null");
+		put_string(emit, ",\"text\":");
+		put_json(emit, line, trim(line, length));
+		put_string(emit, ",\"message\":");
+		put_json_string(emit, message);
+		put_string(emit, ",\"expected\":");
+		put_expected(emit, expected);
+		put_string(emit, ",\"suggestion\":");
+		if(*suggestion) put_json_string(emit, suggestion);
+		else put_string(emit, "null");
+		if(is_fixed) put_string(emit, ",\"fixed\":true");
+		put_string(emit, "}\n");
+		break;
+	case EMIT_SARIF:
+		if(emit->results++) put(emit, ",\n", 2);
+		put_string(emit, "{\"ruleId\":\"syntax\",\"level\":\"error\",");
+		if(is_fixed) put_string(emit, "\"baselineState\":\"absent\",");
+		put_string(emit, "\"message\":{\"text\":");
+		put_json_string(emit, message);
+		put_string(emit, "},\"locations\":[{\"physicalLocation\":{"
+			"\"artifactLocation\":{\"uri\":\"");
+		put_uri(emit, fn);
+		put_string(emit, "\"},\"region\":{\"startLine\":");
+		put_ulong(emit, line_no);
+		if(column >= 0) {
+			put_string(emit, ",\"startColumn\":");
+			put_ulong(emit, c + 1);
+		}
+		put_string(emit, ",\"snippet\":{\"text\":");
+		put_json(emit, line, trim(line, length));
+		put_string(emit, "}}}}],\"properties\":{\"expected\":");
+		put_expected(emit, expected);
+		if(*suggestion) {
+			put_string(emit, ",\"suggestion\":");
+			put_json_string(emit, suggestion);
+		}
+		put_string(emit, "}}");
+		break;
+	}
+	STATS_STOP(PHASE_FORMAT, t);
+}
+
+/** Copies n bytes at a to the buffer, writing it out whenever it fills. */
+static void put(struct Emit *const e, const char *a, size_t n) {
+	size_t room;
+
+	while(n) {
+		if(e->size >= e->capacity) flushEmit(e);
+		room = e->capacity - e->size;
+		if(room > n) room = n;
+		memcpy(e->buffer + e->size, a, room);
+		e->size += room, a += room, n -= room;
+	}
+}
+
+static void put_string(struct Emit *const e, const char *const s) {
+	put(e, s, strlen(s));
+}
+
+/** Writes x in decimal. */
+static void put_ulong(struct Emit *const e, unsigned long x) {
+	char digits[24], *d = digits + sizeof digits;
+
+	do *--d = (char)('0' + x % 10); while(x /= 10);
+	put(e, d, digits + sizeof digits - d);
+}
+
+/** Writes n bytes at a as a JSON string. Runs of characters that need no
+ escape are copied at once; bytes that aren't UTF-8 are replaced. */
+static void put_json(struct Emit *const e, const char *a, const size_t n) {
+	const unsigned char *s = (const unsigned char *)a, *run;
+	const unsigned char *const end = s + n;
+	size_t u;
+
+	put(e, "\"", 1);
+	for(run = s; s < end; ) {
+		if(*s >= 0x20 && *s != '"' && *s != '\\' && *s < 0x80) { s++; continue; }
+		if(*s >= 0x80 && (u = utf8Length((const char *)s, (const char *)end)))
+			{ s += u; continue; }
+		put(e, (const char *)run, s - run);
+		switch(*s) {
+		case '"':  put(e, "\\\"", 2); break;
+		case '\\': put(e, "\\\\", 2); break;
+		case '\n': put(e, "\\n", 2); break;
+		case '\r': put(e, "\\r", 2); break;
+		case '\t': put(e, "\\t", 2); break;
+		default:
+			if(*s >= 0x80) { put(e, "\\ufffd", 6); break; }
+			{
+				char x[6] = { '\\', 'u', '0', '0', 0, 0 };
+				x[4] = hex[*s >> 4], x[5] = hex[*s & 15];
+				put(e, x, sizeof x);
+			}
+		}
+		run = ++s;
+	}
+	put(e, (const char *)run, s - run);
+	put(e, "\"", 1);
+}
+
+static void put_json_string(struct Emit *const e, const char *const s) {
+	put_json(e, s, strlen(s));
+}
+
+/** Writes the space-separated tokens in expected as a JSON array. */
+static void put_expected(struct Emit *const e, const char *const expected) {
+	const char *a = expected, *b;
+
+	put(e, "[", 1);
+	while(*a) {
+		for(b = a; *b && *b != ' '; b++);
+		if(a != expected) put(e, ",", 1);
+		put_json(e, a, b - a);
+		a = *b ? b + 1 : b;
+	}
+	put(e, "]", 1);
+}
+
+/** Writes fn as a URI reference inside a JSON string; absolute paths are
+ file URIs. */
+static void put_uri(struct Emit *const e, const char *const fn) {
+	const unsigned char *s;
+	char x[3] = { '%', 0, 0 };
+
+	if(*fn == '/') put(e, "file://", 7);
+	for(s = (const unsigned char *)fn; *s; s++) {
+		if((*s >= 'a' && *s <= 'z') || (*s >= 'A' && *s <= 'Z')
+			|| (*s >= '0' && *s <= '9') || *s == '/' || *s == '-' || *s == '.'
+			|| *s == '_' || *s == '~') { put(e, (const char *)s, 1); continue; }
+		x[1] = hex[*s >> 4], x[2] = hex[*s & 15];
+		put(e, x, sizeof x);
+	}
+}
+
+/** @return	The length of line without the new line at the end. */
+static size_t trim(const char *const line, size_t length) {
+	while(length && (line[length - 1] == '\n' || line[length - 1] == '\r'))
+		length--;
+	return length;
+}
@@ -0,0 +1,34 @@
+#include <stdio.h>  /* FILE */
+#include <stddef.h> /* size_t */
+
+/* how the diagnostics are written */
+enum EmitFormat { EMIT_TEXT, EMIT_JSONL, EMIT_SARIF };
+
+/* formats diagnostics into one buffer that goes out in large writes */
+struct Emit {
+	FILE *fp;
+	enum EmitFormat format;
+	int name_max;      /* text cuts file names to this */
+	const char *fn;    /* the last file name, so it's only measured once */
+	size_t fn_size;
+	char *buffer;
+	size_t size, capacity;
+	unsigned long results, failures;
+	int is_error;
+};
+
+int initEmit(struct Emit *const emit, FILE *const fp,
+	const enum EmitFormat format, const char *const tool,
+	const char *const version);
+int endEmit(struct Emit *const emit);
+int flushEmit(struct Emit *const emit);
+void emitDiagnostic(struct Emit *const emit, const char *const fn,
+	const unsigned long line_no, const char *const line, const size_t length,
+	const long column, const char *const message, const char *const expected,
+	const char *const suggestion);
+void emitFixed(struct Emit *const emit, const char *const fn,
+	const unsigned long line_no, const char *const line, const size_t length,
+	const long column, const char *const message, const char *const expected,
+	const char *const suggestion);
+void emitFailure(struct Emit *const emit, const char *const fn,
+	const unsigned long line_no, const char *const message);
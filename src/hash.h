@@ -0,0 +1,4 @@
+#include <stddef.h> /* size_t */
+#include <stdint.h> /* uint64_t */
+
+uint64_t hash64(const void *const data, const size_t size, const uint64_t seed);
@@ -0,0 +1,159 @@
+/* Input for main.c: the file is handed out in blocks that only contain whole
+ lines so they can be tokenised in place, without copying a line at a time
+ like fgets. A regular file is memory-mapped and is all one block; pipes and
+ standard input are read in large blocks, with the unfinished line at the end
+ carried over to the next block. A line longer than the buffer grows the
+ buffer, so there is no limit on the length of a line.
+
+ @author	Neil
+ @version	1; 2016-03
+ @since		1; 2016-03 */
+
+#define _POSIX_C_SOURCE 200809L /* mmap, posix_madvise, read */
+
+#include <stdlib.h>		/* malloc realloc free */
+#include <string.h>		/* strcmp memmove */
+#include <errno.h>		/* errno */
+#include <fcntl.h>		/* open */
+#include <unistd.h>		/* read close */
+#include <sys/types.h>	/* off_t */
+#include <sys/stat.h>	/* fstat */
+#include <sys/mman.h>	/* mmap munmap posix_madvise */
+#include "input.h"
+#include "stats.h"		/* STATS_* */
+
+/* constants */
+static const size_t block_size = 4 << 20;
+
+/* private prototypes */
+static const char *read_block(struct Input *const input, size_t *const size);
+static const char *last_line(const char *const a, const size_t size);
+
+/* public */
+
+/** Opens fn for reading, or standard input if fn is null or "-".
+ @return	True on success; otherwise errno is set. */
+int openInput(struct Input *const input, const char *const fn) {
+	struct stat st;
+
+	input->fd           = -1;
+	input->is_eof       = 0;
+	input->is_error     = 0;
+	input->map          = 0;
+	input->map_size     = 0;
+	input->buf          = 0;
+	input->buf_size     = 0;
+	input->buf_capacity = 0;
+	input->buf_taken    = 0;
+	input->bytes        = 0;
+
+	if(!fn || !strcmp(fn, "-")) {
+		input->fd = STDIN_FILENO;
+	} else if((input->fd = open(fn, O_RDONLY)) == -1) {
+		return 0;
+	}
+	if(fstat(input->fd, &st) == -1) { closeInput(input); return 0; }
+
+	/* only regular files can be mapped; zero-length can't be mapped at all */
+	if(!S_ISREG(st.st_mode) || !st.st_size
+		|| (off_t)(size_t)st.st_size != st.st_size) return -1;
+	input->map = mmap(0, st.st_size, PROT_READ, MAP_PRIVATE, input->fd, 0);
+	if(input->map == MAP_FAILED) { input->map = 0; return -1; }
+	input->map_size = st.st_size;
+	posix_madvise(input->map, input->map_size, POSIX_MADV_SEQUENTIAL);
+
+	return -1;
+}
+
+/** Gets the next block of whole lines; only the last block in the file may
+ end in a line that has no new line. The block is valid until the next call.
+ @return	The block and its size, or null at the end of the file or on error,
+			in which case input->is_error is set along with errno. */
+const char *readBlock(struct Input *const input, size_t *const size) {
+	const char *block;
+	STATS_DECLARE(t);
+
+	if(input->is_error) return 0;
+	if(input->map) {
+		if(input->is_eof) return 0;
+		input->is_eof = -1;
+		block = input->map, *size = input->map_size;
+	} else {
+		STATS_START(t);
+		block = read_block(input, size);
+		STATS_STOP(PHASE_READ, t);
+		if(!block) return 0;
+	}
+	input->bytes += *size;
+	return block;
+}
+
+/** Releases input.
+ @return	True on success; otherwise errno is set. */
+int closeInput(struct Input *const input) {
+	int is_ok = -1;
+
+	if(input->map && munmap(input->map, input->map_size) == -1) is_ok = 0;
+	input->map      = 0;
+	free(input->buf);
+	input->buf      = 0;
+	input->buf_size = input->buf_capacity = input->buf_taken = 0;
+	if(input->fd != -1 && input->fd != STDIN_FILENO
+		&& close(input->fd) == -1) is_ok = 0;
+	input->fd       = -1;
+
+	return is_ok;
+}
+
+/* private */
+
+/** {@see readBlock} when reading; fills the buffer before giving out all the
+ whole lines in it. */
+static const char *read_block(struct Input *const input, size_t *const size) {
+	const char *end;
+	ssize_t r;
+
+	/* the line that was cut off goes to the front */
+	if(input->buf_taken) {
+		input->buf_size -= input->buf_taken;
+		memmove(input->buf, input->buf + input->buf_taken, input->buf_size);
+		input->buf_taken = 0;
+	}
+
+	for( ; ; ) {
+		if(input->is_eof) {
+			if(!input->buf_size) return 0;
+			*size = input->buf_taken = input->buf_size;
+			return input->buf;
+		}
+		if(input->buf_size >= input->buf_capacity) {
+			/* either there's no buffer or the line is too long for it */
+			const size_t c = input->buf_capacity
+				? input->buf_capacity << 1 : block_size;
+			char *const buf = realloc(input->buf, c);
+			if(!buf) { input->is_error = -1; return 0; }
+			input->buf          = buf;
+			input->buf_capacity = c;
+		}
+		if((r = read(input->fd, input->buf + input->buf_size,
+			input->buf_capacity - input->buf_size)) == -1) {
+			if(errno == EINTR) continue;
+			input->is_error = -1;
+			return 0;
+		}
+		if(!r) { input->is_eof = -1; continue; }
+		input->buf_size += r;
+		if(input->buf_size < input->buf_capacity) continue;
+		/* full; give out up to the last new line */
+		if(!(end = last_line(input->buf, input->buf_size))) continue;
+		*size = input->buf_taken = end - input->buf;
+		return input->buf;
+	}
+}
+
+/** @return One past the last new line in [a, a + size) or null. */
+static const char *last_line(const char *const a, const size_t size) {
+	const char *b = a + size;
+	while(b > a) if(*--b == '\n') return b + 1;
+	return 0;
+}
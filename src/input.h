@@ -0,0 +1,16 @@
+#include <stddef.h> /* size_t */
+
+/* reads a file as blocks of whole lines; regular files are memory-mapped in
+ one block, anything else (pipes, stdin) is read in large blocks */
+struct Input {
+	int fd, is_eof, is_error;
+	char *map;
+	size_t map_size;
+	char *buf;
+	size_t buf_size, buf_capacity, buf_taken;
+	size_t bytes;
+};
+
+int openInput(struct Input *const input, const char *const fn);
+const char *readBlock(struct Input *const input, size_t *const size);
+int closeInput(struct Input *const input);
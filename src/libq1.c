@@ -0,0 +1,348 @@
+/* A context for checking many lines at once, for programmes that want to
+ check scripts without running q1 for each one. The diagnostics are kept in
+ one array and the messages, what was expected, and the suggestions in one
+ pool, both reused between calls, and a line that's not valid is repaired in
+ an {@see Arena} that's reused too, so checking doesn't allocate once they've
+ grown large enough. With {@see q1Memo}, lines that have been seen before are
+ remembered, a {@see Memo} for each thread. With {@see q1Analyze}, what the
+ lines cost is added up as they're checked, {@see Analysis}.
+
+ @author	Neil
+ @version	1; 2016-03
+ @since		1; 2016-03 */
+
+#include <stdlib.h>		/* malloc realloc free */
+#include <string.h>		/* strlen memcpy */
+#include <errno.h>		/* errno */
+#include "syntax.h"		/* checkLine checkNested analyzeLine struct Error */
+#include "parallel.h"	/* checkParallel */
+#include "memo.h"		/* Memo */
+#include "analyze.h"	/* Analysis */
+#include "arena.h"		/* Arena */
+#include "libq1.h"
+
+/* below this, threads are more trouble than they're worth */
+static const size_t parallel_min = 4 << 20;
+
+struct Q1 {
+	unsigned threads;
+	int is_nested;
+	struct Nest nest; /* the blocks open in the script, if is_nested */
+	size_t memo_bytes; /* of each of the memos */
+	struct Memo *memos;
+	unsigned memos_size;
+	struct MemoCount memo_count; /* of the ones that have been freed */
+	int is_analyze;
+	struct Analysis analysis; /* of all the lines since q1Analyze */
+	struct Arena arena; /* for the lines that are checked on this thread */
+	const char *base;
+	struct Q1Diagnostic *diagnostics;
+	size_t diagnostics_size, diagnostics_capacity;
+	char *messages;
+	size_t messages_size, messages_capacity;
+	unsigned long lines;
+	int is_error;
+};
+
+/* private prototypes */
+static void clear(struct Q1 *const q1, const char *const base);
+static int memos(struct Q1 *const q1, const unsigned n);
+static void free_memos(struct Q1 *const q1);
+static int check(struct Q1 *const q1, struct Error *const e,
+	const char *const line, const size_t length);
+static void add(void *const param, const unsigned long line_no,
+	const char *const line, const size_t length,
+	const struct Error *const e);
+
+/* public */
+
+/** @return	A new context that checks on one thread, or null and errno is
+			set. */
+struct Q1 *q1Context(void) {
+	struct Q1 *const q1 = malloc(sizeof *q1);
+
+	if(!q1) return 0;
+	q1->threads              = 1;
+	q1->is_nested            = 0;
+	initNest(&q1->nest);
+	q1->memo_bytes           = 0;
+	q1->memos                = 0;
+	q1->memos_size           = 0;
+	q1->memo_count.hits = q1->memo_count.misses = q1->memo_count.collisions
+		= q1->memo_count.evictions = 0;
+	q1->is_analyze           = 0;
+	initAnalysis(&q1->analysis);
+	initArena(&q1->arena);
+	q1->base                 = 0;
+	q1->diagnostics          = 0;
+	q1->diagnostics_size     = q1->diagnostics_capacity = 0;
+	q1->messages             = 0;
+	q1->messages_size        = q1->messages_capacity = 0;
+	q1->lines                = 0;
+	q1->is_error             = 0;
+	return q1;
+}
+
+/** Frees q1, which can be null. */
+void q1Free(struct Q1 *const q1) {
+	if(!q1) return;
+	freeNest(&q1->nest);
+	free_memos(q1);
+	freeArena(&q1->arena);
+	free(q1->diagnostics);
+	free(q1->messages);
+	free(q1);
+}
+
+/** Large buffers are split at new lines and checked on threads; 0 is the
+ same as 1. */
+void q1Threads(struct Q1 *const q1, const unsigned threads) {
+	q1->threads = threads ? threads : 1;
+}
+
+/** If is_nested, checks the extended dialect where REPEAT and WHILE nest and
+ their bodies go over lines, {@see checkNested}; then the lines of a script
+ are given in order to any number of checks, on one thread, and the script
+ is ended with {@see q1End}. Otherwise, every line is by itself, as the
+ assignment has it. */
+void q1Nested(struct Q1 *const q1, const int is_nested) {
+	q1->is_nested = is_nested;
+	freeNest(&q1->nest);
+}
+
+/** Remembers up to about bytes of the lines that have been checked, and what
+ was found, on each thread, so a line that comes up again isn't checked again,
+ {@see checkMemo}; 0, the default, remembers nothing. It forgets what it has
+ remembered, and isn't used in the nested dialect. */
+void q1Memo(struct Q1 *const q1, const size_t bytes) {
+	free_memos(q1);
+	q1->memo_bytes = bytes;
+}
+
+/** Adds up what the memos have done since q1 was made in count. */
+void q1MemoCount(const struct Q1 *const q1, struct MemoCount *const count) {
+	unsigned i;
+
+	*count = q1->memo_count;
+	for(i = 0; i < q1->memos_size; i++) {
+		const struct MemoCount *const c = &q1->memos[i].count;
+		count->hits       += c->hits;
+		count->misses     += c->misses;
+		count->collisions += c->collisions;
+		count->evictions  += c->evictions;
+	}
+}
+
+/** If is_analyze, the lines that are checked are also analysed for what they
+ cost when they run, {@see analyzeLine}, and added up over all the checks
+ until this is called again, {@see q1Analysis}; a REPEAT that is zero or too
+ many times is then not valid. It's on one thread, without the memo, and not
+ in the nested dialect. */
+void q1Analyze(struct Q1 *const q1, const int is_analyze) {
+	q1->is_analyze = is_analyze;
+	initAnalysis(&q1->analysis);
+}
+
+/** @return	What the lines checked since {@see q1Analyze} cost. */
+const struct Analysis *q1Analysis(const struct Q1 *const q1) {
+	return &q1->analysis;
+}
+
+/** Checks every line in [buffer, buffer + size), replacing the diagnostics.
+ Lines end in new lines, except possibly the last; buffer is not modified.
+ @return	True on success; otherwise errno is set and the diagnostics are
+			incomplete. */
+int q1CheckBuffer(struct Q1 *const q1, const char *const buffer,
+	const size_t size) {
+	const char *line, *eol;
+	const char *const end = buffer + size;
+	struct Error e;
+
+	e.arena = &q1->arena;
+	clear(q1, buffer);
+	if(q1->threads > 1 && size >= parallel_min && !q1->is_nested
+		&& !q1->is_analyze) {
+		if(!memos(q1, q1->threads) || !checkParallel(buffer, size, q1->threads,
+			q1->memos, &q1->lines, &add, q1)) return 0;
+	} else {
+		if(!memos(q1, 1)) return 0;
+		for(line = buffer; line < end; line = eol) {
+			q1->lines++;
+			eol = memchr(line, '\n', end - line);
+			eol = eol ? eol + 1 : end;
+			if(!check(q1, &e, line, eol - line)) add(q1, q1->lines, line,
+				eol - line, &e);
+		}
+	}
+	if(q1->is_error || q1->nest.is_error) { errno = ENOMEM; return 0; }
+	return -1;
+}
+
+/** Checks lines_size lines, replacing the diagnostics. If lengths is null,
+ lines are null-terminated.
+ @return	True on success; otherwise errno is set and the diagnostics are
+			incomplete. */
+int q1CheckLines(struct Q1 *const q1, const char *const*const lines,
+	const size_t *const lengths, const size_t lines_size) {
+	struct Error e;
+	size_t i, length;
+
+	e.arena = &q1->arena;
+	clear(q1, 0);
+	if(!memos(q1, 1)) return 0;
+	for(i = 0; i < lines_size; i++) {
+		q1->lines++;
+		length = lengths ? lengths[i] : strlen(lines[i]);
+		if(check(q1, &e, lines[i], length)) continue;
+		q1->base = lines[i];
+		add(q1, q1->lines, lines[i], length, &e);
+	}
+	if(q1->is_error || q1->nest.is_error) { errno = ENOMEM; return 0; }
+	return -1;
+}
+
+/** Ends the script that has been checked, replacing the diagnostics; in the
+ nested dialect, a block that is still open is a diagnostic at the line and
+ column where it starts, with the line counted from the start of the script,
+ not the last check, and no text. The next check starts another script.
+ @return	True on success; otherwise errno is set. */
+int q1End(struct Q1 *const q1) {
+	struct Error e;
+	unsigned long line;
+	const int is_error = q1->nest.is_error;
+
+	e.arena = &q1->arena;
+	clear(q1, "");
+	if(q1->is_nested && !endNested(&e, &q1->nest, &line))
+		add(q1, line, "", 0, &e);
+	q1->nest.is_error = 0;
+	if(q1->is_error || is_error) { errno = ENOMEM; return 0; }
+	return -1;
+}
+
+/** @return	The diagnostics from the last check, in order of line, and their
+			number in size; valid until the next check. */
+const struct Q1Diagnostic *q1Diagnostics(const struct Q1 *const q1,
+	size_t *const size) {
+	*size = q1->diagnostics_size;
+	return q1->diagnostics;
+}
+
+/** @return	The message of d, which is from q1. */
+const char *q1Message(const struct Q1 *const q1,
+	const struct Q1Diagnostic *const d) {
+	return q1->messages + d->message;
+}
+
+/** @return	The tokens that could have been in the place of the error in d,
+			separated by spaces, or empty. */
+const char *q1Expected(const struct Q1 *const q1,
+	const struct Q1Diagnostic *const d) {
+	return q1->messages + d->expected;
+}
+
+/** @return	What d suggests the line should have been, or empty. */
+const char *q1Suggestion(const struct Q1 *const q1,
+	const struct Q1Diagnostic *const d) {
+	return q1->messages + d->suggestion;
+}
+
+/** @return	The number of lines in the last check. */
+unsigned long q1LinesChecked(const struct Q1 *const q1) {
+	return q1->lines;
+}
+
+/* private */
+
+/** Empties q1 for a check of base. */
+static void clear(struct Q1 *const q1, const char *const base) {
+	q1->base             = base;
+	q1->diagnostics_size = 0;
+	q1->messages_size    = 0;
+	q1->lines            = 0;
+	q1->is_error         = 0;
+}
+
+/** Makes sure that, if q1 remembers lines, there are memos for n threads.
+ @return	Success; otherwise errno is set. */
+static int memos(struct Q1 *const q1, const unsigned n) {
+	struct Memo *m;
+
+	if(!q1->memo_bytes || q1->is_nested || q1->memos_size >= n) return -1;
+	if(!(m = realloc(q1->memos, n * sizeof *m))) return 0;
+	q1->memos = m;
+	for( ; q1->memos_size < n; q1->memos_size++) {
+		initMemo(m = q1->memos + q1->memos_size);
+		if(!sizeMemo(m, q1->memo_bytes)) return 0;
+	}
+	return -1;
+}
+
+/** Frees the memos of q1, keeping what they counted. */
+static void free_memos(struct Q1 *const q1) {
+	struct MemoCount count;
+	unsigned i;
+
+	q1MemoCount(q1, &count);
+	q1->memo_count = count;
+	for(i = 0; i < q1->memos_size; i++) freeMemo(q1->memos + i);
+	free(q1->memos);
+	q1->memos      = 0;
+	q1->memos_size = 0;
+}
+
+/** Checks a line in the dialect of q1, with the first memo if it has one,
+ and analyses it if q1 does. */
+static int check(struct Q1 *const q1, struct Error *const e,
+	const char *const line, const size_t length) {
+	if(q1->is_nested) return checkNested(e, &q1->nest, line, length);
+	if(q1->is_analyze) {
+		struct LineCost cost;
+		const int is_valid = analyzeLine(e, &cost, line, length);
+		addAnalysis(&q1->analysis, line, length, is_valid ? &cost : 0);
+		return is_valid;
+	}
+	return q1->memos_size ? checkMemo(q1->memos, e, line, length)
+		: checkLine(e, line, length);
+}
+
+/** Appends a diagnostic; this is a {@see LineReport} with q1 as the
+ parameter. */
+static void add(void *const param, const unsigned long line_no,
+	const char *const line, const size_t length,
+	const struct Error *const e) {
+	struct Q1 *const q1 = param;
+	struct Q1Diagnostic *d;
+	const size_t m = strlen(e->error) + 1, x = strlen(e->expected) + 1,
+		s = strlen(e->suggestion) + 1;
+
+	if(q1->is_error) return;
+	if(q1->diagnostics_size >= q1->diagnostics_capacity) {
+		const size_t c = q1->diagnostics_capacity
+			? q1->diagnostics_capacity << 1 : 64;
+		if(!(d = realloc(q1->diagnostics, c * sizeof *d)))
+			{ q1->is_error = -1; return; }
+		q1->diagnostics          = d;
+		q1->diagnostics_capacity = c;
+	}
+	while(q1->messages_size + m + x + s > q1->messages_capacity) {
+		const size_t c = q1->messages_capacity
+			? q1->messages_capacity << 1 : 4096;
+		char *const messages = realloc(q1->messages, c);
+		if(!messages) { q1->is_error = -1; return; }
+		q1->messages          = messages;
+		q1->messages_capacity = c;
+	}
+	d = q1->diagnostics + q1->diagnostics_size++;
+	d->line    = line_no;
+	d->offset  = line - q1->base;
+	d->length  = length;
+	d->column  = e->index;
+	d->message    = q1->messages_size;
+	d->expected   = d->message + m;
+	d->suggestion = d->expected + x;
+	memcpy(q1->messages + d->message, e->error, m);
+	memcpy(q1->messages + d->expected, e->expected, x);
+	memcpy(q1->messages + d->suggestion, e->suggestion, s);
+	q1->messages_size += m + x + s;
+}
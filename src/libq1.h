@@ -0,0 +1,43 @@
+/* libq1: the syntax checker as a library. A context holds all the state, so
+ different contexts can be used on different threads at the same time; the
+ assignment's initBuffer/nextToken and isValidExpression use globals and are
+ not part of this. */
+
+#include <stddef.h> /* size_t */
+
+struct Q1;
+struct MemoCount; /* see memo.h */
+struct Analysis;  /* see analyze.h */
+
+/* one line that's not valid */
+struct Q1Diagnostic {
+	unsigned long line;   /* starting at one, in the buffer or lines */
+	size_t offset, length; /* of the line in the buffer; offset 0 for lines */
+	long column;           /* of the token in error in the line, or -1 */
+	size_t message;        /* offset of the message, see q1Message */
+	size_t expected;       /* see q1Expected */
+	size_t suggestion;     /* see q1Suggestion */
+};
+
+struct Q1 *q1Context(void);
+void q1Free(struct Q1 *const q1);
+void q1Threads(struct Q1 *const q1, const unsigned threads);
+void q1Nested(struct Q1 *const q1, const int is_nested);
+void q1Memo(struct Q1 *const q1, const size_t bytes);
+void q1MemoCount(const struct Q1 *const q1, struct MemoCount *const count);
+void q1Analyze(struct Q1 *const q1, const int is_analyze);
+const struct Analysis *q1Analysis(const struct Q1 *const q1);
+int q1CheckBuffer(struct Q1 *const q1, const char *const buffer,
+	const size_t size);
+int q1CheckLines(struct Q1 *const q1, const char *const*const lines,
+	const size_t *const lengths, const size_t lines_size);
+int q1End(struct Q1 *const q1);
+const struct Q1Diagnostic *q1Diagnostics(const struct Q1 *const q1,
+	size_t *const size);
+const char *q1Message(const struct Q1 *const q1,
+	const struct Q1Diagnostic *const d);
+const char *q1Expected(const struct Q1 *const q1,
+	const struct Q1Diagnostic *const d);
+const char *q1Suggestion(const struct Q1 *const q1,
+	const struct Q1Diagnostic *const d);
+unsigned long q1LinesChecked(const struct Q1 *const q1);
@@ -0,0 +1,761 @@
+/* A language server on a pair of streams, {@see lspServe}, so an editor can
+ show the diagnostics as the robot script is typed instead of running q1 on
+ the file when it's saved. It speaks JSON-RPC with Content-Length headers,
+ the base protocol of LSP, and knows initialize, shutdown, exit, and the
+ textDocument didOpen, didChange, and didClose notifications.
+
+ An open document is kept as an array of lines. Every line is valid or not by
+ itself, so an edit, which replaces a range of text, only has its own lines
+ checked, with checkLine; the diagnostics of the others are kept already
+ formatted, all but the line number, which can move. The whole list is still
+ sent with every change, as publishDiagnostics has it; on a file with few
+ errors, that's a walk over the array. Positions are in UTF-16, as LSP says
+ unless it's asked for something else.
+
+ @author	Neil
+ @version	1; 2016-03
+ @since		1; 2016-03 */
+
+#define _POSIX_C_SOURCE 200809L /* clock_gettime strncasecmp */
+
+#include <stdio.h>		/* getc fread fwrite fprintf fflush */
+#include <stdlib.h>		/* malloc realloc free strtoul */
+#include <string.h>		/* strlen strcmp strchr memchr memcpy memmove
+						 memcmp */
+#include <strings.h>	/* strncasecmp */
+#include <time.h>		/* clock_gettime */
+#include "syntax.h"		/* checkLine */
+#include "parse.h"		/* delimiters */
+#include "utf8.h"		/* utf8Length utf8Encode */
+#include "arena.h"		/* struct Arena initArena freeArena */
+#include "lsp.h"
+
+/* constants */
+static const char *const programme = "q1";
+static const size_t message_max = (size_t)1 << 30; /* bigger is an error */
+static const unsigned json_depth = 64;
+static const char hex[] = "0123456789abcdef";
+
+/* JSON-RPC errors */
+enum { E_PARSE = -32700, E_METHOD = -32601, E_NOT_INITIALISED = -32002 };
+
+/* a line of a document, without the new line; diagnostic is the end of the
+ diagnostic, formatted, if it's not valid, and start and end are its range */
+struct Line {
+	char *text;
+	size_t size;
+	unsigned long start, end;
+	char *diagnostic;
+};
+
+struct Document {
+	char *uri;
+	unsigned long version;
+	struct Line *lines;
+	size_t lines_size, lines_capacity;
+	unsigned long invalid;
+};
+
+/* a buffer that grows; is_error is set when it couldn't */
+struct Text {
+	char *data;
+	size_t size, capacity;
+	int is_error;
+};
+
+struct Lsp {
+	FILE *in, *out;
+	const char *version;
+	int is_initialised, is_shutdown, is_exit, is_timed;
+	struct Document **documents;
+	size_t documents_size, documents_capacity;
+	struct Text body, string, edit, format, reply;
+	struct Arena arena; /* for the lines that aren't valid */
+	unsigned long checked;
+};
+
+/* private */
+static int read_message(struct Lsp *const lsp);
+static int handle(struct Lsp *const lsp);
+static int open_document(struct Lsp *const lsp, const char *const params);
+static int change_document(struct Lsp *const lsp, const char *const params);
+static int close_document(struct Lsp *const lsp, const char *const params);
+static struct Document *find_document(struct Lsp *const lsp,
+	const char *const params);
+static void free_document(struct Document *const d);
+static int edit_document(struct Lsp *const lsp, struct Document *const d,
+	const char *const change);
+static int position(const struct Document *const d, const char *const p,
+	size_t *const line, size_t *const byte);
+static int splice(struct Lsp *const lsp, struct Document *const d,
+	const size_t a, const size_t b, const char *const text, const size_t size);
+static int check_line(struct Lsp *const lsp, struct Line *const line);
+static int publish(struct Lsp *const lsp, const struct Document *const d);
+static int reply(struct Lsp *const lsp, const char *const id,
+	const char *const result);
+static int reply_error(struct Lsp *const lsp, const char *const id,
+	const int code, const char *const message);
+static int send(struct Lsp *const lsp);
+static size_t byte_offset(const struct Line *const line,
+	const unsigned long character);
+static unsigned long utf16_length(const char *const a, const size_t size);
+static const char *json_space(const char *s);
+static const char *json_skip(const char *s, const unsigned depth);
+static const char *json_member(const char *s, const char *const key);
+static const char *json_element(const char *s, const int is_first);
+static int json_string(const char *s, struct Text *const t);
+static int json_ulong(const char *s, unsigned long *const x);
+static int json_hex4(const char *const s, unsigned long *const x);
+static int reserve(struct Text *const t, const size_t n);
+static void put(struct Text *const t, const char *const a, const size_t n);
+static void put_string(struct Text *const t, const char *const s);
+static void put_ulong(struct Text *const t, unsigned long x);
+static void put_json(struct Text *const t, const char *const a,
+	const size_t n);
+static void put_utf8(struct Text *const t, const unsigned long c);
+
+/* public */
+
+/** Serves the language server protocol: messages come from in and go to out,
+ until the client says exit or in ends. version is what q1 says it is. If
+ is_timed, the time from each change to its diagnostics goes to stderr.
+ @return	Whether it was asked to shut down and exit, as it should have been;
+			otherwise, errno may be set. */
+int lspServe(FILE *const in, FILE *const out, const char *const version,
+	const int is_timed) {
+	struct Lsp lsp = { 0 };
+	size_t i;
+	int is_done = 0;
+
+	lsp.in = in, lsp.out = out, lsp.version = version;
+	lsp.is_timed = is_timed;
+	initArena(&lsp.arena);
+	/* try */ do {
+		while(!lsp.is_exit && read_message(&lsp)) if(!handle(&lsp)) break;
+		is_done = lsp.is_exit && lsp.is_shutdown;
+	} while(0); /* finally */ {
+		for(i = 0; i < lsp.documents_size; i++)
+			free_document(lsp.documents[i]);
+		free(lsp.documents);
+		free(lsp.body.data), free(lsp.string.data), free(lsp.edit.data);
+		free(lsp.format.data), free(lsp.reply.data);
+		freeArena(&lsp.arena);
+	}
+	return is_done ? -1 : 0;
+}
+
+/* private */
+
+/** Reads the headers and the content of the next message into lsp->body,
+ null-terminated.
+ @return	Success, or false at the end of the input or if it's not a
+			message. */
+static int read_message(struct Lsp *const lsp) {
+	char header[128];
+	size_t h, length = 0;
+	int c, is_length = 0;
+
+	for( ; ; ) {
+		for(h = 0; (c = getc(lsp->in)) != EOF && c != '\n'; )
+			if(h < sizeof header - 1) header[h++] = (char)c;
+		if(c == EOF) return 0;
+		if(h && header[h - 1] == '\r') h--;
+		header[h] = '\0';
+		if(!h) break;
+		if(!strncasecmp(header, "Content-Length:", 15)) {
+			char *end;
+			length = strtoul(header + 15, &end, 10);
+			is_length = end != header + 15 && !*end;
+		}
+	}
+	if(!is_length || length > message_max) {
+		fprintf(stderr, "%s: not a message.\n", programme);
+		return 0;
+	}
+	lsp->body.size = 0;
+	if(!reserve(&lsp->body, length + 1)
+		|| fread(lsp->body.data, 1, length, lsp->in) != length) return 0;
+	lsp->body.data[length] = '\0';
+	lsp->body.size = length;
+	return -1;
+}
+
+/** Does what the message in lsp->body says.
+ @return	Whether it can go on. */
+static int handle(struct Lsp *const lsp) {
+	const char *const message = lsp->body.data,
+		*const id = json_member(message, "id"),
+		*const method = json_member(message, "method"),
+		*const params = json_member(message, "params");
+	char m[64];
+
+	if(!json_skip(message, 0) || *json_space(message) != '{')
+		return reply_error(lsp, 0, E_PARSE, "not a JSON object");
+	/* a response; it never asks anything */
+	if(!method) return -1;
+	if(!json_string(method, &lsp->string)
+		|| lsp->string.size >= sizeof m) m[0] = '\0';
+	else memcpy(m, lsp->string.data, lsp->string.size + 1);
+	if(!strcmp(m, "initialize")) {
+		char result[256];
+		lsp->is_initialised = -1;
+		sprintf(result, "{\"capabilities\":{\"positionEncoding\":\"utf-16\","
+			"\"textDocumentSync\":{\"openClose\":true,\"change\":2}},"
+			"\"serverInfo\":{\"name\":\"%s\",\"version\":\"%.16s\"}}",
+			programme, lsp->version);
+		return reply(lsp, id, result);
+	} else if(!strcmp(m, "shutdown")) {
+		lsp->is_shutdown = -1;
+		return reply(lsp, id, "null");
+	} else if(!strcmp(m, "exit")) {
+		lsp->is_exit = -1;
+		return -1;
+	} else if(!lsp->is_initialised) {
+		return id ? reply_error(lsp, id, E_NOT_INITIALISED,
+			"not initialized") : -1;
+	} else if(!strcmp(m, "textDocument/didOpen")) {
+		return open_document(lsp, params);
+	} else if(!strcmp(m, "textDocument/didChange")) {
+		return change_document(lsp, params);
+	} else if(!strcmp(m, "textDocument/didClose")) {
+		return close_document(lsp, params);
+	}
+	/* a notification it doesn't know is ignored */
+	return id ? reply_error(lsp, id, E_METHOD, "method not found") : -1;
+}
+
+/** textDocument/didOpen: the document is checked all at once. */
+static int open_document(struct Lsp *const lsp, const char *const params) {
+	const char *const item = json_member(params, "textDocument"),
+		*const text = json_member(item, "text");
+	struct Document *d;
+	unsigned long version = 0;
+
+	if(!text || !(d = find_document(lsp, params))) return -1;
+	json_ulong(json_member(item, "version"), &version);
+	if(!json_string(text, &lsp->edit)) return 0;
+	d->version = version;
+	lsp->checked = 0;
+	return splice(lsp, d, 0, d->lines_size, lsp->edit.data, lsp->edit.size)
+		&& publish(lsp, d);
+}
+
+/** textDocument/didChange: the changes are made in order, and only the lines
+ that they touch are checked. */
+static int change_document(struct Lsp *const lsp, const char *const params) {
+	const char *const changes = json_member(params, "contentChanges");
+	const char *change;
+	struct Document *d;
+	struct timespec t0, t1;
+	unsigned long version = 0;
+
+	if(lsp->is_timed) clock_gettime(CLOCK_MONOTONIC, &t0);
+	if(!(d = find_document(lsp, params))) return -1;
+	if(json_ulong(json_member(json_member(params, "textDocument"), "version"),
+		&version)) d->version = version;
+	lsp->checked = 0;
+	for(change = json_element(changes, -1); change;
+		change = json_element(change, 0))
+		if(!edit_document(lsp, d, change)) return 0;
+	if(!publish(lsp, d)) return 0;
+	if(lsp->is_timed) {
+		clock_gettime(CLOCK_MONOTONIC, &t1);
+		fprintf(stderr, "%s: %s: %lu lines, %lu checked, %lu not valid in "
+			"%.3f ms.\n", programme, d->uri, (unsigned long)d->lines_size,
+			lsp->checked, d->invalid, (t1.tv_sec - t0.tv_sec) * 1e3
+			+ (t1.tv_nsec - t0.tv_nsec) * 1e-6);
+	}
+	return -1;
+}
+
+/** textDocument/didClose: the document is forgotten, and so are its
+ diagnostics. */
+static int close_document(struct Lsp *const lsp, const char *const params) {
+	struct Document *d;
+	size_t i;
+	int is_sent;
+
+	if(!(d = find_document(lsp, params))) return -1;
+	for(i = 0; lsp->documents[i] != d; i++);
+	memmove(lsp->documents + i, lsp->documents + i + 1,
+		sizeof *lsp->documents * (--lsp->documents_size - i));
+	for(i = 0; i < d->lines_size; i++)
+		free(d->lines[i].text), free(d->lines[i].diagnostic);
+	d->lines_size = 0, d->invalid = 0;
+	is_sent = publish(lsp, d);
+	free_document(d);
+	return is_sent;
+}
+
+/** @return	The document with the uri of params.textDocument, which is new
+			and empty if it's not open; null if there's no uri or no
+			memory. */
+static struct Document *find_document(struct Lsp *const lsp,
+	const char *const params) {
+	struct Document *d, **documents;
+	size_t i;
+
+	if(!json_string(json_member(json_member(params, "textDocument"), "uri"),
+		&lsp->string)) return 0;
+	for(i = 0; i < lsp->documents_size; i++) {
+		d = lsp->documents[i];
+		if(!strcmp(d->uri, lsp->string.data)) return d;
+	}
+	if(lsp->documents_size >= lsp->documents_capacity) {
+		const size_t c = lsp->documents_capacity ? 2 * lsp->documents_capacity
+			: 8;
+		if(!(documents = realloc(lsp->documents, sizeof *documents * c)))
+			return 0;
+		lsp->documents = documents, lsp->documents_capacity = c;
+	}
+	if(!(d = calloc(1, sizeof *d))) return 0;
+	if(!(d->uri = malloc(lsp->string.size + 1))) { free(d); return 0; }
+	memcpy(d->uri, lsp->string.data, lsp->string.size + 1);
+	lsp->documents[lsp->documents_size++] = d;
+	return d;
+}
+
+static void free_document(struct Document *const d) {
+	size_t i;
+	for(i = 0; i < d->lines_size; i++)
+		free(d->lines[i].text), free(d->lines[i].diagnostic);
+	free(d->lines), free(d->uri), free(d);
+}
+
+/** Makes one of contentChanges: text over a range, or all of it if there's
+ no range. */
+static int edit_document(struct Lsp *const lsp, struct Document *const d,
+	const char *const change) {
+	const char *const range = json_member(change, "range"),
+		*const text = json_member(change, "text");
+	size_t a, a_byte, b, b_byte;
+	struct Line *line;
+
+	if(!text) return -1;
+	if(!d->lines_size && !splice(lsp, d, 0, 0, "", 0)) return 0;
+	if(!range) {
+		if(!json_string(text, &lsp->edit)) return 0;
+		return splice(lsp, d, 0, d->lines_size, lsp->edit.data,
+			lsp->edit.size);
+	}
+	if(!position(d, json_member(range, "start"), &a, &a_byte)
+		|| !position(d, json_member(range, "end"), &b, &b_byte)) return -1;
+	if(b < a || (b == a && b_byte < a_byte)) b = a, b_byte = a_byte;
+	/* the start of the first line, the text, and the end of the last */
+	lsp->edit.size = 0;
+	line = d->lines + a;
+	put(&lsp->edit, line->text, a_byte);
+	if(!json_string(text, &lsp->string)) return 0;
+	put(&lsp->edit, lsp->string.data, lsp->string.size);
+	line = d->lines + b;
+	put(&lsp->edit, line->text + b_byte, line->size - b_byte);
+	if(lsp->edit.is_error) return 0;
+	return splice(lsp, d, a, b + 1, lsp->edit.data, lsp->edit.size);
+}
+
+/** Finds the line and the byte in it of the LSP Position, p; past the end is
+ the end.
+ @return	Whether p is a position. */
+static int position(const struct Document *const d, const char *const p,
+	size_t *const line, size_t *const byte) {
+	unsigned long l, c;
+
+	if(!json_ulong(json_member(p, "line"), &l)
+		|| !json_ulong(json_member(p, "character"), &c)) return 0;
+	if(l >= d->lines_size) {
+		*line = d->lines_size - 1;
+		*byte = d->lines[*line].size;
+	} else {
+		*line = l;
+		*byte = byte_offset(d->lines + l, c);
+	}
+	return -1;
+}
+
+/** Replaces lines [a, b) of d with the lines of text, of size, split at new
+ lines, and checks them. */
+static int splice(struct Lsp *const lsp, struct Document *const d,
+	const size_t a, const size_t b, const char *const text, const size_t size) {
+	const char *s, *n, *const end = text + size;
+	size_t k = 1, i;
+	struct Line *line;
+
+	for(s = text; (s = memchr(s, '\n', end - s)); s++) k++;
+	if(d->lines_size - (b - a) + k > d->lines_capacity) {
+		size_t c = d->lines_capacity ? d->lines_capacity : 64;
+		while(c < d->lines_size - (b - a) + k) c *= 2;
+		if(!(line = realloc(d->lines, sizeof *line * c))) return 0;
+		d->lines = line, d->lines_capacity = c;
+	}
+	for(i = a; i < b; i++) {
+		line = d->lines + i;
+		if(line->diagnostic) d->invalid--;
+		free(line->text), free(line->diagnostic);
+	}
+	memmove(d->lines + a + k, d->lines + b,
+		sizeof *d->lines * (d->lines_size - b));
+	d->lines_size = d->lines_size - (b - a) + k;
+	for(s = text, i = a; i < a + k; i++, s = n + 1) {
+		if(!(n = memchr(s, '\n', end - s))) n = end;
+		line = d->lines + i;
+		line->size = n - s;
+		line->diagnostic = 0;
+		if(!(line->text = malloc(line->size + 1))) {
+			/* so it can be freed */
+			for( ; i < a + k; i++) d->lines[i].text = 0,
+				d->lines[i].diagnostic = 0, d->lines[i].size = 0;
+			return 0;
+		}
+		memcpy(line->text, s, line->size);
+		line->text[line->size] = '\0';
+		if(!check_line(lsp, line)) return 0;
+		if(line->diagnostic) d->invalid++;
+	}
+	return -1;
+}
+
+/** Checks line, and formats its diagnostic if it's not valid; the range is
+ the token at syntax.index, or the line if there's none. */
+static int check_line(struct Lsp *const lsp, struct Line *const line) {
+	struct Error e;
+	char message[sizeof e.error + sizeof e.expected + 16];
+	size_t start, end, size = line->size;
+
+	e.arena = &lsp->arena;
+	lsp->checked++;
+	if(size && line->text[size - 1] == '\r') size--;
+	if(checkLine(&e, line->text, size)) return -1;
+	if(e.index < 0) {
+		start = 0, end = size;
+	} else {
+		start = (size_t)e.index < size ? (size_t)e.index : size;
+		for(end = start; end < size && !strchr(delimiters, line->text[end]);
+			end++);
+	}
+	line->start = utf16_length(line->text, start);
+	line->end = line->start + utf16_length(line->text + start, end - start);
+	snprintf(message, sizeof message, *e.expected ? "%s\nexpected: %s" : "%s",
+		e.error, e.expected);
+	lsp->format.size = 0;
+	put_string(&lsp->format, ",\"severity\":1,\"source\":\"");
+	put_string(&lsp->format, programme);
+	put_string(&lsp->format, "\",\"message\":");
+	put_json(&lsp->format, message, strlen(message));
+	put(&lsp->format, "}", 2);
+	if(lsp->format.is_error
+		|| !(line->diagnostic = malloc(lsp->format.size))) return 0;
+	memcpy(line->diagnostic, lsp->format.data, lsp->format.size);
+	return -1;
+}
+
+/** Sends textDocument/publishDiagnostics with every line of d that's not
+ valid. */
+static int publish(struct Lsp *const lsp, const struct Document *const d) {
+	struct Text *const r = &lsp->reply;
+	size_t i;
+	int is_first = -1;
+
+	r->size = 0;
+	put_string(r, "{\"jsonrpc\":\"2.0\",\"method\":"
+		"\"textDocument/publishDiagnostics\",\"params\":{\"uri\":");
+	put_json(r, d->uri, strlen(d->uri));
+	put_string(r, ",\"version\":");
+	put_ulong(r, d->version);
+	put_string(r, ",\"diagnostics\":[");
+	for(i = 0; i < d->lines_size; i++) {
+		const struct Line *const line = d->lines + i;
+		if(!line->diagnostic) continue;
+		put_string(r, is_first ? "{\"range\":{\"start\":{\"line\":"
+			: ",{\"range\":{\"start\":{\"line\":");
+		put_ulong(r, (unsigned long)i);
+		put_string(r, ",\"character\":");
+		put_ulong(r, line->start);
+		put_string(r, "},\"end\":{\"line\":");
+		put_ulong(r, (unsigned long)i);
+		put_string(r, ",\"character\":");
+		put_ulong(r, line->end);
+		put_string(r, "}}");
+		put_string(r, line->diagnostic);
+		is_first = 0;
+	}
+	put_string(r, "]}}");
+	return send(lsp);
+}
+
+/** Answers the request with id with result, which is JSON. */
+static int reply(struct Lsp *const lsp, const char *const id,
+	const char *const result) {
+	struct Text *const r = &lsp->reply;
+	const char *const id_end = id ? json_skip(id, 0) : 0;
+
+	if(!id_end) return -1; /* a notification gets no answer */
+	r->size = 0;
+	put_string(r, "{\"jsonrpc\":\"2.0\",\"id\":");
+	put(r, id, id_end - id);
+	put_string(r, ",\"result\":");
+	put_string(r, result);
+	put_string(r, "}");
+	return send(lsp);
+}
+
+/** Answers the request with id, or null, with an error. */
+static int reply_error(struct Lsp *const lsp, const char *const id,
+	const int code, const char *const message) {
+	struct Text *const r = &lsp->reply;
+	const char *const id_end = id ? json_skip(id, 0) : 0;
+	char c[16];
+
+	r->size = 0;
+	put_string(r, "{\"jsonrpc\":\"2.0\",\"id\":");
+	if(id_end) put(r, id, id_end - id);
+	else put_string(r, "null");
+	sprintf(c, "%d", code);
+	put_string(r, ",\"error\":{\"code\":");
+	put_string(r, c);
+	put_string(r, ",\"message\":");
+	put_json(r, message, strlen(message));
+	put_string(r, "}}");
+	return send(lsp);
+}
+
+/** Writes lsp->reply to lsp->out as a message. */
+static int send(struct Lsp *const lsp) {
+	const struct Text *const r = &lsp->reply;
+	if(r->is_error) return 0;
+	return fprintf(lsp->out, "Content-Length: %lu\r\n\r\n",
+		(unsigned long)r->size) > 0
+		&& fwrite(r->data, 1, r->size, lsp->out) == r->size
+		&& !fflush(lsp->out) ? -1 : 0;
+}
+
+/** @return	The byte in line of the UTF-16 character, or the end. */
+static size_t byte_offset(const struct Line *const line,
+	const unsigned long character) {
+	const unsigned char *const a = (const unsigned char *)line->text;
+	unsigned long u = 0;
+	size_t i;
+
+	for(i = 0; i < line->size && u < character; i++) {
+		if((a[i] & 0xc0) == 0x80) continue;
+		u += a[i] >= 0xf0 ? 2 : 1;
+	}
+	while(i < line->size && (a[i] & 0xc0) == 0x80) i++;
+	return i;
+}
+
+/** @return	The length in UTF-16 of size bytes of UTF-8 at a. */
+static unsigned long utf16_length(const char *const a, const size_t size) {
+	const unsigned char *s = (const unsigned char *)a,
+		*const end = s + size;
+	unsigned long u = 0;
+
+	for( ; s < end; s++) if((*s & 0xc0) != 0x80) u += *s >= 0xf0 ? 2 : 1;
+	return u;
+}
+
+/** @return	s past white space. */
+static const char *json_space(const char *s) {
+	while(*s == ' ' || *s == '\t' || *s == '\n' || *s == '\r') s++;
+	return s;
+}
+
+/** @return	s past the JSON value at it, or null if it's not one. Only the
+			structure is checked. */
+static const char *json_skip(const char *s, const unsigned depth) {
+	char close;
+
+	s = json_space(s);
+	switch(*s) {
+	case '"':
+		for(s++; *s != '"'; s++) {
+			if(!*s || (*s == '\\' && !*++s)) return 0;
+		}
+		return s + 1;
+	case '{':
+	case '[':
+		if(depth >= json_depth) return 0;
+		close = *s == '{' ? '}' : ']';
+		if(*(s = json_space(s + 1)) == close) return s + 1;
+		for( ; ; ) {
+			if(close == '}') {
+				if(*s != '"' || !(s = json_skip(s, depth + 1))
+					|| *(s = json_space(s)) != ':') return 0;
+				s++;
+			}
+			if(!(s = json_skip(s, depth + 1))) return 0;
+			if(*(s = json_space(s)) == close) return s + 1;
+			if(*s != ',') return 0;
+			s = json_space(s + 1);
+		}
+	case '\0':
+		return 0;
+	default:
+		if(!strchr("-0123456789tfn", *s)) return 0;
+		while(*s && !strchr(",:]} \t\r\n", *s)) s++;
+		return s;
+	}
+}
+
+/** @return	The value of key in the object at s, or null if s is null, is
+			not an object, or has no key. Keys are compared as they are,
+			without escapes. */
+static const char *json_member(const char *s, const char *const key) {
+	const size_t key_size = strlen(key);
+	const char *k, *v;
+
+	if(!s || *(s = json_space(s)) != '{') return 0;
+	for(s = json_space(s + 1); *s == '"'; s = json_space(s + 1)) {
+		k = s + 1;
+		if(!(s = json_skip(s, 0)) || *(v = json_space(s)) != ':') return 0;
+		v = json_space(v + 1);
+		if((size_t)(s - 1 - k) == key_size && !memcmp(k, key, key_size))
+			return v;
+		if(!(s = json_skip(v, 0)) || *(s = json_space(s)) != ',') return 0;
+	}
+	return 0;
+}
+
+/** @return	The first element of the array at s if is_first, otherwise the
+			one after the element at s; null if there are no more. */
+static const char *json_element(const char *s, const int is_first) {
+	if(!s) return 0;
+	if(is_first) {
+		if(*(s = json_space(s)) != '[') return 0;
+		s = json_space(s + 1);
+		return *s == ']' || !*s ? 0 : s;
+	}
+	if(!(s = json_skip(s, 0)) || *(s = json_space(s)) != ',') return 0;
+	return json_space(s + 1);
+}
+
+/** Decodes the JSON string at s into t, null-terminated; bad escapes and
+ lone surrogates are U+FFFD.
+ @return	Whether it was a string and there was memory. */
+static int json_string(const char *s, struct Text *const t) {
+	const char *run;
+	unsigned long c, d;
+
+	t->size = 0, t->is_error = 0;
+	if(!s || *(s = json_space(s)) != '"') return 0;
+	for(run = ++s; *s != '"'; ) {
+		if(!*s) return 0;
+		if(*s != '\\') { s++; continue; }
+		put(t, run, s - run);
+		switch(*++s) {
+		case 'n': put(t, "\n", 1); s++; break;
+		case 'r': put(t, "\r", 1); s++; break;
+		case 't': put(t, "\t", 1); s++; break;
+		case 'b': put(t, "\b", 1); s++; break;
+		case 'f': put(t, "\f", 1); s++; break;
+		case 'u':
+			if(!json_hex4(s + 1, &c)) { put_utf8(t, 0xfffd); s++; break; }
+			s += 5;
+			if(c >= 0xd800 && c < 0xdc00 && s[0] == '\\' && s[1] == 'u'
+				&& json_hex4(s + 2, &d) && d >= 0xdc00 && d < 0xe000) {
+				c = 0x10000 + ((c - 0xd800) << 10) + (d - 0xdc00);
+				s += 6;
+			}
+			put_utf8(t, c >= 0xd800 && c < 0xe000 ? 0xfffd : c);
+			break;
+		case '\0': return 0;
+		default: put(t, s, 1); s++; break; /* \" \\ \/ */
+		}
+		run = s;
+	}
+	put(t, run, s - run);
+	put(t, "", 1), t->size--;
+	return !t->is_error;
+}
+
+/** Reads the non-negative integer at s into x.
+ @return	Whether there was one. */
+static int json_ulong(const char *s, unsigned long *const x) {
+	if(!s || *(s = json_space(s)) < '0' || *s > '9') return 0;
+	*x = strtoul(s, 0, 10);
+	return -1;
+}
+
+/** Reads the four hex digits at s, of a \u escape, into x.
+ @return	Whether there were four. */
+static int json_hex4(const char *const s, unsigned long *const x) {
+	const char *h;
+	unsigned i;
+
+	for(*x = 0, i = 0; i < 4; i++) {
+		if(!s[i] || !(h = strchr(hex, s[i] | 0x20))) return 0;
+		*x = *x << 4 | (unsigned long)(h - hex);
+	}
+	return -1;
+}
+
+/** Makes room for n more bytes in t. */
+static int reserve(struct Text *const t, const size_t n) {
+	size_t c;
+	char *data;
+
+	if(t->is_error) return 0;
+	if(t->size + n <= t->capacity) return -1;
+	for(c = t->capacity ? t->capacity : 4096; c < t->size + n; c *= 2);
+	if(!(data = realloc(t->data, c))) { t->is_error = -1; return 0; }
+	t->data = data, t->capacity = c;
+	return -1;
+}
+
+static void put(struct Text *const t, const char *const a, const size_t n) {
+	if(!reserve(t, n)) return;
+	memcpy(t->data + t->size, a, n);
+	t->size += n;
+}
+
+static void put_string(struct Text *const t, const char *const s) {
+	put(t, s, strlen(s));
+}
+
+/** Writes x in decimal. */
+static void put_ulong(struct Text *const t, unsigned long x) {
+	char digits[24], *d = digits + sizeof digits;
+
+	do *--d = (char)('0' + x % 10); while(x /= 10);
+	put(t, d, digits + sizeof digits - d);
+}
+
+/** Writes n bytes at a as a JSON string; control characters are escaped,
+ and a byte that is not part of UTF-8 is written as U+FFFD, (messages quote
+ words cut to a length, and that can be inside a character.) */
+static void put_json(struct Text *const t, const char *const a,
+	const size_t n) {
+	const char *s = a, *run, *const end = a + n;
+
+	put(t, "\"", 1);
+	for(run = s; s < end; s++) {
+		const unsigned char c = (unsigned char)*s;
+		if(c >= 0x80) {
+			const size_t i = utf8Length(s, end);
+			if(i) { s += i - 1; continue; }
+			put(t, run, s - run);
+			put_utf8(t, 0xfffd);
+			run = s + 1;
+			continue;
+		}
+		if(c >= 0x20 && c != '"' && c != '\\') continue;
+		put(t, run, s - run);
+		if(c == '"') put(t, "\\\"", 2);
+		else if(c == '\\') put(t, "\\\\", 2);
+		else if(c == '\n') put(t, "\\n", 2);
+		else if(c == '\t') put(t, "\\t", 2);
+		else {
+			char x[6] = { '\\', 'u', '0', '0', 0, 0 };
+			x[4] = hex[c >> 4], x[5] = hex[c & 15];
+			put(t, x, sizeof x);
+		}
+		run = s + 1;
+	}
+	put(t, run, s - run);
+	put(t, "\"", 1);
+}
+
+/** Writes the code point c in UTF-8. */
+static void put_utf8(struct Text *const t, const unsigned long c) {
+	char u[4];
+	put(t, u, utf8Encode(u, c));
+}
@@ -0,0 +1,4 @@
+#include <stdio.h> /* FILE */
+
+int lspServe(FILE *const in, FILE *const out, const char *const version,
+	const int is_timed);
@@ -17,101 +17,599 @@
  @version	1; 2016-03
  @since		1; 2016-03 */
 
-#include <stdio.h>  /* fprintf, fgets */
-#include <string.h>	/* strlen */
+#define _POSIX_C_SOURCE 200809L /* clock_gettime */
+
+#include <stdio.h>  /* fprintf, snprintf */
+#include <string.h>	/* strlen, memchr */
 #include <stdlib.h>	/* EXIT_* */
-#include "syntax.h"	/* including syntax (error) */
+#include <errno.h>	/* errno */
+#include <limits.h>	/* INT_MAX */
+#include <time.h>	/* clock_gettime */
+#include <unistd.h>	/* sysconf */
+#include "libq1.h"	/* q1* */
+#include "input.h"	/* openInput, readBlock */
+#include "batch.h"	/* initBatch, addBatchPath, checkBatch, MemoCount */
+#include "cache.h"	/* openCache, getCache, replayCache, beginCache, endCache */
+#include "emit.h"	/* initEmit, emitDiagnostic, emitFailure, endEmit */
+#include "robot.h"	/* initRobot, compileRobot, initWorld, runRobot */
+#include "stats.h"	/* isStats, printStats, freeStats */
+#include "lsp.h"	/* lspServe */
+#include "watch.h"	/* watchServe */
+#include "analyze.h"	/* Analysis, costString, costDouble */
 
 /* constants */
 static const char *programme   = "q1";
 static const char *year        = "2016";
 static const int versionMajor  = 1;
-static const int versionMinor  = 0;
+static const int versionMinor  = 2;
 
 static const char *lf = "\n\r"; /* fixme: vertical tab, etc */
 static const int debug = 0;
 
+/* the diagnostics are printed after every slice so they don't all have to be
+ held in memory */
+static const size_t slice_size = 64 << 20;
+
+/* the exit status with more than one file */
+enum { X_VALID, X_INVALID, X_FAILED };
+
+/* the file name is cut to this in diagnostics, unless there are many files */
+static const int name_max = 16;
+
+/* --run stops a robot that has executed this many ops by default */
+static const unsigned long long run_max = 1000000000ull;
+
+/* where the diagnostics go */
+static struct Emit out;
+
+/* the number of lines that are not valid */
+static unsigned long invalid;
+
 /* private */
+static int check_block(struct Q1 *const q1, const char *const block,
+	const size_t size, unsigned long *const line_no, const char *const fn,
+	struct Cache *const cache);
+static void print_diagnostics(const struct Q1 *const q1,
+	const char *const base, const unsigned long line_no, const char *const fn,
+	struct Cache *const cache);
+static void print_error(const char *const fn, const unsigned long line_no,
+	const char *const line, const size_t line_len, const long column,
+	const char *const message, const char *const expected,
+	const char *const suggestion);
+static void print_memo(const struct MemoCount *const count);
+static void print_analysis(const struct Analysis *const a,
+	const char *const fn);
+static int run(const struct Robot *const robot, const char *const world_fn,
+	const unsigned long long max_ops, const int is_timed);
 static void usage(void);
 
 /** Entry point.
  @param argc	The number of arguments, starting with the programme name.
  @param argv	The arguments.
- @return		Either EXIT_SUCCESS or EXIT_FAILURE.
- @fixme			Should be "q1 < file" instead of "q1 file"; much simpler and
-				more robust. */
+ @return		Either EXIT_SUCCESS or EXIT_FAILURE; with more than one file,
+				X_VALID, X_INVALID if any line is not valid, or X_FAILED if any file
+				could not be checked. */
 int main(int argc, char **argv) {
-	char line[1024];
-	int buffer_len;
-	FILE *fp = 0;
-	enum Error { E_NO, E_SYNTAX, E_FILE, E_LINE } error = E_NO;
-	int line_no = 0;
+	struct Input input;
+	struct Q1 *q1 = 0;
+	struct Batch batch;
+	struct BatchSummary summary;
+	struct Cache cache;
+	struct CacheKey key;
+	const struct CacheRecord *record;
+	struct Robot robot;
+	const char *block, *end, *last, *files_from = 0, *cache_dir = 0,
+		*world_fn = 0;
+	size_t block_size;
+	int is_input = 0, is_timed = 0, is_recursive = 0, is_threads = 0,
+		is_batch = 0, is_cache = 0, is_record = 0, is_emit = 0, is_run = 0,
+		is_robot = 0, is_lsp = 0, is_nested = 0, is_analyze = 0, is_watch = 0,
+		stats = 0, status = EXIT_SUCCESS, arg;
+	unsigned long long max_ops = run_max;
+	size_t memo = 0;
+	enum EmitFormat format = EMIT_TEXT;
+	char version[16];
+	long threads = 1;
+	struct timespec t0, t1;
+	enum Error { E_NO, E_SYNTAX, E_FILE, E_LINE, E_RESOURCE } error = E_NO;
+	unsigned long line_no = 0;
 	char *fn = 0;
 
 	/* try */ do {
 
-		/* check that one arg is passed */
-		if(argc != 2) { error = E_SYNTAX; break; }
-		fn = argv[1];
+		/* options, then files; "-" is standard input */
+		for(arg = 1; arg < argc && argv[arg][0] == '-' && argv[arg][1]; arg++) {
+			if(!strcmp(argv[arg], "--")) {
+				arg++;
+				break;
+			} else if(!strcmp(argv[arg], "-t")) {
+				is_timed = -1;
+			} else if(!strcmp(argv[arg], "-r")) {
+				is_recursive = -1;
+			} else if(!strncmp(argv[arg], "--files-from", 12)) {
+				files_from = argv[arg][12] == '=' ? argv[arg] + 13
+					: argv[arg][12] || ++arg >= argc ? "" : argv[arg];
+				if(!*files_from) { error = E_SYNTAX; break; }
+			} else if(!strncmp(argv[arg], "--format=", 9)) {
+				const char *const f = argv[arg] + 9;
+				if(!strcmp(f, "text")) format = EMIT_TEXT;
+				else if(!strcmp(f, "jsonl")) format = EMIT_JSONL;
+				else if(!strcmp(f, "sarif")) format = EMIT_SARIF;
+				else { error = E_SYNTAX; break; }
+			} else if(!strncmp(argv[arg], "--cache", 7)) {
+				cache_dir = argv[arg][7] == '=' ? argv[arg] + 8
+					: argv[arg][7] || ++arg >= argc ? "" : argv[arg];
+				if(!*cache_dir) { error = E_SYNTAX; break; }
+			} else if(!strcmp(argv[arg], "--run")) {
+				is_run = -1;
+			} else if(!strncmp(argv[arg], "--world", 7)) {
+				world_fn = argv[arg][7] == '=' ? argv[arg] + 8
+					: argv[arg][7] || ++arg >= argc ? "" : argv[arg];
+				if(!*world_fn) { error = E_SYNTAX; break; }
+			} else if(!strncmp(argv[arg], "--max-ops", 9)) {
+				const char *const n = argv[arg][9] == '=' ? argv[arg] + 10
+					: argv[arg][9] || ++arg >= argc ? "" : argv[arg];
+				char *n_end;
+				max_ops = strtoull(n, &n_end, 10);
+				if(!*n || *n_end || *n == '-') { error = E_SYNTAX; break; }
+			} else if(!strncmp(argv[arg], "--memo", 6)) {
+				const char *const n = argv[arg][6] == '=' ? argv[arg] + 7
+					: argv[arg][6] || ++arg >= argc ? "" : argv[arg];
+				char *n_end;
+				unsigned long long m = strtoull(n, &n_end, 10);
+				switch(*n_end) {
+					case 'G': m <<= 10; /* fall through */
+					case 'M': m <<= 10; /* fall through */
+					case 'K': m <<= 10; n_end++; break;
+					default: break;
+				}
+				if(!*n || *n_end || *n == '-' || m > (size_t)-1 >> 2)
+					{ error = E_SYNTAX; break; }
+				memo = (size_t)m;
+			} else if(!strcmp(argv[arg], "--lsp")) {
+				is_lsp = -1;
+			} else if(!strcmp(argv[arg], "--nested")) {
+				is_nested = -1;
+			} else if(!strcmp(argv[arg], "--analyze")) {
+				is_analyze = -1;
+			} else if(!strcmp(argv[arg], "--watch")) {
+				is_watch = -1;
+			} else if(!strcmp(argv[arg], "--stats")
+				|| !strcmp(argv[arg], "--stats=text")) {
+				stats = 1;
+			} else if(!strcmp(argv[arg], "--stats=json")) {
+				stats = 2;
+			} else if(!strncmp(argv[arg], "-j", 2)) {
+				const char *const n = argv[arg][2] ? argv[arg] + 2
+					: ++arg < argc ? argv[arg] : "";
+				char *n_end;
+				threads = strtol(n, &n_end, 10);
+				if(!*n || *n_end || threads < 0 || threads > 1024)
+					{ error = E_SYNTAX; break; }
+				if(!threads && (threads = sysconf(_SC_NPROCESSORS_ONLN)) < 1)
+					threads = 1;
+				is_threads = -1;
+			} else { error = E_SYNTAX; break; }
+		}
+		if(error) break;
+		if(stats && !isStats()) {
+			fprintf(stderr, "%s: --stats needs the counters; make clean, then "
+				"make STATS=1.\n", programme);
+			status = EXIT_FAILURE;
+			break;
+		}
+
+		snprintf(version, sizeof version, "%d.%d", versionMajor, versionMinor);
+
+		/* the nested dialect goes on from line to line, so it's not per line
+		 in an editor or the cache, and robot.c runs only one loop at a time */
+		if(is_nested && (is_lsp || is_run || cache_dir))
+			{ error = E_SYNTAX; break; }
+		/* the analysis is of every line of one file as it's checked */
+		if(is_analyze && (is_nested || is_lsp || cache_dir || is_recursive
+			|| files_from || argc - arg != 1)) { error = E_SYNTAX; break; }
+		/* a script that's run has its counts read exactly, as the analysis
+		 does, which the cache doesn't */
+		if(is_run && cache_dir) { error = E_SYNTAX; break; }
+		/* a watch checks the lines that change, one at a time, by itself */
+		if(is_watch && (is_nested || is_lsp || is_run || is_analyze
+			|| cache_dir || files_from || memo || arg >= argc))
+			{ error = E_SYNTAX; break; }
+
+		/* an editor sends the files, and gets the diagnostics back, on the
+		 standard streams */
+		if(is_lsp) {
+			if(arg < argc || is_run || cache_dir) { error = E_SYNTAX; break; }
+			if(!lspServe(stdin, stdout, version, is_timed))
+				status = EXIT_FAILURE;
+			break;
+		}
+
+		if(!initEmit(&out, stdout, format, programme, version))
+			{ error = E_RESOURCE; break; }
+		is_emit = -1;
+		out.name_max = name_max;
+
+		/* the files are checked, then the lines that changed whenever one of
+		 them is saved, until it's interrupted */
+		if(is_watch) {
+			out.name_max = INT_MAX;
+			if(!watchServe(argv + arg, (size_t)(argc - arg), &out, is_timed))
+				status = EXIT_FAILURE;
+			break;
+		}
+
+		/* results are stored by the contents of the files; if there's a
+		 problem with the cache, it's as if there were none */
+		if(cache_dir) {
+			if(openCache(&cache, cache_dir, versionMajor, versionMinor))
+				is_cache = -1;
+			else fprintf(stderr, "%s: cache %s: %s; not using it.\n",
+				programme, cache_dir, strerror(errno));
+		}
+
+		/* many files are checked on a pool of threads, one per processor
+		 unless -j says otherwise */
+		if(is_recursive || files_from || argc - arg > 1) {
+			if(is_run) { error = E_SYNTAX; break; }
+			struct timespec b0, b1;
+			initBatch(&batch), is_batch = -1;
+			batch.is_nested = is_nested;
+			batch.memo      = memo;
+			for( ; arg < argc; arg++) if(!addBatchPath(&batch, argv[arg],
+				is_recursive)) { fn = argv[arg]; error = E_FILE; break; }
+			if(error) break;
+			if(files_from && !addBatchList(&batch, files_from, is_recursive))
+				{ fn = (char *)files_from; error = E_FILE; break; }
+			if(!is_threads
+				&& (threads = sysconf(_SC_NPROCESSORS_ONLN)) < 1) threads = 1;
+			out.name_max = INT_MAX;
+			if(is_timed) clock_gettime(CLOCK_MONOTONIC, &b0);
+			if(!checkBatch(&batch, (unsigned)threads, is_cache ? &cache : 0,
+				&print_error, &summary))
+				{ error = E_RESOURCE; break; }
+			flushEmit(&out);
+			if(is_timed) {
+				double s;
+				clock_gettime(CLOCK_MONOTONIC, &b1);
+				s = (b1.tv_sec - b0.tv_sec) + (b1.tv_nsec - b0.tv_nsec) * 1e-9;
+				fprintf(stderr, "%lu files: %lu bytes, %lu lines in %.3f s; "
+					"%.1f MB/s, %.0f lines/s.\n", summary.files,
+					(unsigned long)summary.bytes, summary.lines, s,
+					s > 0.0 ? summary.bytes / s * 1e-6 : 0.0,
+					s > 0.0 ? summary.lines / s : 0.0);
+				if(memo && !is_nested) print_memo(&summary.memo);
+			}
+			fprintf(stderr, "%s: %lu files, %lu lines; %lu with errors, "
+				"%lu failed", programme, summary.files, summary.lines,
+				summary.invalid, summary.failed);
+			if(is_cache) fprintf(stderr, "; %lu cached", summary.cached);
+			fputs(".\n", stderr);
+			status = summary.failed ? X_FAILED
+				: summary.invalid ? X_INVALID : X_VALID;
+			break;
+		}
+		if(argc - arg != 1) { error = E_SYNTAX; break; }
+		fn = argv[arg];
+
+		initRobot(&robot), is_robot = -1;
+		if(!(q1 = q1Context())) { error = E_RESOURCE; break; }
+		q1Threads(q1, (unsigned)threads);
+		q1Nested(q1, is_nested);
+		q1Memo(q1, memo);
+		q1Analyze(q1, is_analyze || is_run);
 
 		/* open the file */
-		if(!(fp = fopen(fn, "r"))) { error = E_FILE; break; }
+		if(!openInput(&input, fn)) { error = E_FILE; break; }
+		is_input = -1;
+		if(is_timed) clock_gettime(CLOCK_MONOTONIC, &t0);
 
-		/* syntax check */
-		while(fgets(line, sizeof line, fp)) {
-			line_no++;
-			if(debug) fprintf(stderr, "LINE %u: %s", line_no, line);
+		/* syntax check; the lines are checked in place in the block */
+		while((block = readBlock(&input, &block_size))) {
+			/* the lines that are valid are compiled as well */
+			if(is_run && !compileRobot(&robot, block, block_size))
+				{ error = E_RESOURCE; break; }
+			/* a memory-mapped file is one block; if it's been seen, print
+			 what was found before */
+			if(is_cache && input.map) {
+				int is_unterminated;
+				keyCache(&key, block, block_size);
+				if((record = getCache(&cache, &key))) {
+					replayCache(&cache, record, fn, &print_error, &line_no,
+						&is_unterminated);
+					if(is_unterminated) { error = E_LINE; line_no++; }
+					break;
+				}
+				beginCache(&cache, &key), is_record = -1;
+			}
 			/* "Every command or expression terminates with a carriage return
 			 and line feed." -- too restrictive (Windows gah,) but test at least
-			 new lines of any kind; fixme: \n is different on different
-			 systems, try it out */
-			buffer_len = strlen(line);
-			if(!buffer_len || !strchr(lf, line[buffer_len - 1])) { error = E_LINE; break; }
-
-			/* check for syntax; isValidExpression checks if the line is a
-			 valid expression, including all the commands and expressions;
-			 Expression (line) != expression (token) */
-			if(isValidExpression(line)) continue;
-
-			/* syntax error message */
-			if(syntax.index < 0) {
-				printf("%.16s%s:%u: %s", fn, strlen(fn) > 16 ? "..." : "",
-					   line_no, line);
-			} else {
-				printf("%.16s%s:%u: %.*s***%s", fn, strlen(fn) > 16 ? "..." :
-					   "", line_no, syntax.index, line, line + syntax.index);
+			 new lines of any kind; only the last line can be missing it */
+			end = block + block_size;
+			if(end[-1] != '\n' && !(end[-1] && strchr(lf, end[-1]))) {
+				for(last = end; last > block && last[-1] != '\n'; last--);
+				block_size = last - block;
+				error = E_LINE;
 			}
-			printf("syntax error: %s\n\n", syntax.error);
+			if(!check_block(q1, block, block_size, &line_no, fn,
+				is_record ? &cache : 0)) { error = E_RESOURCE; break; }
+			if(is_record) endCache(&cache, line_no, error == E_LINE),
+				is_record = 0;
+			if(error) { line_no++; break; }
 		}
 		if(error) break;
-		if(ferror(fp)) { error = E_FILE; break; };
+		if(input.is_error) { error = E_FILE; break; };
+
+		/* blocks that are still open at the end, where they start */
+		if(!q1End(q1)) { error = E_RESOURCE; break; }
+		print_diagnostics(q1, "", 0, fn, 0);
+		if(is_analyze) flushEmit(&out), print_analysis(q1Analysis(q1), fn);
+
+		if(is_timed) {
+			double s;
+			clock_gettime(CLOCK_MONOTONIC, &t1);
+			flushEmit(&out);
+			s = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) * 1e-9;
+			fprintf(stderr, "%s: %lu bytes, %lu lines in %.3f s; %.1f MB/s, "
+				"%.0f lines/s.\n", fn, (unsigned long)input.bytes, line_no, s,
+				s > 0.0 ? input.bytes / s * 1e-6 : 0.0,
+				s > 0.0 ? line_no / s : 0.0);
+			if(memo && !is_nested) {
+				struct MemoCount count;
+				q1MemoCount(q1, &count);
+				print_memo(&count);
+			}
+		}
+
+		/* it's only run if every line was valid */
+		if(is_run) {
+			flushEmit(&out);
+			if(invalid) {
+				fprintf(stderr, "%s: %s: not run; %lu lines not valid.\n",
+					programme, fn, invalid);
+				status = EXIT_FAILURE;
+			} else if(!run(&robot, world_fn, max_ops, is_timed)) {
+				if(errno)
+					{ fn = (char *)world_fn, line_no = 0; error = E_FILE; break; }
+				status = EXIT_FAILURE;
+			}
+		}
 
 	} while(0); /* finally */ {
 
-		if(fp && fclose(fp) && !error) error = E_FILE;
+		if(is_input && !closeInput(&input) && !error) error = E_FILE;
+		q1Free(q1);
+		if(is_robot) freeRobot(&robot);
+		if(is_batch) freeBatch(&batch);
+		if(is_cache && !closeCache(&cache)) fprintf(stderr,
+			"%s: cache %s: %s; not saved.\n", programme, cache_dir,
+			strerror(errno));
+		/* the threads are done, so what they counted can be added up */
+		if(stats && isStats()) printStats(stderr, stats == 2);
+		freeStats();
 
 	} /* catch */ if(error) {
 
+		/* a file that failed is a result in the structured formats */
+		const char *const why = error == E_LINE ? "not followed by new line."
+			: strerror(errno);
 		char msg[64];
-		snprintf(msg, sizeof msg, "%s line %u", fn, line_no);
+		snprintf(msg, sizeof msg, "%s line %lu", fn ? fn : programme, line_no);
 		switch(error) {
 			case E_SYNTAX:  usage(); break;
-			case E_FILE:	perror(msg); break;
-			case E_LINE:	fprintf(stderr, "%s: too long or not followed by new line.\n", msg); break;
+			case E_FILE:
+			case E_LINE:
+			case E_RESOURCE:
+				if(is_emit && fn) emitFailure(&out, fn, line_no, why);
+				else fprintf(stderr, "%s: %s\n", msg, why);
+				break;
 			case E_NO:		break; /* won't get here */
 		}
-		return EXIT_FAILURE;
+		status = is_batch ? X_FAILED : EXIT_FAILURE;
 
 	}
 
-	return EXIT_SUCCESS;
+	if(is_emit && !endEmit(&out)) {
+		perror(programme);
+		status = is_batch ? X_FAILED : EXIT_FAILURE;
+	}
+	return status;
 }
 
 /* private */
 
+/** Checks the lines of a block, which all end in new lines, except possibly
+ the last, in slices, printing the diagnostics, and adding them to cache if
+ it's not null. line_no is advanced by the number of lines.
+ @return	Success, otherwise errno is set. */
+static int check_block(struct Q1 *const q1, const char *const block,
+	const size_t size, unsigned long *const line_no, const char *const fn,
+	struct Cache *const cache) {
+	const char *slice, *slice_end, *nl;
+	const char *const end = block + size;
+
+	for(slice = block; slice < end; slice = slice_end) {
+		if((size_t)(end - slice) <= slice_size || !(nl = memchr(slice
+			+ slice_size, '\n', end - slice - slice_size))) slice_end = end;
+		else slice_end = nl + 1;
+
+		/* check for syntax; q1CheckBuffer checks if each line is a valid
+		 expression, including all the commands and expressions; Expression
+		 (line) != expression (token) */
+		if(!q1CheckBuffer(q1, slice, slice_end - slice)) return 0;
+		print_diagnostics(q1, slice, *line_no, fn, cache);
+		*line_no += q1LinesChecked(q1);
+	}
+	return -1;
+}
+
+/** Prints the diagnostics of the last check of q1, of the lines at base
+ after line_no, and adds them to cache if it's not null. */
+static void print_diagnostics(const struct Q1 *const q1,
+	const char *const base, const unsigned long line_no, const char *const fn,
+	struct Cache *const cache) {
+	const struct Q1Diagnostic *d;
+	size_t d_size, i;
+
+	for(d = q1Diagnostics(q1, &d_size), i = 0; i < d_size; i++, d++) {
+		if(debug) fprintf(stderr, "LINE %lu: %.*s", line_no + d->line,
+			(int)d->length, base + d->offset);
+		print_error(fn, line_no + d->line, base + d->offset, d->length,
+			d->column, q1Message(q1, d), q1Expected(q1, d),
+			q1Suggestion(q1, d));
+		if(cache) addCache(cache, line_no + d->line, d->column,
+			base + d->offset, d->length, q1Message(q1, d),
+			q1Expected(q1, d), q1Suggestion(q1, d));
+	}
+}
+
+/** Prints the syntax error message at column for line, which includes the new
+ line, in the format that was asked for; if line is null, fn failed at line_no
+ for the reason in message. */
+static void print_error(const char *const fn, const unsigned long line_no,
+	const char *const line, const size_t line_len, const long column,
+	const char *const message, const char *const expected,
+	const char *const suggestion) {
+	if(!line) { emitFailure(&out, fn, line_no, message); return; }
+	invalid++;
+	emitDiagnostic(&out, fn, line_no, line, line_len, column, message,
+		expected, suggestion);
+}
+
+/** Prints what the memos did, for -t. */
+static void print_memo(const struct MemoCount *const count) {
+	const unsigned long looked = count->hits + count->misses;
+	fprintf(stderr, "%s: memo: %lu hits, %lu misses, %.1f%% hit; %lu "
+		"collisions, %lu evictions.\n", programme, count->hits, count->misses,
+		looked ? 100.0 * count->hits / looked : 0.0, count->collisions,
+		count->evictions);
+}
+
+/** Prints what the lines of fn cost to run, and the ones that cost the most,
+ for --analyze. */
+static void print_analysis(const struct Analysis *const a,
+	const char *const fn) {
+	const double total = costDouble(&a->commands);
+	char commands[40], steps[40];
+	size_t i;
+
+	fprintf(stderr, "%s: %s: %lu lines run %s commands, %s of them steps",
+		programme, fn, a->lines, costString(commands, &a->commands),
+		costString(steps, &a->steps));
+	if(a->unbounded) fprintf(stderr, "; the %lu lines with WHILE are "
+		"counted once through", a->unbounded);
+	fputs(".\n", stderr);
+	if(!a->top_size) return;
+	fprintf(stderr, "%s: %s: the lines that run the most commands:\n",
+		programme, fn);
+	for(i = 0; i < a->top_size; i++) {
+		const struct AnalysisLine *const t = a->top + i;
+		fprintf(stderr, "%s:%lu: %s commands, %.1f%%, %s steps%s: %s\n", fn,
+			t->line, costString(commands, &t->cost.commands),
+			100.0 * costDouble(&t->cost.commands) / total,
+			costString(steps, &t->cost.steps),
+			t->cost.is_unbounded ? ", each time through" : "", t->text);
+	}
+}
+
+/** Runs robot on the map in world_fn, or an empty one if it's null, until
+ it ends or has executed max_ops. What it says goes to standard output, or
+ standard error if that is for the diagnostics in another format, and where
+ it ended up goes to standard error.
+ @return	True if it ran to the end; false if it was stopped, or the world
+			couldn't be read and errno is set. */
+static int run(const struct Robot *const robot, const char *const world_fn,
+	const unsigned long long max_ops, const int is_timed) {
+	static const char *const headings[] = { "north", "east", "south",
+		"west" };
+	struct Input input;
+	struct World world;
+	const char *map = 0;
+	size_t map_size = 0;
+	struct timespec t0, t1;
+	int is_input = 0, is_world = 0, is_done = 0;
+
+	errno = 0;
+	/* try */ do {
+		if(world_fn) {
+			if(!openInput(&input, world_fn)) break;
+			is_input = -1;
+			if(!(map = readBlock(&input, &map_size)) && input.is_error) break;
+			if(!map) map = "", map_size = 0;
+		}
+		if(!initWorld(&world, map, map_size)) break;
+		is_world = -1;
+		if(is_input) { is_input = 0; if(!closeInput(&input)) break; }
+		clock_gettime(CLOCK_MONOTONIC, &t0);
+		is_done = runRobot(robot, &world,
+			out.format == EMIT_TEXT ? stdout : stderr, max_ops);
+		clock_gettime(CLOCK_MONOTONIC, &t1);
+		fprintf(stderr, "%s: %s after %llu ops (and %llu folded); the robot is "
+			"at %u, %u facing %s, with the lamp %s, carrying %lu.\n",
+			programme, is_done ? "ended" : "stopped",
+			(unsigned long long)world.ops, (unsigned long long)world.folded,
+			world.x, world.y, headings[world.heading],
+			world.is_lamp ? "on" : "off", world.carried);
+		if(is_timed) {
+			const double s = (t1.tv_sec - t0.tv_sec)
+				+ (t1.tv_nsec - t0.tv_nsec) * 1e-9;
+			fprintf(stderr, "%s: ran in %.3f s; %.1f M ops/s executed.\n",
+				programme, s, s > 0.0 ? world.ops / s * 1e-6 : 0.0);
+		}
+		errno = 0;
+	} while(0); /* finally */ {
+		if(is_world) freeWorld(&world);
+		if(is_input) closeInput(&input);
+	}
+	return is_done;
+}
+
 /** Prints command-line help. */
 static void usage(void) {
-	fprintf(stderr, "Usage: %s <filename>\n", programme);
+	fprintf(stderr, "Usage: %s [-t] [-j <threads>] [-r] [--files-from <list>] "
+		"[--cache <dir>]\n\t[--format=text|jsonl|sarif] [--run [--world <map>] "
+		"[--max-ops <n>]]\n\t[--nested] [--memo <size>] [--analyze] "
+		"[--stats[=text|json]] <filename> ...\n"
+		"       %s [-t] --lsp\n"
+		"       %s [-t] [--format=text|jsonl|sarif] --watch <path> ...\n",
+		programme, programme, programme);
+	fprintf(stderr, "Reads standard input if <filename> or <list> is -.\n");
+	fprintf(stderr, " -t\tprints the time taken and the throughput.\n");
+	fprintf(stderr, " -j\tchecks on <threads> threads; 0 is one per "
+		"processor.\n");
+	fprintf(stderr, " -r\tchecks every file under directories.\n");
+	fprintf(stderr, " --files-from\talso checks the files in <list>, one per "
+		"line.\n");
+	fprintf(stderr, " --format\twrites the diagnostics as text, JSON Lines, or "
+		"SARIF.\n");
+	fprintf(stderr, " --cache\tremembers the results in <dir>, by the "
+		"contents of the files.\n");
+	fprintf(stderr, " --run\truns the robot if every line of the one file is "
+		"valid.\n");
+	fprintf(stderr, " --world\tstarts it in the grid drawn in <map>: . empty, "
+		"* marker,\n\t1-9 items, and ^ > v < the robot.\n");
+	fprintf(stderr, " --max-ops\tstops it after <n> ops; the default is %llu."
+		"\n", run_max);
+	fprintf(stderr, " --nested\tchecks the dialect where REPEAT and WHILE "
+		"blocks nest and go\n\tover lines; not with --cache or --run.\n");
+	fprintf(stderr, " --memo\tremembers the lines that have been checked, in "
+		"up to <size> bytes\n\t(with K, M, or G) on each thread, for scripts "
+		"that repeat them.\n");
+	fprintf(stderr, " --analyze\tadds up the commands and steps that the "
+		"lines of one file run,\n\tand which run the most, and a REPEAT of "
+		"zero or too many times is not\n\tvalid; not with --nested or "
+		"--cache.\n");
+	fprintf(stderr, " --watch\tchecks the files under the <path>s, then, when "
+		"one is saved, only\n\tthe lines that changed, and prints the "
+		"diagnostics that appeared or\n\twere fixed, until it's interrupted; "
+		"on Linux.\n");
+	fprintf(stderr, " --lsp\tserves the language server protocol on standard "
+		"input and output;\n\t-t prints the time that each change took.\n");
+	fprintf(stderr, " --stats\tprints what the checker did and the time "
+		"each phase took; it\n\tneeds a build with make STATS=1.\n");
+	fprintf(stderr, "With more than one file, the exit status is %d if all "
+		"are valid, %d if any\nline is not, and %d if any file failed.\n",
+		X_VALID, X_INVALID, X_FAILED);
 	fprintf(stderr, "Version %d.%d.\n\n", versionMajor, versionMinor);
 	fprintf(stderr, "%s %s Neil Edelman\n\n", programme, year);
 }
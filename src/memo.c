@@ -0,0 +1,246 @@
+/* Remembers what {@see checkLine} said about lines, so a script that repeats
+ the same lines over and over only checks each once. A line is looked up by a
+ hash of its bytes in a table of buckets of four ways, and what's in the way
+ is compared with the whole line, so lines that have the same hash are just
+ checked again. The lines and what was found, the message, column, expected,
+ and suggestion if it's not valid, are copied one after the other into a ring
+ of bytes; the ring is the memory limit, and the oldest lines are forgotten
+ to make room for new ones, first in, first out, except that a line that's
+ found when it's almost at the end of the ring is copied to the front, so the
+ lines that keep coming up stay. A bucket that's full forgets the way that is
+ oldest. The ways have the position of their line in all that has gone
+ through the ring, so one that's been passed is just not there any more,
+ and the tail doesn't have to look in the table.
+
+ Only {@see checkLine} is remembered; in the nested dialect, what a line is
+ depends on the lines before it.
+
+ @author	Neil
+ @version	1; 2016-03
+ @since		1; 2016-03 */
+
+#include <stdlib.h>		/* malloc calloc free */
+#include <string.h>		/* memcpy memcmp strlen */
+#include "syntax.h"		/* checkLine struct Error */
+#include "hash.h"		/* hash64 */
+#include "memo.h"
+
+/* constants */
+static const uint64_t memo_seed = 0x6d656d6f71310000u;
+static const size_t memo_min    = 1 << 12; /* below this, it's not worth it */
+static const size_t line_ratio  = 16; /* longer lines than ring / this aren't
+	remembered; they'd push out too many others */
+
+/* a line that's been checked in the ring */
+struct MemoWay {
+	uint64_t hash;
+	uint64_t at; /* one past its position, or 0 */
+};
+
+#define BUCKET_WAYS 4
+
+/* a line in the ring, followed by its bytes and, if it's not valid, by the
+ message, expected, and suggestion, without nulls; padded to a multiple of
+ eight. One that's a skip is where the ring was too close to the end, and
+ one that's gone is not in the table any more */
+struct MemoEntry {
+	uint32_t size, length;
+	int32_t index;
+	unsigned char kind, error, expected, suggestion;
+};
+
+enum { ENTRY_VALID, ENTRY_INVALID, ENTRY_SKIP, ENTRY_GONE };
+
+/* private prototypes */
+static void recall(struct Error *const e,
+	const struct MemoEntry *const entry);
+static void insert(struct Memo *const memo, struct MemoWay *way,
+	const uint64_t hash, const char *const line, const size_t length,
+	const int is_valid, const struct Error *const e);
+static struct MemoEntry *entry_at(const struct Memo *const memo,
+	const struct MemoWay *const way);
+static void reserve(struct Memo *const memo, const size_t size);
+
+/* public */
+
+/** Initialises memo to remember nothing, {@see sizeMemo}. */
+void initMemo(struct Memo *const memo) {
+	memo->ways     = 0;
+	memo->buckets  = 0;
+	memo->ring     = 0;
+	memo->capacity = 0;
+	memo->head     = memo->tail = 0;
+	memo->count.hits = memo->count.misses = memo->count.collisions
+		= memo->count.evictions = 0;
+}
+
+/** Forgets everything in memo and gives it up to bytes of memory; the ring
+ and the table are each the largest power of two in half of it. Less than a
+ few KiB, like 0, is nothing, and then it just checks. The counts go on.
+ @return	Success; otherwise errno is set and it remembers nothing. */
+int sizeMemo(struct Memo *const memo, const size_t bytes) {
+	const size_t bucket = BUCKET_WAYS * sizeof *memo->ways;
+	size_t capacity, buckets;
+
+	free(memo->ways), memo->ways = 0;
+	free(memo->ring), memo->ring = 0;
+	memo->buckets  = 0;
+	memo->capacity = 0;
+	memo->head     = memo->tail = 0;
+	if(bytes < memo_min) return -1;
+	for(capacity = memo_min >> 1; capacity <= bytes >> 2; capacity <<= 1);
+	buckets = capacity / bucket;
+	if(!(memo->ways = calloc(buckets * BUCKET_WAYS, sizeof *memo->ways))
+		|| !(memo->ring = malloc(capacity))) {
+		free(memo->ways), memo->ways = 0;
+		return 0;
+	}
+	memo->buckets  = buckets;
+	memo->capacity = capacity;
+	return -1;
+}
+
+/** Frees the memory of memo and initialises it. */
+void freeMemo(struct Memo *const memo) {
+	free(memo->ways);
+	free(memo->ring);
+	initMemo(memo);
+}
+
+/** The same as {@see checkLine}, but if line has been seen before by memo,
+ what was found then. */
+int checkMemo(struct Memo *const memo, struct Error *const e,
+	const char *const line, const size_t length) {
+	struct MemoWay *bucket, *way, *replace = 0;
+	struct MemoEntry *entry;
+	uint64_t hash;
+	int is_valid;
+
+	if(!memo->ring) return checkLine(e, line, length);
+	if(length > memo->capacity / line_ratio) {
+		memo->count.misses++;
+		return checkLine(e, line, length);
+	}
+	hash = hash64(line, length, memo_seed);
+	bucket = memo->ways + (hash & (memo->buckets - 1)) * BUCKET_WAYS;
+	for(way = bucket; way < bucket + BUCKET_WAYS; way++) {
+		if(way->hash != hash || !(entry = entry_at(memo, way))) continue;
+		if(entry->length != length || memcmp(entry + 1, line, length)) {
+			memo->count.collisions++;
+			replace = way;
+			continue;
+		}
+		memo->count.hits++;
+		if(!(is_valid = entry->kind == ENTRY_VALID)) recall(e, entry);
+		/* it's about to be forgotten, but it's still coming up */
+		if(memo->head - (way->at - 1) > memo->capacity - memo->capacity / 4)
+			insert(memo, way, hash, line, length, is_valid, e);
+		return is_valid;
+	}
+	memo->count.misses++;
+	is_valid = checkLine(e, line, length);
+	insert(memo, replace, hash, line, length, is_valid, e);
+	return is_valid;
+}
+
+/* private */
+
+/** Copies what was found about entry to e. */
+static void recall(struct Error *const e,
+	const struct MemoEntry *const entry) {
+	const char *s = (const char *)(entry + 1) + entry->length;
+
+	e->index = entry->index;
+	memcpy(e->error, s, entry->error), s += entry->error;
+	e->error[entry->error] = '\0';
+	memcpy(e->expected, s, entry->expected), s += entry->expected;
+	e->expected[entry->expected] = '\0';
+	memcpy(e->suggestion, s, entry->suggestion);
+	e->suggestion[entry->suggestion] = '\0';
+}
+
+/** Remembers line at the front of the ring and in way, if it's not null, in
+ the place of what was there, or else in a way of its bucket. */
+static void insert(struct Memo *const memo, struct MemoWay *way,
+	const uint64_t hash, const char *const line, const size_t length,
+	const int is_valid, const struct Error *const e) {
+	const size_t m = is_valid ? 0 : strlen(e->error),
+		x = is_valid ? 0 : strlen(e->expected),
+		s = is_valid ? 0 : strlen(e->suggestion),
+		size = (sizeof(struct MemoEntry) + length + m + x + s + 7)
+		& ~(size_t)7,
+		left = memo->capacity - (memo->head & (memo->capacity - 1));
+	struct MemoEntry *entry;
+	char *a;
+
+	if(way && (entry = entry_at(memo, way))) entry->kind = ENTRY_GONE;
+
+	/* an entry is in one piece */
+	if(left < size) {
+		reserve(memo, left);
+		if(left >= sizeof *entry) {
+			entry = (struct MemoEntry *)(memo->ring + memo->capacity - left);
+			entry->size = (uint32_t)left;
+			entry->kind = ENTRY_SKIP;
+		}
+		memo->head += left;
+	}
+	reserve(memo, size);
+	entry = (struct MemoEntry *)(memo->ring
+		+ (memo->head & (memo->capacity - 1)));
+	entry->size       = (uint32_t)size;
+	entry->length     = (uint32_t)length;
+	entry->index      = is_valid ? 0 : e->index;
+	entry->kind       = is_valid ? ENTRY_VALID : ENTRY_INVALID;
+	entry->error      = (unsigned char)m;
+	entry->expected   = (unsigned char)x;
+	entry->suggestion = (unsigned char)s;
+	a = (char *)(entry + 1);
+	memcpy(a, line, length), a += length;
+	if(!is_valid) {
+		memcpy(a, e->error, m), a += m;
+		memcpy(a, e->expected, x), a += x;
+		memcpy(a, e->suggestion, s);
+	}
+
+	/* an empty way, or else the one with the line that's been there longest */
+	if(!way) {
+		struct MemoWay *const bucket
+			= memo->ways + (hash & (memo->buckets - 1)) * BUCKET_WAYS;
+		struct MemoWay *w;
+		for(w = bucket; w < bucket + BUCKET_WAYS; w++) {
+			if(!entry_at(memo, w)) { way = w; break; }
+			if(!way || w->at < way->at) way = w;
+		}
+		if(w == bucket + BUCKET_WAYS) {
+			entry_at(memo, way)->kind = ENTRY_GONE;
+			memo->count.evictions++;
+		}
+	}
+	way->hash = hash;
+	way->at   = memo->head + 1;
+	memo->head += size;
+}
+
+/** @return	The line in way, or null if it's empty or has been passed. */
+static struct MemoEntry *entry_at(const struct Memo *const memo,
+	const struct MemoWay *const way) {
+	if(!way->at || way->at - 1 < memo->tail) return 0;
+	return (struct MemoEntry *)(memo->ring
+		+ ((way->at - 1) & (memo->capacity - 1)));
+}
+
+/** Forgets the oldest lines in the ring until there is size bytes after the
+ head. */
+static void reserve(struct Memo *const memo, const size_t size) {
+	while(memo->head + size - memo->tail > memo->capacity) {
+		const size_t left
+			= memo->capacity - (memo->tail & (memo->capacity - 1));
+		const struct MemoEntry *const entry = (const struct MemoEntry *)
+			(memo->ring + memo->capacity - left);
+		if(left < sizeof *entry) { memo->tail += left; continue; }
+		if(entry->kind == ENTRY_VALID || entry->kind == ENTRY_INVALID)
+			memo->count.evictions++;
+		memo->tail += entry->size;
+	}
+}
@@ -0,0 +1,28 @@
+#include <stddef.h> /* size_t */
+#include <stdint.h> /* uint64_t */
+
+struct Error;
+
+/* what a memo has done: a line that's looked up is a hit or a miss; a line
+ that has the hash of another that's remembered is also a collision; and a
+ line that had to be forgotten to make room is an eviction */
+struct MemoCount {
+	unsigned long hits, misses, collisions, evictions;
+};
+
+/* the lines that have been checked and what was found, in a fixed amount of
+ memory, {@see checkMemo} */
+struct Memo {
+	struct MemoWay *ways;
+	size_t buckets;
+	unsigned char *ring;
+	size_t capacity;
+	uint64_t head, tail; /* in all that has gone through the ring */
+	struct MemoCount count;
+};
+
+void initMemo(struct Memo *const memo);
+int sizeMemo(struct Memo *const memo, const size_t bytes);
+void freeMemo(struct Memo *const memo);
+int checkMemo(struct Memo *const memo, struct Error *const e,
+	const char *const line, const size_t length);
@@ -0,0 +1,244 @@
+/* Every line is independent, so a block of lines can be split at new lines
+ into chunks and checked on many threads with {@see checkLine}. The reports are
+ kept with the chunk until all the chunks before it have been reported, so they
+ come out in exactly the order that checking serially would give. Chunks are
+ claimed in order and at most a window of them is outstanding, so the memory
+ used is bounded no matter the size of the block. Each thread can have a
+ {@see Memo} of its own, and has an {@see Arena} for the lines that aren't
+ valid, so they don't share anything while checking.
+
+ @author	Neil
+ @version	1; 2016-03
+ @since		1; 2016-03 */
+
+#define _POSIX_C_SOURCE 200809L /* pthreads */
+
+#include <stdlib.h>		/* malloc realloc free */
+#include <string.h>		/* memchr */
+#include <errno.h>		/* errno */
+#include <pthread.h>	/* pthread_* */
+#include "syntax.h"		/* checkLine, struct Error */
+#include "memo.h"		/* checkMemo */
+#include "arena.h"		/* struct Arena initArena freeArena */
+#include "parallel.h"
+
+/* constants */
+static const size_t chunk_size          = 1 << 20;
+static const unsigned chunks_per_thread = 4;
+
+/* a line that's not valid, copied out of the chunk's checking */
+struct Report {
+	unsigned long line_no; /* in the chunk, starting at one */
+	const char *line;
+	size_t length;
+	struct Error error;
+};
+
+struct Chunk {
+	const char *begin, *end;
+	unsigned long lines;
+	struct Report *reports;
+	size_t reports_size, reports_capacity;
+	int is_done, is_error;
+};
+
+struct Parallel {
+	pthread_mutex_t lock;
+	pthread_cond_t claimable, done;
+	const char *pos, *end;
+	unsigned long claimed, reported;
+	struct Chunk *chunks;
+	size_t chunks_size;
+};
+
+/* a thread and what it remembers */
+struct Worker {
+	struct Parallel *p;
+	struct Memo *memo;
+	struct Arena arena;
+	pthread_t thread;
+};
+
+/* private prototypes */
+static void *work(void *const param);
+static struct Chunk *claim_chunk(struct Parallel *const p);
+static void check_chunk(struct Chunk *const c, struct Memo *const memo,
+	struct Arena *const arena);
+
+/* public */
+
+/** Checks [block, block + size) on threads, calling report for every line
+ that's not valid in the order of the lines. Lines end in new lines, except
+ possibly the last. line_no is the number of lines before the block and is
+ advanced by the number of lines in it. If memos is not null, it's an array
+ of threads, one for each.
+ @return	True on success; otherwise errno is set and not all the block was
+			reported. */
+int checkParallel(const char *const block, const size_t size,
+	const unsigned threads, struct Memo *const memos,
+	unsigned long *const line_no, const LineReport report, void *const param) {
+	struct Parallel p;
+	struct Worker *worker = 0;
+	unsigned started = 0, t;
+	unsigned long k;
+	size_t i;
+	int is_ok = 0, e = 0;
+
+	p.pos         = block;
+	p.end         = block + size;
+	p.claimed     = p.reported = 0;
+	p.chunks_size = threads * chunks_per_thread;
+	if(!(p.chunks = calloc(p.chunks_size, sizeof *p.chunks))) return 0;
+	if(!(worker = malloc(threads * sizeof *worker))) {
+		free(p.chunks);
+		return 0;
+	}
+	pthread_mutex_init(&p.lock, 0);
+	pthread_cond_init(&p.claimable, 0);
+	pthread_cond_init(&p.done, 0);
+
+	/* try */ do {
+
+		for(t = 0; t < threads; t++) {
+			worker[t].p    = &p;
+			worker[t].memo = memos ? memos + t : 0;
+			if((e = pthread_create(&worker[t].thread, 0, &work, worker + t)))
+				break;
+			started++;
+		}
+		if(!started) break;
+		e = 0;
+
+		/* report the chunks in order as they're done */
+		for(k = 0; ; k++) {
+			struct Chunk *const c = p.chunks + k % p.chunks_size;
+			int is_end;
+			pthread_mutex_lock(&p.lock);
+			while(!(is_end = k >= p.claimed && p.pos >= p.end)
+				&& !(k < p.claimed && c->is_done)) {
+				pthread_cond_wait(&p.done, &p.lock);
+			}
+			pthread_mutex_unlock(&p.lock);
+			if(is_end) break;
+			if(c->is_error) { e = ENOMEM; break; }
+			for(i = 0; i < c->reports_size; i++) {
+				const struct Report *const r = c->reports + i;
+				report(param, *line_no + r->line_no, r->line, r->length,
+					&r->error);
+			}
+			*line_no += c->lines;
+			pthread_mutex_lock(&p.lock);
+			p.reported++;
+			pthread_cond_broadcast(&p.claimable);
+			pthread_mutex_unlock(&p.lock);
+		}
+		if(e) break;
+		is_ok = -1;
+
+	} while(0); /* finally */ {
+
+		/* on error, the workers stop when they can't claim any more */
+		pthread_mutex_lock(&p.lock);
+		if(!is_ok) p.pos = p.end;
+		pthread_cond_broadcast(&p.claimable);
+		pthread_mutex_unlock(&p.lock);
+		for(t = 0; t < started; t++) pthread_join(worker[t].thread, 0);
+		for(i = 0; i < p.chunks_size; i++) free(p.chunks[i].reports);
+		free(p.chunks);
+		free(worker);
+		pthread_cond_destroy(&p.done);
+		pthread_cond_destroy(&p.claimable);
+		pthread_mutex_destroy(&p.lock);
+
+	} /* catch */ if(!is_ok) {
+
+		errno = e ? e : EAGAIN;
+		return 0;
+
+	}
+
+	return -1;
+}
+
+/* private */
+
+/** The thread function. */
+static void *work(void *const param) {
+	struct Worker *const w = param;
+	struct Parallel *const p = w->p;
+	struct Chunk *c;
+
+	initArena(&w->arena);
+	while((c = claim_chunk(p))) {
+		check_chunk(c, w->memo, &w->arena);
+		pthread_mutex_lock(&p->lock);
+		c->is_done = -1;
+		pthread_cond_broadcast(&p->done);
+		pthread_mutex_unlock(&p->lock);
+	}
+	freeArena(&w->arena);
+	return 0;
+}
+
+/** Takes the next chunk of lines, waiting if the window is full.
+ @return	The chunk or null if there are no more. */
+static struct Chunk *claim_chunk(struct Parallel *const p) {
+	struct Chunk *c = 0;
+	const char *nl;
+
+	pthread_mutex_lock(&p->lock);
+	while(p->pos < p->end && p->claimed >= p->reported + p->chunks_size) {
+		pthread_cond_wait(&p->claimable, &p->lock);
+	}
+	if(p->pos < p->end) {
+		c = p->chunks + p->claimed % p->chunks_size;
+		c->begin = p->pos;
+		if((size_t)(p->end - p->pos) <= chunk_size || !(nl = memchr(p->pos
+			+ chunk_size, '\n', p->end - p->pos - chunk_size))) {
+			c->end = p->end;
+		} else {
+			c->end = nl + 1;
+		}
+		c->lines        = 0;
+		c->reports_size = 0;
+		c->is_done      = 0;
+		c->is_error     = 0;
+		p->pos = c->end;
+		p->claimed++;
+	}
+	pthread_mutex_unlock(&p->lock);
+	return c;
+}
+
+/** Checks all the lines in c, with memo if it's not null and arena for
+ scratch, keeping a report for each that's not valid. */
+static void check_chunk(struct Chunk *const c, struct Memo *const memo,
+	struct Arena *const arena) {
+	const char *line, *eol;
+	struct Error e;
+	struct Report *r;
+
+	e.arena = arena;
+	for(line = c->begin; line < c->end; line = eol) {
+		c->lines++;
+		eol = memchr(line, '\n', c->end - line);
+		eol = eol ? eol + 1 : c->end;
+		if(memo ? checkMemo(memo, &e, line, eol - line)
+			: checkLine(&e, line, eol - line)) continue;
+		if(c->reports_size >= c->reports_capacity) {
+			const size_t cap = c->reports_capacity
+				? c->reports_capacity << 1 : 64;
+			if(!(r = realloc(c->reports, cap * sizeof *r))) {
+				c->is_error = -1;
+				return;
+			}
+			c->reports          = r;
+			c->reports_capacity = cap;
+		}
+		r = c->reports + c->reports_size++;
+		r->line_no = c->lines;
+		r->line    = line;
+		r->length  = eol - line;
+		r->error   = e;
+	}
+}
@@ -0,0 +1,13 @@
+#include <stddef.h> /* size_t */
+
+struct Error;
+struct Memo;
+
+/* called with each line that's not valid, in order */
+typedef void (*LineReport)(void *const param, const unsigned long line_no,
+	const char *const line, const size_t length,
+	const struct Error *const error);
+
+int checkParallel(const char *const block, const size_t size,
+	const unsigned threads, struct Memo *const memos,
+	unsigned long *const line_no, const LineReport report, void *const param);
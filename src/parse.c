@@ -8,11 +8,15 @@
  @version	1; 2016-03
  @since		1; 2016-03 */
 
-#include <string.h>	/* strncpy strlen strpbrk etc */
-#include <ctype.h>	/* is* */
-#include <stdio.h>	/* snprintf */
+#include <string.h>	/* strlen memcpy memchr etc */
+#include <stdio.h>	/* snprintf vsnprintf */
+#include <stdarg.h>	/* va_* */
+#include <ctype.h>	/* isxdigit */
 #include "syntax.h"	/* including syntax (error) */
 #include "parse.h"	/* including delimiters, quote */
+#include "utf8.h"	/* utf8Valid utf8Encode */
+#include "stats.h"	/* STATS_* */
+#include "arena.h"	/* struct Arena arenaAlloc resetArena */
 
 /* global definition; means ",repeat 2,times turnon turnon TURNON,,,end ,,"
  will be accepted as valid, but I think it should; 'end' and ',' play duplicate
@@ -23,12 +27,36 @@ const char quote = '\"';
 
 /* static data */
 static const char *last_init;
-static char buffer[1024], *buf_pos = buffer, *upcoming_token;
-static const int buffer_size = sizeof buffer / sizeof(char);
+static char empty[1];
+static char *buffer = empty; /* a copy of the line in buffer_arena */
+static struct Arena buffer_arena; /* static, so it's initialised */
+static struct Scan scan;
+static char *upcoming_token;
+
+/* count trailing zeros */
+#ifdef __GNUC__
+#define ctz(x) ((unsigned)__builtin_ctz(x))
+#else
+static unsigned ctz(uint32_t x) {
+	unsigned n = 0;
+	while(!(x & 1)) x >>= 1, n++;
+	return n;
+}
+#endif
 
 /* private prototypes */
-static char *next_token(void);
-static int is_first_whitespace(const char *const str);
+static char *next_buffer_token(void);
+static const char *next_token(struct Scan *const s, size_t *const length);
+static int is_first_whitespace(const struct Scan *const s);
+static const char *find_class(struct Scan *const s, const char *a,
+	const enum Class class, const int is_in);
+static void classify_window(struct Scan *const s, const char *const a);
+static void scan_error(struct Scan *const s, const char *const at,
+	const char *const format, ...);
+static enum StringError closed_string(const char *const a,
+	const char *const b, const char **const at);
+static size_t escape_length(const char *const a, const char *const end);
+static int hex4(const char *const a, unsigned long *const x);
 
 /* public */
 
@@ -37,18 +65,28 @@ static int is_first_whitespace(const char *const str);
  <p>
  While parsing, inputLine must be held constant. */
 void initBuffer(const char *const inputLine) {
+	size_t length;
 
-	buffer[0]      = '\0';
-	buf_pos        = buffer;
+	buffer         = empty;
 	upcoming_token = 0;
+	initScan(&scan, &syntax, buffer, 0);
 
 	if(!(last_init = inputLine)) return;
 
-	/* fixme: if inputLine is too long, it will truncate it and not warn you */
-	strncpy(buffer, inputLine, buffer_size);
-	buffer[buffer_size - 1] = '\0';
+	/* the tokens are null-terminated in the copy; it's as long as the line */
+	length = strlen(inputLine);
+	resetArena(&buffer_arena);
+	if(!(buffer = arenaAlloc(&buffer_arena, length + 1, 1))) {
+		buffer = empty;
+		snprintf(syntax.error, sizeof syntax.error, "no memory for the line");
+		syntax.index = -1;
+		syntax.expected[0] = syntax.suggestion[0] = '\0';
+		return;
+	}
+	memcpy(buffer, inputLine, length + 1);
 
-	upcoming_token = next_token();
+	initScan(&scan, &syntax, buffer, length);
+	upcoming_token = next_buffer_token();
 
 	syntax.index = -1;
 
@@ -67,7 +105,7 @@ int hasNextToken(void) {
 char *nextToken(void) {
 	char *const token = upcoming_token;
 	syntax.index = token - buffer;
-	upcoming_token = next_token();
+	upcoming_token = next_buffer_token();
 	return token;
 }
 
@@ -78,54 +116,253 @@ void vybrewind(void) {
 	initBuffer(last_init);
 }
 
+/** Starts tokenising line, which is length bytes and is neither copied nor
+ modified; it must be held constant while scanning. Unlike initBuffer, it
+ only touches scan and error, so it's reentrant. */
+void initScan(struct Scan *const scan, struct Error *const error,
+	const char *const line, const size_t length) {
+	scan->begin       = scan->pos = line;
+	scan->end         = line + length;
+	scan->error       = error;
+	scan->bad         = 0;
+	scan->classify    = classifyFunction();
+	scan->window      = line;
+	scan->window_size = 0;
+}
+
+/** Returns the next token in scan and puts its length in length, or null if
+ there are no more tokens or the tokens can't be read any further, in which
+ case it sets scan->error and scan->bad. */
+const char *nextScan(struct Scan *const scan, size_t *const length) {
+	const char *tok;
+	STATS_DECLARE(t);
+
+	STATS_START(t);
+	tok = next_token(scan, length);
+	STATS_STOP(PHASE_TOKEN, t);
+	return tok;
+}
+
+/** Checks the string that starts with the quote at a, before end. It ends at
+ the first quote that isn't escaped; the escapes are \", \\, \n, and
+ \u with four hex digits of any code point but null and the surrogates; and
+ the rest of it is UTF-8, {@see utf8Valid}. A quote is found with memchr,
+ and then the backslashes before it, so a message with no escapes is two
+ calls; the UTF-8 is checked a window at a time after, so a long message is
+ not looked at a byte at a time.
+ @return	STRING_VALID, and the closing quote in at, or else what's wrong,
+			and at is where: the opening quote, the backslash, or the
+			start of the first character that isn't UTF-8. */
+enum StringError scanString(const char *const a, const char *const end,
+	const char **const at) {
+	const char *from = a + 1, *q, *b;
+	size_t n;
+
+	for( ; ; ) {
+		if(!(q = memchr(from, quote, (size_t)(end - from))))
+			{ *at = a; return STRING_OPEN; }
+		while((b = memchr(from, '\\', (size_t)(q - from)))) {
+			if(!(n = escape_length(b, end)))
+				{ *at = b; return STRING_ESCAPE; }
+			from = b + n;
+			if(from > q) break; /* the quote was escaped */
+		}
+		if(from <= q) return closed_string(a, q, at);
+	}
+}
+
+/** Copies the inside of a string, a, length, that {@see scanString} says is
+ valid, to s with the escapes replaced by what they stand for; s must have
+ room for length bytes, which is at least as many.
+ @return	The number of bytes in s. */
+size_t unescapeString(char *const s, const char *const a, const size_t length) {
+	const char *from = a, *const end = a + length, *b;
+	unsigned long c;
+	size_t n = 0;
+
+	while((b = memchr(from, '\\', (size_t)(end - from)))) {
+		memcpy(s + n, from, (size_t)(b - from)), n += (size_t)(b - from);
+		switch(b[1]) {
+		case 'n': s[n++] = '\n'; from = b + 2; break;
+		case 'u': hex4(b + 2, &c), n += utf8Encode(s + n, c); from = b + 6;
+			break;
+		default: s[n++] = b[1]; from = b + 2; break;
+		}
+	}
+	memcpy(s + n, from, (size_t)(end - from));
+	return n + (size_t)(end - from);
+}
+
 /* private */
 
-static char *next_token(void) {
-	char *tok_start;
+/** Takes the next token from the private buffer and null-terminates it; the
+ terminator goes on the delimiter that the scan has already passed. */
+static char *next_buffer_token(void) {
+	const char *tok;
+	size_t len;
+
+	if(!(tok = next_token(&scan, &len))) return 0;
+	buffer[tok - buffer + len] = '\0';
+	return buffer + (tok - buffer);
+}
+
+static const char *next_token(struct Scan *const s, size_t *const length) {
+	const char *tok_start;
 
 	/* advance the pointer to the first non-delimeter word */
-	while(*buf_pos && strchr(delimiters, *buf_pos)) buf_pos++;
-	tok_start = buf_pos;
+	s->pos = tok_start = find_class(s, s->pos, C_DELIMITER, 0);
 
 	/* check special cases */
-	if(!*buf_pos) { /* end-of-string */
+	if(s->pos >= s->end) { /* end-of-string */
 		return 0;
-	} else if(*buf_pos == quote) { /* double-quotes */
-		char quote_str[2];
-		buf_pos++;
-		/* seach for the closing quotes; fixme: escape \" */
-		quote_str[0] = quote;
-		quote_str[1] = '\0';
-		if(!(buf_pos = strpbrk(buf_pos, quote_str))) {
-			snprintf(syntax.error, sizeof syntax.error,
-				"unmatched quotes");
-			buf_pos = buffer + strlen(buffer);
+	} else if(*s->pos == quote) { /* double-quotes */
+		const char *at, *to;
+		switch(scanString(s->pos, s->end, &at)) {
+		case STRING_VALID: break;
+		case STRING_OPEN:
+			for(to = s->end; to > at && (to[-1] == '\n' || to[-1] == '\r');
+				to--);
+			scan_error(s, at, "[%.*s%s] has no closing quote.",
+				to - at > 16 ? 16 : (int)(to - at), at,
+				to - at > 16 ? "..." : "");
+			return 0;
+		case STRING_ESCAPE:
+			/* the backslash, the next, and the hex digits after a u */
+			for(to = at + 2; at[1] == 'u' && to < s->end && to < at + 6
+				&& isxdigit((unsigned char)*to); to++);
+			scan_error(s, at, "[%.*s] is not an escape; they are \\\", "
+				"\\\\, \\n, and \\u and four hex digits.",
+				(int)(to - at), at);
+			return 0;
+		case STRING_UTF8:
+			scan_error(s, at, "[<message>] is not UTF-8 from byte 0x%02X.",
+				(unsigned char)*at);
 			return 0;
 		}
-		buf_pos++;
+		s->pos = at + 1;
 		/* ending is not followed by a whitespace? */
-		if(!is_first_whitespace(buf_pos)) {
-			snprintf(syntax.error, sizeof syntax.error,
-				"closing quotes not followed by whitespace");
-			buf_pos = strpbrk(buf_pos, delimiters);
+		if(!is_first_whitespace(s)) {
+			s->pos = find_class(s, s->pos, C_DELIMITER, -1);
+			scan_error(s, tok_start, "[%.*s%s] is not followed by a delimiter.",
+				s->pos - tok_start > 16 ? 16 : (int)(s->pos - tok_start),
+				tok_start, s->pos - tok_start > 16 ? "..." : "");
 			return 0;
 		}
-	} else if(isdigit(*buf_pos)) { /* numerical */
-		while(isdigit(*(++buf_pos)));
-		if(!is_first_whitespace(buf_pos)) {
-			snprintf(syntax.error, sizeof syntax.error,
-				"non-numeric value in number");
-			buf_pos = strpbrk(buf_pos, delimiters);
+	} else if(classes[(unsigned char)*s->pos] & (1 << C_DIGIT)) { /* num */
+		s->pos = find_class(s, s->pos + 1, C_DIGIT, 0);
+		if(!is_first_whitespace(s)) {
+			s->pos = find_class(s, s->pos, C_DELIMITER, -1);
+			scan_error(s, tok_start, "[%.*s%s] is not a number.",
+				s->pos - tok_start > 16 ? 16 : (int)(s->pos - tok_start),
+				tok_start, s->pos - tok_start > 16 ? "..." : "");
 			return 0;
 		}
 	}
 
 	/* search for the next delimeter */
-	if((buf_pos = strpbrk(buf_pos, delimiters))) *(buf_pos++) = '\0';
+	s->pos  = find_class(s, s->pos, C_DELIMITER, -1);
+	*length = s->pos - tok_start;
+	if(s->pos < s->end) s->pos++;
 
 	return tok_start;
 }
 
-static int is_first_whitespace(const char *const str) {
-	return !*str || strchr(delimiters, *str) ? -1 : 0;
+static int is_first_whitespace(const struct Scan *const s) {
+	return s->pos >= s->end
+		|| classes[(unsigned char)*s->pos] & (1 << C_DELIMITER) ? -1 : 0;
+}
+
+/** A window of characters is classified at once and the masks are kept in s
+ for the next call, so most tokens don't need to classify anything.
+ @return The first character in [a, end) that is in class, if is_in, or isn't,
+ if not, or end. */
+static const char *find_class(struct Scan *const s, const char *a,
+	const enum Class class, const int is_in) {
+	uint32_t m;
+
+	while(a < s->end) {
+		if(a < s->window || (size_t)(a - s->window) >= s->window_size)
+			classify_window(s, a);
+		m = is_in ? s->masks.mask[class] : ~s->masks.mask[class];
+		if((m >>= a - s->window)) {
+			a += ctz(m);
+			return a < s->end ? a : s->end;
+		}
+		a = s->window + s->window_size;
+	}
+	return s->end;
+}
+
+/** Classifies the window starting at a; if it's the end of the line, the
+ window is padded with null, which is a delimiter. */
+static void classify_window(struct Scan *const s, const char *const a) {
+	const size_t left = s->end - a;
+
+	if(left >= classify_size) {
+		s->classify(a, &s->masks);
+		s->window_size = classify_size;
+	} else {
+		char pad[classify_size] = { 0 };
+		memcpy(pad, a, left);
+		s->classify(pad, &s->masks);
+		s->window_size = left;
+	}
+	s->window = a;
+}
+
+/** Sets the error of s, at at, from format, and stops it. */
+static void scan_error(struct Scan *const s, const char *const at,
+	const char *const format, ...) {
+	va_list args;
+
+	va_start(args, format);
+	vsnprintf(s->error->error, sizeof s->error->error, format, args);
+	va_end(args);
+	s->error->suggestion[0] = '\0';
+	s->bad = at;
+}
+
+/** The string from the quote at a to the one at b, which closes it, has
+ valid escapes; checks that it's UTF-8, {@see scanString}. */
+static enum StringError closed_string(const char *const a,
+	const char *const b, const char **const at) {
+	const size_t length = (size_t)(b - a - 1), n = utf8Valid(a + 1, length);
+
+	if(n < length) { *at = a + 1 + n; return STRING_UTF8; }
+	*at = b;
+	return STRING_VALID;
+}
+
+/** @return	The length of the escape at the backslash a, before end, or zero
+			if it's not one, {@see scanString}. */
+static size_t escape_length(const char *const a, const char *const end) {
+	unsigned long c;
+
+	if(end - a < 2) return 0;
+	switch(a[1]) {
+	case '\"': case '\\': case 'n': return 2;
+	case 'u':
+		if(end - a < 6 || !hex4(a + 2, &c) || !c
+			|| (c >= 0xd800 && c < 0xe000)) return 0;
+		return 6;
+	default: return 0;
+	}
+}
+
+/** Reads the four hex digits at a into x.
+ @return	Success. */
+static int hex4(const char *const a, unsigned long *const x) {
+	unsigned i;
+
+	*x = 0;
+	for(i = 0; i < 4; i++) {
+		const char c = a[i];
+		unsigned d;
+		if(c >= '0' && c <= '9') d = (unsigned)(c - '0');
+		else if(c >= 'a' && c <= 'f') d = (unsigned)(c - 'a' + 10);
+		else if(c >= 'A' && c <= 'F') d = (unsigned)(c - 'A' + 10);
+		else return 0;
+		*x = *x << 4 | d;
+	}
+	return -1;
 }
@@ -1,7 +1,37 @@
+#include <stddef.h> /* size_t */
+#include "classify.h" /* struct Classes, Classify */
+
 extern const char *const delimiters;
 extern const char quote;
 
+struct Error;
+
+/* tokeniser state over a line that is not copied or modified; the line is
+ [begin, end) and need not be null-terminated; errors go to error, so
+ different scans can be used at the same time, and bad is where the line
+ couldn't be tokenised, or null; the characters in
+ [window, window + window_size) are classified in masks */
+struct Scan {
+	const char *begin, *pos, *end;
+	struct Error *error;
+	const char *bad;
+	Classify classify;
+	const char *window;
+	size_t window_size;
+	struct Classes masks;
+};
+
 void initBuffer(const char *const inputLine);
 int hasNextToken(void);
 char *nextToken(void);
 void vybrewind(void);
+
+/* what's wrong with a string, {@see scanString} */
+enum StringError { STRING_VALID, STRING_OPEN, STRING_ESCAPE, STRING_UTF8 };
+
+void initScan(struct Scan *const scan, struct Error *const error,
+	const char *const line, const size_t length);
+const char *nextScan(struct Scan *const scan, size_t *const length);
+enum StringError scanString(const char *const a, const char *const end,
+	const char **const at);
+size_t unescapeString(char *const s, const char *const a, const size_t length);
@@ -0,0 +1,441 @@
+/* The back end: lines that are valid are compiled into a bytecode, which runs
+ on a robot in a grid. The bytecode is 32-bit words, where the low byte is
+ the instruction; the jumps of loops are in the rest of the word, and SAY,
+ REPEAT, and ROBOT_MOVE have an index into strings or repeats in the next
+ word. There's always a ROBOT_HALT after the end, so the interpreter doesn't
+ check where it is. The grammar doesn't nest, so there is only ever one
+ REPEAT counter.
+ <p>
+ A REPEAT whose body only moves, turns, and switches the lamp is folded: if
+ it ends up facing the same way, it's one ROBOT_MOVE of the steps times the
+ count; if not, it comes back to the same place every two or four times, so
+ only the remainder is run. The interpreter is threaded, with a computed goto
+ per instruction where the compiler has that, and a switch otherwise.
+
+ @author	Neil
+ @version	1; 2016-03
+ @since		1; 2016-03 */
+
+#include <stdlib.h> /* malloc realloc free */
+#include <string.h> /* memcpy memchr */
+#include <errno.h>  /* errno */
+#include "syntax.h" /* compileLine, struct Error */
+#include "parse.h"  /* unescapeString */
+#include "arena.h"  /* struct Arena initArena freeArena */
+#include "robot.h"
+
+/* the grid when there's no map */
+static const unsigned world_default = 64;
+
+/* private prototypes */
+static void emit(struct Robot *const robot, const uint32_t word);
+static uint32_t add_repeat(struct Robot *const robot,
+	const struct RobotRepeat *const repeat);
+static void end_repeat(struct Robot *const robot);
+static uint64_t multiply(const uint64_t a, const uint64_t b);
+static unsigned wrap(const int d, const unsigned size);
+
+/* public */
+
+/** Empties robot. */
+void initRobot(struct Robot *const robot) {
+	robot->code         = 0;
+	robot->code_size    = robot->code_capacity = 0;
+	robot->repeats      = 0;
+	robot->repeats_size = robot->repeats_capacity = 0;
+	robot->strings      = 0;
+	robot->strings_size = robot->strings_capacity = 0;
+	robot->count        = 0;
+	robot->loop         = 0;
+	robot->is_loop      = 0;
+	robot->is_error     = 0;
+}
+
+/** Frees what robot holds and empties it. */
+void freeRobot(struct Robot *const robot) {
+	free(robot->code);
+	free(robot->repeats);
+	free(robot->strings);
+	initRobot(robot);
+}
+
+/** Appends one of the commands, ROBOT_STEP to ROBOT_OFF. */
+void robotCommand(struct Robot *const robot, const enum RobotOp op) {
+	emit(robot, op);
+}
+
+/** Starts a REPEAT of count; the commands up to {@see robotEnd} are the
+ body. */
+void robotRepeat(struct Robot *const robot, const uint64_t count) {
+	robot->count   = count;
+	robot->loop    = robot->code_size;
+	robot->is_loop = -1;
+	emit(robot, ROBOT_REPEAT);
+	emit(robot, 0);
+}
+
+/** Starts a WHILE NOT DETECTMARKER; the commands up to {@see robotEnd} are
+ the body. */
+void robotWhile(struct Robot *const robot) {
+	robot->loop    = robot->code_size;
+	robot->is_loop = -1;
+	emit(robot, ROBOT_WHILE);
+}
+
+/** Ends the body of a REPEAT or WHILE. */
+void robotEnd(struct Robot *const robot) {
+	if(robot->is_error || !robot->is_loop) return;
+	robot->is_loop = 0;
+	if((robot->code[robot->loop] & 255) == ROBOT_REPEAT) {
+		end_repeat(robot);
+	} else {
+		const size_t body = robot->code_size - robot->loop;
+		emit(robot, ROBOT_AGAIN | (uint32_t)body << 8);
+		if(robot->is_error) return;
+		robot->code[robot->loop] |= (uint32_t)(body + 1) << 8;
+	}
+}
+
+/** Appends a SAY of message, which is length, the inside of a string with the
+ escapes still in it, {@see unescapeString}. */
+void robotSay(struct Robot *const robot, const char *const message,
+	const size_t length) {
+	size_t size = length + 2; /* new line and null; escapes only shrink */
+
+	if(robot->is_error) return;
+	if(robot->strings_size + size > UINT32_MAX)
+		{ errno = EFBIG; robot->is_error = -1; return; }
+	while(robot->strings_size + size > robot->strings_capacity) {
+		const size_t c = robot->strings_capacity
+			? robot->strings_capacity << 1 : 4096;
+		char *const strings = realloc(robot->strings, c);
+		if(!strings) { robot->is_error = -1; return; }
+		robot->strings          = strings;
+		robot->strings_capacity = c;
+	}
+	emit(robot, ROBOT_SAY);
+	emit(robot, (uint32_t)robot->strings_size);
+	size = unescapeString(robot->strings + robot->strings_size, message,
+		length);
+	robot->strings[robot->strings_size + size]     = '\n';
+	robot->strings[robot->strings_size + size + 1] = '\0';
+	robot->strings_size += size + 2;
+}
+
+/** Compiles every valid line in [buffer, buffer + size) onto the end of
+ robot; lines that are not valid are left out. Lines end in new lines,
+ except possibly the last.
+ @return	Success; otherwise errno is set. */
+int compileRobot(struct Robot *const robot, const char *const buffer,
+	const size_t size) {
+	const char *line, *eol;
+	const char *const end = buffer + size;
+	struct Error e;
+	struct Arena arena;
+
+	initArena(&arena);
+	e.arena = &arena;
+	for(line = buffer; line < end && !robot->is_error; line = eol) {
+		eol = memchr(line, '\n', end - line);
+		eol = eol ? eol + 1 : end;
+		compileLine(&e, robot, line, eol - line);
+	}
+	freeArena(&arena);
+	return !robot->is_error;
+}
+
+/** Sets up world from the map, which is size; each line is a row of cells,
+ '.' or ' ' for nothing, '*' for a marker, '1' to '9' for that many items, and
+ '^', '>', 'v', or '<' for where the robot starts and which way it's facing.
+ If map is null, it's an empty grid with the robot in the middle facing
+ north.
+ @return	Success; otherwise errno is set. */
+int initWorld(struct World *const world, const char *const map,
+	const size_t size) {
+	static const char headings[] = "^>v<";
+	const char *a, *const end = map + size, *h;
+	unsigned x = 0, y = 0;
+
+	world->width = world->height = 0;
+	world->cells   = 0;
+	world->x = world->y = world->heading = 0;
+	world->is_lamp = 0;
+	world->carried = 0;
+	world->ops     = world->folded = 0;
+	if(!map) {
+		world->width = world->height = world_default;
+		world->x = world->y = world_default / 2;
+	} else {
+		for(a = map; a < end; a++) {
+			if(*a == '\n') { if(x) y++; x = 0; continue; }
+			if(*a == '\r') continue;
+			if(++x > world->width) world->width = x;
+		}
+		world->height = x ? y + 1 : y;
+	}
+	if(!world->width || !world->height
+		|| world->width > 65536 || world->height > 65536)
+		{ errno = EINVAL; return 0; }
+	if(!(world->cells = calloc((size_t)world->width * world->height, 1)))
+		return 0;
+	if(!map) return -1;
+	for(a = map, x = y = 0; a < end; a++) {
+		unsigned char *cell;
+		if(*a == '\n') { if(x) y++; x = 0; continue; }
+		if(*a == '\r') continue;
+		cell = world->cells + (size_t)y * world->width + x;
+		if(*a == '*') {
+			*cell = WORLD_MARKER;
+		} else if(*a >= '1' && *a <= '9') {
+			*cell = (unsigned char)(*a - '0');
+		} else if(*a && (h = strchr(headings, *a))) {
+			world->x = x, world->y = y;
+			world->heading = (unsigned)(h - headings);
+		} else if(*a != '.' && *a != ' ') {
+			freeWorld(world);
+			errno = EINVAL;
+			return 0;
+		}
+		x++;
+	}
+	return -1;
+}
+
+/** Frees the grid of world. */
+void freeWorld(struct World *const world) {
+	free(world->cells);
+	world->cells = 0;
+}
+
+/** Runs robot in world, from where it is, writing what it says to say. It
+ stops when it's executed max_ops robot ops, counting the tests of WHILE,
+ which is only checked when a loop goes around again.
+ @return	True if it got to the end, false if it was stopped. */
+int runRobot(const struct Robot *const robot, struct World *const world,
+	FILE *const say, const uint64_t max_ops) {
+	const uint32_t *pc = robot->code;
+	const unsigned width = world->width, height = world->height;
+	/* the step of each heading, with wrapping around by subtracting */
+	const unsigned step_x[4] = { 0, 1, 0, width - 1 },
+		step_y[4] = { height - 1, 0, 1, 0 };
+	unsigned char *const cells = world->cells;
+	unsigned x = world->x, y = world->y, heading = world->heading;
+	uint64_t ops = world->ops, folded = world->folded, counter = 0;
+	unsigned long carried = world->carried;
+	int is_lamp = world->is_lamp, is_done = -1;
+
+	/* the instructions, one label each; it's the only place with goto */
+#if defined(__GNUC__) && !defined(ROBOT_SWITCH)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpedantic"
+	static const void *const dispatch[ROBOT_OP_NO] = { &&halt, &&step, &&left,
+		&&right, &&pickup, &&drop, &&on, &&off, &&say, &&repeat, &&next,
+		&&move, &&loop, &&again };
+#define NEXT goto *dispatch[*pc & 255]
+#else
+#define NEXT goto dispatch
+#endif
+
+	NEXT;
+#if !defined(__GNUC__) || defined(ROBOT_SWITCH)
+dispatch:
+	switch(*pc & 255) {
+	case ROBOT_HALT:   goto halt;
+	case ROBOT_STEP:   goto step;
+	case ROBOT_LEFT:   goto left;
+	case ROBOT_RIGHT:  goto right;
+	case ROBOT_PICKUP: goto pickup;
+	case ROBOT_DROP:   goto drop;
+	case ROBOT_ON:     goto on;
+	case ROBOT_OFF:    goto off;
+	case ROBOT_SAY:    goto say;
+	case ROBOT_REPEAT: goto repeat;
+	case ROBOT_NEXT:   goto next;
+	case ROBOT_MOVE:   goto move;
+	case ROBOT_WHILE:  goto loop;
+	case ROBOT_AGAIN:  goto again;
+	default:           goto halt;
+	}
+#endif
+step:
+	x += step_x[heading], x -= x >= width ? width : 0;
+	y += step_y[heading], y -= y >= height ? height : 0;
+	ops++, pc++;
+	NEXT;
+left:
+	heading = (heading + 3) & 3;
+	ops++, pc++;
+	NEXT;
+right:
+	heading = (heading + 1) & 3;
+	ops++, pc++;
+	NEXT;
+pickup: {
+		unsigned char *const cell = cells + (size_t)y * width + x;
+		if(*cell & ~WORLD_MARKER) (*cell)--, carried++;
+	}
+	ops++, pc++;
+	NEXT;
+drop: {
+		unsigned char *const cell = cells + (size_t)y * width + x;
+		if(carried && (*cell & ~WORLD_MARKER) != 0x7f) (*cell)++, carried--;
+	}
+	ops++, pc++;
+	NEXT;
+on:
+	is_lamp = -1;
+	ops++, pc++;
+	NEXT;
+off:
+	is_lamp = 0;
+	ops++, pc++;
+	NEXT;
+say:
+	fputs(robot->strings + pc[1], say);
+	ops++, pc += 2;
+	NEXT;
+repeat: {
+		const struct RobotRepeat *const r = robot->repeats + pc[1];
+		counter = r->count;
+		folded += r->folded;
+	}
+	pc += 2;
+	NEXT;
+next:
+	if(--counter) {
+		if(ops >= max_ops) { is_done = 0; goto stop; }
+		pc -= *pc >> 8;
+	} else {
+		pc++;
+	}
+	NEXT;
+move: {
+		const struct RobotRepeat *const r = robot->repeats + pc[1];
+		const unsigned right_heading = (heading + 1) & 3;
+		/* the steps each time in the grid; step_* is -1 modulo the size */
+		const int dx = r->forward * ((int)(heading == 1) - (int)(heading == 3))
+			+ r->right * ((int)(right_heading == 1) - (int)(right_heading == 3)),
+			dy = r->forward * ((int)(heading == 2) - (int)(heading == 0))
+			+ r->right * ((int)(right_heading == 2) - (int)(right_heading == 0));
+		x = (unsigned)((x + r->count % width * wrap(dx, width)) % width);
+		y = (unsigned)((y + r->count % height * wrap(dy, height)) % height);
+		if(r->lamp) is_lamp = r->lamp == ROBOT_ON ? -1 : 0;
+		folded += r->folded;
+	}
+	pc += 2;
+	NEXT;
+loop:
+	ops++;
+	if(cells[(size_t)y * width + x] & WORLD_MARKER) pc += *pc >> 8;
+	else pc++;
+	NEXT;
+again:
+	if(ops >= max_ops) { is_done = 0; goto stop; }
+	pc -= *pc >> 8;
+	NEXT;
+halt:
+stop:
+#undef NEXT
+#if defined(__GNUC__) && !defined(ROBOT_SWITCH)
+#pragma GCC diagnostic pop
+#endif
+	world->x = x, world->y = y, world->heading = heading;
+	world->ops = ops, world->folded = folded;
+	world->carried = carried;
+	world->is_lamp = is_lamp;
+	return is_done;
+}
+
+/* private */
+
+/** Appends word to the code of robot. */
+static void emit(struct Robot *const robot, const uint32_t word) {
+	if(robot->is_error) return;
+	if(robot->code_size + 1 >= robot->code_capacity) {
+		const size_t c = robot->code_capacity ? robot->code_capacity << 1 : 1024;
+		uint32_t *const code = realloc(robot->code, c * sizeof *code);
+		if(!code) { robot->is_error = -1; return; }
+		robot->code          = code;
+		robot->code_capacity = c;
+	}
+	robot->code[robot->code_size++] = word;
+	robot->code[robot->code_size]   = ROBOT_HALT;
+}
+
+/** Appends repeat to the repeats of robot.
+ @return	Its index. */
+static uint32_t add_repeat(struct Robot *const robot,
+	const struct RobotRepeat *const repeat) {
+	if(robot->is_error) return 0;
+	if(robot->repeats_size >= UINT32_MAX)
+		{ errno = EFBIG; robot->is_error = -1; return 0; }
+	if(robot->repeats_size >= robot->repeats_capacity) {
+		const size_t c = robot->repeats_capacity
+			? robot->repeats_capacity << 1 : 64;
+		struct RobotRepeat *const r = realloc(robot->repeats, c * sizeof *r);
+		if(!r) { robot->is_error = -1; return 0; }
+		robot->repeats          = r;
+		robot->repeats_capacity = c;
+	}
+	robot->repeats[robot->repeats_size] = *repeat;
+	return (uint32_t)robot->repeats_size++;
+}
+
+/** The body of the REPEAT at robot->loop has been compiled; it's run through
+ once, facing north at the origin, to see if it can be folded. */
+static void end_repeat(struct Robot *const robot) {
+	const uint32_t *const body = robot->code + robot->loop + 2;
+	const size_t body_size = robot->code_size - robot->loop - 2;
+	struct RobotRepeat r = { 0, 0, 0, 0, 0 };
+	unsigned heading = 0, period;
+	int is_items = 0;
+	size_t i;
+
+	if(!robot->count || !body_size) {
+		robot->code_size = robot->loop;
+		robot->code[robot->code_size] = ROBOT_HALT;
+		return;
+	}
+	for(i = 0; i < body_size; i++) {
+		switch(body[i]) {
+		case ROBOT_STEP:
+			r.forward += heading == 0 ? 1 : heading == 2 ? -1 : 0;
+			r.right   += heading == 1 ? 1 : heading == 3 ? -1 : 0;
+			break;
+		case ROBOT_LEFT:  heading = (heading + 3) & 3; break;
+		case ROBOT_RIGHT: heading = (heading + 1) & 3; break;
+		case ROBOT_ON:
+		case ROBOT_OFF:   r.lamp = (unsigned char)body[i]; break;
+		default:          is_items = -1; break;
+		}
+	}
+	period = heading == 0 ? 1 : heading == 2 ? 2 : 4;
+	if(!is_items && robot->count % period == 0) {
+		/* it faces the same way as it started */
+		r.count  = robot->count / period;
+		r.folded = multiply(robot->count, body_size);
+		if(period != 1) r.forward = r.right = 0;
+		robot->code[robot->loop]     = ROBOT_MOVE;
+		robot->code[robot->loop + 1] = add_repeat(robot, &r);
+		robot->code_size = robot->loop + 2;
+		robot->code[robot->code_size] = ROBOT_HALT;
+	} else {
+		/* period times comes back to the same place */
+		r.count  = is_items ? robot->count : robot->count % period;
+		r.folded = multiply(robot->count - r.count, body_size);
+		r.forward = r.right = r.lamp = 0;
+		robot->code[robot->loop + 1] = add_repeat(robot, &r);
+		emit(robot, ROBOT_NEXT | (uint32_t)body_size << 8);
+	}
+}
+
+/** @return	a times b, or the most there can be if it's more. */
+static uint64_t multiply(const uint64_t a, const uint64_t b) {
+	return b && a > UINT64_MAX / b ? UINT64_MAX : a * b;
+}
+
+/** @return	d modulo size, from zero to size. */
+static unsigned wrap(const int d, const unsigned size) {
+	const long m = (long)d % (long)size;
+	return (unsigned)(m < 0 ? m + (long)size : m);
+}
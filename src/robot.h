@@ -0,0 +1,57 @@
+#include <stddef.h> /* size_t */
+#include <stdint.h> /* uint32_t uint64_t */
+#include <stdio.h>  /* FILE */
+
+/* the instructions; the low byte of a word is the instruction and the rest is
+ a jump, or the word after is an index, {@see robot.c} */
+enum RobotOp { ROBOT_HALT, ROBOT_STEP, ROBOT_LEFT, ROBOT_RIGHT, ROBOT_PICKUP,
+	ROBOT_DROP, ROBOT_ON, ROBOT_OFF, ROBOT_SAY, ROBOT_REPEAT, ROBOT_NEXT,
+	ROBOT_MOVE, ROBOT_WHILE, ROBOT_AGAIN, ROBOT_OP_NO };
+
+/* the count of a REPEAT, and what it does at once if it's folded */
+struct RobotRepeat {
+	uint64_t count, folded; /* folded is the ops that are not executed */
+	int forward, right;     /* the steps of a ROBOT_MOVE, each time */
+	unsigned char lamp;     /* after ROBOT_MOVE: 0, ROBOT_ON, or ROBOT_OFF */
+};
+
+/* the valid lines of a script, compiled in order */
+struct Robot {
+	uint32_t *code;
+	size_t code_size, code_capacity;
+	struct RobotRepeat *repeats;
+	size_t repeats_size, repeats_capacity;
+	char *strings; /* the messages of SAY, with new lines */
+	size_t strings_size, strings_capacity;
+	uint64_t count; /* of the REPEAT being compiled */
+	size_t loop;    /* where the REPEAT or WHILE being compiled starts */
+	int is_loop, is_error;
+};
+
+/* the grid the robot is in; it wraps around at the edges */
+struct World {
+	unsigned width, height;
+	unsigned char *cells; /* the number of items, and WORLD_MARKER */
+	unsigned x, y, heading; /* heading is north, east, south, west */
+	int is_lamp;
+	unsigned long carried;
+	uint64_t ops, folded; /* executed and done at once */
+};
+
+#define WORLD_MARKER 0x80
+
+void initRobot(struct Robot *const robot);
+void freeRobot(struct Robot *const robot);
+void robotCommand(struct Robot *const robot, const enum RobotOp op);
+void robotRepeat(struct Robot *const robot, const uint64_t count);
+void robotWhile(struct Robot *const robot);
+void robotEnd(struct Robot *const robot);
+void robotSay(struct Robot *const robot, const char *const message,
+	const size_t length);
+int compileRobot(struct Robot *const robot, const char *const buffer,
+	const size_t size);
+int initWorld(struct World *const world, const char *const map,
+	const size_t size);
+void freeWorld(struct World *const world);
+int runRobot(const struct Robot *const robot, struct World *const world,
+	FILE *const say, const uint64_t max_ops);
@@ -0,0 +1,226 @@
+/* Counters of what the checker does and how long it takes, {@see stats.h};
+ the functions are always here, but the hot paths only call them when built
+ with Q1_STATS. Each thread gets a struct Stats the first time it counts
+ something, so threads don't share cache lines or locks while checking; they
+ are kept in a list until they're added up.
+
+ @author	Neil
+ @version	1; 2016-03
+ @since		1; 2016-03 */
+
+#define _POSIX_C_SOURCE 200809L /* clock_gettime */
+
+#include <stdlib.h>  /* calloc free */
+#include <time.h>    /* clock_gettime */
+#include <pthread.h> /* pthread_mutex_* */
+#include <sys/resource.h> /* getrusage */
+#include "syntax.h"  /* tokenName */
+#include "stats.h"
+
+#ifndef STATS_UNIT
+#define STATS_UNIT "ns"
+#endif
+
+/* the names of the counters in the report */
+static const char *const phase_names[PHASE_NO] = { "read", "accept",
+	"next_token", "match_token", "group", "match_expression", "repair",
+	"format" };
+static const char *const form_names[FORM_NO] = { "blank", "command",
+	"repeat", "while", "say", "invalid" };
+static const char *const error_names[ERROR_NO] = { "token", "expression",
+	"failure" };
+
+/* every thread's counters */
+#ifdef __GNUC__
+__thread struct Stats *stats_thread;
+#else
+struct Stats *stats_thread;
+#endif
+static struct Stats *stats_list;
+static pthread_mutex_t stats_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* private prototypes */
+static void sum(struct Stats *const total);
+static unsigned long max_rss(void);
+static void print_histogram(FILE *const fp, const char *const name,
+	const uint64_t *const buckets, const int is_json);
+
+/* public */
+
+/** @return	Whether the hot paths were compiled with the counters. */
+int isStats(void) {
+#ifdef Q1_STATS
+	return -1;
+#else
+	return 0;
+#endif
+}
+
+/** Makes the counters of the thread that calls it; if they can't be
+ allocated, it's counted in a static struct that is shared.
+ @return	The counters. */
+struct Stats *statsThread(void) {
+	static struct Stats shared;
+	struct Stats *s = calloc(1, sizeof *s);
+
+	if(!s) return stats_thread = &shared;
+	pthread_mutex_lock(&stats_lock);
+	s->next    = stats_list;
+	stats_list = s;
+	pthread_mutex_unlock(&stats_lock);
+	return stats_thread = s;
+}
+
+/** @return	A clock in nanoseconds, where there is no cycle counter. */
+uint64_t statsClock(void) {
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return (uint64_t)t.tv_sec * 1000000000u + (uint64_t)t.tv_nsec;
+}
+
+/** @return	The histogram bucket of n: 0 for 0, otherwise b for
+			[2^(b - 1), 2^b). */
+unsigned statsBucket(const uint64_t n) {
+#ifdef __GNUC__
+	return n ? 64u - (unsigned)__builtin_clzll(n) : 0;
+#else
+	unsigned b = 0;
+	uint64_t m = n;
+	while(m) m >>= 1, b++;
+	return b;
+#endif
+}
+
+/** Writes what all the threads counted to fp, as text or as one JSON
+ object. */
+void printStats(FILE *const fp, const int is_json) {
+	struct Stats total;
+	uint64_t all = 0;
+	unsigned i;
+
+	sum(&total);
+	for(i = 0; i < PHASE_NO; i++) all += total.cycles[i];
+	if(is_json) {
+		fprintf(fp, "{\"unit\":\"%s\",\"phases\":{", STATS_UNIT);
+		for(i = 0; i < PHASE_NO; i++) fprintf(fp,
+			"%s\"%s\":{\"calls\":%llu,\"cycles\":%llu}", i ? "," : "",
+			phase_names[i], (unsigned long long)total.calls[i],
+			(unsigned long long)total.cycles[i]);
+		fputs("},\"tokens\":{", fp);
+		for(i = 0; i < STATS_TOKENS && tokenName(i); i++) fprintf(fp,
+			"%s\"%s\":%llu", i ? "," : "", tokenName(i),
+			(unsigned long long)total.tokens[i]);
+		fputs("},\"forms\":{", fp);
+		for(i = 0; i < FORM_NO; i++) fprintf(fp, "%s\"%s\":%llu",
+			i ? "," : "", form_names[i], (unsigned long long)total.forms[i]);
+		fputs("},\"errors\":{", fp);
+		for(i = 0; i < ERROR_NO; i++) fprintf(fp, "%s\"%s\":%llu",
+			i ? "," : "", error_names[i], (unsigned long long)total.errors[i]);
+		fputs("},", fp);
+		print_histogram(fp, "line_bytes", total.line_bytes, -1);
+		fputc(',', fp);
+		print_histogram(fp, "line_tokens", total.line_tokens, -1);
+		fprintf(fp, ",\"memory\":{\"arena_blocks\":%llu,\"arena_peak\":%llu,"
+			"\"max_rss_kib\":%lu}}\n", (unsigned long long)total.arena_blocks,
+			(unsigned long long)total.arena_peak, max_rss());
+		return;
+	}
+	fprintf(fp, "%-18s %14s %18s %12s %7s\n", "phase", "calls", STATS_UNIT,
+		"per call", "share");
+	for(i = 0; i < PHASE_NO; i++) fprintf(fp, "%-18s %14llu %18llu %12.1f "
+		"%6.1f%%\n", phase_names[i], (unsigned long long)total.calls[i],
+		(unsigned long long)total.cycles[i], total.calls[i]
+		? (double)total.cycles[i] / total.calls[i] : 0.0,
+		all ? 100.0 * total.cycles[i] / all : 0.0);
+	fputs("tokens:", fp);
+	for(i = 0; i < STATS_TOKENS && tokenName(i); i++) if(total.tokens[i])
+		fprintf(fp, " %s %llu", tokenName(i),
+		(unsigned long long)total.tokens[i]);
+	fputs("\nlines:", fp);
+	for(i = 0; i < FORM_NO; i++) fprintf(fp, " %s %llu", form_names[i],
+		(unsigned long long)total.forms[i]);
+	fputs("\nerrors:", fp);
+	for(i = 0; i < ERROR_NO; i++) fprintf(fp, " %s %llu", error_names[i],
+		(unsigned long long)total.errors[i]);
+	fputc('\n', fp);
+	print_histogram(fp, "line bytes", total.line_bytes, 0);
+	print_histogram(fp, "tokens per line", total.line_tokens, 0);
+	fprintf(fp, "memory: arena blocks %llu, arena peak %llu bytes on a "
+		"thread, max rss %lu KiB\n", (unsigned long long)total.arena_blocks,
+		(unsigned long long)total.arena_peak, max_rss());
+}
+
+/** Frees the counters of every thread; they must not be counting. */
+void freeStats(void) {
+	struct Stats *s, *next;
+
+	pthread_mutex_lock(&stats_lock);
+	for(s = stats_list; s; s = next) next = s->next, free(s);
+	stats_list   = 0;
+	stats_thread = 0;
+	pthread_mutex_unlock(&stats_lock);
+}
+
+/* private */
+
+/** Adds up the counters of every thread into total. */
+static void sum(struct Stats *const total) {
+	const struct Stats *s;
+	unsigned i;
+
+	for(i = 0; i < PHASE_NO; i++) total->cycles[i] = total->calls[i] = 0;
+	for(i = 0; i < STATS_TOKENS; i++) total->tokens[i] = 0;
+	for(i = 0; i < FORM_NO; i++) total->forms[i] = 0;
+	for(i = 0; i < ERROR_NO; i++) total->errors[i] = 0;
+	for(i = 0; i < STATS_BUCKETS; i++)
+		total->line_bytes[i] = total->line_tokens[i] = 0;
+	total->arena_blocks = total->arena_peak = 0;
+	pthread_mutex_lock(&stats_lock);
+	for(s = stats_list; s; s = s->next) {
+		for(i = 0; i < PHASE_NO; i++) total->cycles[i] += s->cycles[i],
+			total->calls[i] += s->calls[i];
+		for(i = 0; i < STATS_TOKENS; i++) total->tokens[i] += s->tokens[i];
+		for(i = 0; i < FORM_NO; i++) total->forms[i] += s->forms[i];
+		for(i = 0; i < ERROR_NO; i++) total->errors[i] += s->errors[i];
+		for(i = 0; i < STATS_BUCKETS; i++)
+			total->line_bytes[i] += s->line_bytes[i],
+			total->line_tokens[i] += s->line_tokens[i];
+		total->arena_blocks += s->arena_blocks;
+		if(s->arena_peak > total->arena_peak)
+			total->arena_peak = s->arena_peak;
+	}
+	pthread_mutex_unlock(&stats_lock);
+}
+
+/** @return	The most memory the process has had resident, in KiB, or 0 if
+			it's not known. */
+static unsigned long max_rss(void) {
+	struct rusage u;
+
+	if(getrusage(RUSAGE_SELF, &u)) return 0;
+#ifdef __APPLE__
+	return (unsigned long)u.ru_maxrss / 1024; /* it's in bytes there */
+#else
+	return (unsigned long)u.ru_maxrss;
+#endif
+}
+
+/** Writes the buckets that are not empty, with their ranges. */
+static void print_histogram(FILE *const fp, const char *const name,
+	const uint64_t *const buckets, const int is_json) {
+	unsigned b;
+	int is_first = -1;
+
+	fprintf(fp, is_json ? "\"%s\":[" : "%s:", name);
+	for(b = 0; b < STATS_BUCKETS; b++) {
+		const unsigned long long lo = b ? 1ull << (b - 1) : 0,
+			hi = b ? (b < 64 ? (1ull << b) - 1 : ~0ull) : 0;
+		if(!buckets[b]) continue;
+		if(is_json) fprintf(fp, "%s{\"min\":%llu,\"max\":%llu,\"lines\":%llu}",
+			is_first ? "" : ",", lo, hi, (unsigned long long)buckets[b]);
+		else fprintf(fp, " [%llu, %llu] %llu", lo, hi,
+			(unsigned long long)buckets[b]);
+		is_first = 0;
+	}
+	fputs(is_json ? "]" : "\n", fp);
+}
@@ -0,0 +1,76 @@
+#include <stdint.h> /* uint64_t */
+#include <stdio.h>  /* FILE */
+
+/* instrumentation of the hot paths; it's compiled in with -DQ1_STATS (make
+ STATS=1) and is nothing otherwise; every thread counts in its own struct
+ Stats, and they are added up for the report */
+
+/* the phases that are timed; the ones after PHASE_ACCEPT are only for lines
+ that it didn't accept */
+enum StatsPhase { PHASE_READ, PHASE_ACCEPT, PHASE_TOKEN, PHASE_MATCH,
+	PHASE_GROUP, PHASE_EXPRESSION, PHASE_REPAIR, PHASE_FORMAT, PHASE_NO };
+
+/* what a line is, by its first token, or not valid */
+enum StatsForm { FORM_BLANK, FORM_COMMAND, FORM_REPEAT, FORM_WHILE, FORM_SAY,
+	FORM_INVALID, FORM_NO };
+
+/* the classes of message */
+enum StatsError { ERROR_TOKEN, ERROR_EXPRESSION, ERROR_FAILURE, ERROR_NO };
+
+/* at least the number of tokens in grammar.txt, {@see tokenName}, and the
+ powers of two in the histograms */
+#define STATS_TOKENS 64
+#define STATS_BUCKETS 65
+
+struct Stats {
+	uint64_t cycles[PHASE_NO], calls[PHASE_NO];
+	uint64_t tokens[STATS_TOKENS], forms[FORM_NO], errors[ERROR_NO];
+	uint64_t line_bytes[STATS_BUCKETS], line_tokens[STATS_BUCKETS];
+	uint64_t arena_blocks, arena_peak; /* {@see arenaAlloc} */
+	struct Stats *next;
+};
+
+#ifdef Q1_STATS
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <x86intrin.h> /* __rdtsc */
+#define STATS_CLOCK() ((uint64_t)__rdtsc())
+#define STATS_UNIT "tsc"
+#else
+#define STATS_CLOCK() statsClock()
+#define STATS_UNIT "ns"
+#endif
+
+#ifdef __GNUC__
+extern __thread struct Stats *stats_thread;
+#else
+extern struct Stats *stats_thread; /* then only one thread can be counted */
+#endif
+
+#define STATS_THIS (stats_thread ? stats_thread : statsThread())
+#define STATS_ONLY(x) x
+#define STATS_DECLARE(t) uint64_t t
+#define STATS_START(t) ((t) = STATS_CLOCK())
+#define STATS_STOP(phase, t) do { struct Stats *const stats_ = STATS_THIS; \
+	stats_->cycles[phase] += STATS_CLOCK() - (t); stats_->calls[phase]++; \
+	} while(0)
+#define STATS_COUNT(field, i) (STATS_THIS->field[i]++)
+#define STATS_HISTOGRAM(field, n) (STATS_THIS->field[statsBucket(n)]++)
+
+#else
+
+#define STATS_ONLY(x)
+#define STATS_DECLARE(t)
+#define STATS_START(t) ((void)0)
+#define STATS_STOP(phase, t) ((void)0)
+#define STATS_COUNT(field, i) ((void)0)
+#define STATS_HISTOGRAM(field, n) ((void)0)
+
+#endif
+
+int isStats(void);
+struct Stats *statsThread(void);
+uint64_t statsClock(void);
+unsigned statsBucket(const uint64_t n);
+void printStats(FILE *const fp, const int is_json);
+void freeStats(void);
@@ -10,101 +10,104 @@
  @version	1; 2016-03
  @since		1; 2016-03 */
 
-#include <stdlib.h> /* bsearch */
 #include <stdio.h>  /* snprintf */
-#include <string.h>	/* strlen */
+#include <stdlib.h>	/* realloc free */
+#include <string.h>	/* strlen memcpy */
 #include <ctype.h>	/* is* */
+#include <stdint.h>	/* uint64_t */
 #include "syntax.h"	/* including syntax (error) */
 #include "parse.h"	/* including delimiters, quote */
+#include "robot.h"	/* robotCommand robotRepeat robotWhile robotEnd robotSay */
+#include "analyze.h"	/* struct LineCost costProduct */
+#include "arena.h"	/* struct Arena arenaAlloc */
+#include "stats.h"	/* STATS_* */
+#include "keywords.h"	/* generated from grammar.txt: keywords, KEYWORD_* */
+#include "grammar.h"	/* generated from grammar.txt: tokens, transition */
+
+#if TOKEN_NO > STATS_TOKENS
+#error grammar.txt has more tokens than stats.h counts.
+#endif
+#if KEYWORD_MAX > 12
+#error grammar.txt has keywords longer than suggest_token counts.
+#endif
 
 /* should be f'n but we can't modify the prototypes; global definition */
-struct Error syntax = { "no error", -1 };
+struct Error syntax = { "no error", -1, "", "", 0 };
 
 /* static const data */
 
-static const int debug = 0;
-
-/* every token */
-enum Tokens { NOT_TOKEN, TAKEASTEP, LEFT, RIGHT, PICKUP, DROP, TURNON, TURNOFF,
-	REPEAT, TIMES, END, WHILE, NOT, DETECTMARKER, DO, SAY,
-	NUMBER, STRING, COMMAND, COMMANDS };
-
-/* alphabetised and in caps */
-static const struct Token {
-	char *string;
-	int id;
-	char avatar;
-} tokens[] = {
-	{ "",			NUMBER,		'#' },
-	{ "",			STRING,		'a' },
-	{ "",			COMMAND,	'$' },
-	{ "",			COMMANDS,	'%' },
-	{"DETECTMARKER",DETECTMARKER,'d'},
-	{ "DO",			DO,			'D' },
-	{ "DROP",		DROP,		'$' },
-	{ "END",		END,		'E' },
-	{ "LEFT",		LEFT,		'$' },
-	{ "NOT",		NOT,		'!' },
-	{ "PICKUP",		PICKUP,		'$' },
-	{ "REPEAT",		REPEAT,		'R' },
-	{ "RIGHT",		RIGHT,		'$' },
-	{ "SAY",		SAY,		'S' },
-	{ "TAKEASTEP",	TAKEASTEP,	'$' },
-	{ "TIMES",		TIMES,		'T' },
-	{ "TURNOFF",	TURNOFF,	'$' },
-	{ "TURNON",		TURNON,		'$' },
-	{ "WHILE",		WHILE,		'W' }
+/* the least number of symbols between states in insert[] when there's no
+ way; insert[] and the other tables are in grammar.h */
+static const unsigned char none = 255;
+
+/* a keyword is only suggested if it's within an edit distance of a third of
+ its length, at least one, and at most this */
+static const unsigned suggest_max = 3;
+
+/* the symbols of the tokens, with a run of commands followed by END as
+ Y_GROUP, for diagnostics; only the first of them are kept, enough to expand
+ past 64 characters */
+struct Group {
+	unsigned char prefix[32];
+	size_t prefix_size, size, run;
 };
-static const int tokens_size = sizeof tokens / sizeof(struct Token);
-static const struct Token *const tok_number   = tokens + 0;
-static const struct Token *const tok_string   = tokens + 1;
-static const struct Token *const tok_command  = tokens + 2;
-static const struct Token *const tok_commands = tokens + 3;
-
-/* for offering suggestions; this should be tokens, but ordered by avatar;
- the string does not (and cannot, it's not bijective) have to be tokens.string,
- it's just used for printing */
-static const struct Reverse {
-	char avatar;
-	char *string;
-} reverse[] = {
-	{ '!', "NOT" },
-	{ '#', "<number>" },
-	{ '$', "<command>" },
-	{ '%', "<commands-followed-by-END>" },
-	{ 'D', "DO" },
-	{ 'E', "END" },
-	{ 'R', "REPEAT" },
-	{ 'S', "SAY" },
-	{ 'T', "TIMES" },
-	{ 'W', "WHILE" },
-	{ 'a', "<message>" },
-	{ 'd', "DETECTMARKER" }
+
+/* a REPEAT or WHILE whose END hasn't come yet in the nested dialect: where
+ it starts, its first and last symbols, and the state of its body */
+struct NestBlock {
+	unsigned long line;
+	long column;
+	unsigned char first, last, body;
 };
-static const int reverse_size = sizeof reverse / sizeof(struct Reverse);
-
-/* valid syntax expression translated to single-char by tokens[] -- work with
- strings as opposed to int[] because of the library support */
-static const char *avatars[] = {
-	"",		/* blank line should be ignored */
-	"$",	/* COMMAND */
-	"R#T%",	/* REPEAT NUMBER TIMES COMMANDS */
-	"Sa",	/* SAY STRING */
-	"W!dD%"	/* WHILE NOT DETECTMARKER DO COMMANDS */
+
+/* what is done to a token to repair a line */
+enum Edit { EDIT_KEEP, EDIT_INSERT, EDIT_REPLACE, EDIT_DELETE };
+struct Repair {
+	unsigned char edit, symbol;
 };
-static const int avatars_size = sizeof avatars / sizeof(char *);
 
 /* private prototypes */
-static const struct Token *match_token(const char *const string);
-static int token_compare(const void *a, const void *b);
-static const char *match_expression(const char *const avatar);
-static int expression_compare(const void *a, const void *b);
-static char *expand_expression(const char *const avatar);
-static char *reverse_token(const char avatar);
-static int reverse_compare(const void *a, const void *b);
-static const char *suggest_token(const char *const);
-static const char *suggest_expression(const char *const);
-static int tokstrcmp(const char *a, const char *b);
+static int accept_line(const char *const line, const size_t length,
+	struct LineCost *const cost);
+static int diagnose_line(struct Error *const e, const char *const line,
+	const size_t length);
+static const struct Token *match_token(struct Error *const e,
+	const char *const token, const size_t length);
+static const struct Token *match_keyword(const char *const token,
+	const size_t length);
+static const struct Token *find_keyword(uint64_t *const word,
+	const size_t length);
+static size_t load_word(uint64_t *const word, const unsigned char *const a,
+	const unsigned char *const end);
+static void pack_word(uint64_t *const word, const char *const a,
+	const size_t length);
+static void group_push(struct Group *const g, const unsigned symbol);
+static void group_end(struct Group *const g);
+static void group_emit(struct Group *const g, const unsigned symbol,
+	const size_t n);
+static void expression_error(struct Error *const e,
+	const struct Group *const g, const char *const line, const size_t length,
+	const size_t n);
+static size_t repair_edits(struct Repair *const edits,
+	unsigned (*const cost)[S_STATE_NO], const unsigned char *const symbol,
+	const size_t n);
+static int suggest_repair(struct Error *const e, const char *const line,
+	const size_t length, const struct Repair *const edits,
+	const size_t edits_size, const size_t first, const size_t from);
+static int suggest_put(struct Error *const e, size_t *const size,
+	const char *const s, const size_t n);
+static void expect(struct Error *const e, const unsigned state);
+static void expect_symbols(struct Error *const e, const unsigned set,
+	const int is_end);
+static int is_body(const unsigned state);
+static void nest_expect(struct Error *const e, const struct Nest *const nest,
+	const unsigned state);
+static void nest_push(struct Nest *const nest, const long column,
+	const unsigned first, const unsigned last, const unsigned body);
+static char *expand_expression(char *const expand, const size_t expand_size,
+	const struct Group *const g);
+static const char *suggest_token(const char *const, const size_t);
+static unsigned suggest_cutoff(const unsigned length);
 
 /* public */
 
@@ -118,7 +121,8 @@ static int tokstrcmp(const char *a, const char *b);
  not a command. The functionality is a subset of {@see isValidExpression}. */
 int isValidCommand(const char *const token) {
 	const struct Token *t;
-	return (t = match_token(token)) && (t->avatar == '$') ? 1 : 0;
+	return token && (t = match_token(&syntax, token, strlen(token)))
+		&& (t->symbol == Y_COMMAND) ? 1 : 0;
 }
 
 /** "Returns 1 if the expression agrees with one of the legal robot expressions,
@@ -126,197 +130,899 @@ int isValidCommand(const char *const token) {
  <p>
  "Expression" is a line, not in individal token. It checks the individual
  tokens, and then it checks the syntax of the line. If it returns false, it's
- guaranteed to set synax.error.
- <p>
- It uses parse.c to tokenise, so it will destroy any temp data that you have. */
+ guaranteed to set synax.error. */
 int isValidExpression(const char *const expression) {
-	const struct Token *token;
-	int shift;
-	char avatar[512] = "", *a, *b;
 
 	/* check the arguments */
 	if(!expression) {
 		snprintf(syntax.error, sizeof syntax.error, "null expression");
 		syntax.index = -1;
+		syntax.expected[0] = syntax.suggestion[0] = '\0';
 		return 0;
 	}
 
-	/* parse expression into Tokens and put them into the avatar (expression
-	 buffer or whatever) */
-	initBuffer(expression);
-	a = avatar;
-	while(hasNextToken()) {
-		if(!(token = match_token(nextToken()))) return 0;
-		/* danger! (undefined behaviour)
-		 snprintf(avatar, sizeof avatar, "%s%c", avatar, token->avatar) */
-		if(a >= avatar + sizeof avatar / sizeof(char) - 1 /*null*/) {
-			snprintf(syntax.error, sizeof syntax.error,
-					 "line too long; %u tokens", (int)sizeof avatar);
-			/* index is set in parse.c */
+	return isValidLine(expression, strlen(expression));
+}
+
+/** The same as {@see isValidExpression}, but line is length bytes and is
+ tokenised in place; it need not be null-terminated and is not modified or
+ copied, so the caller can pass memory-mapped input directly. syntax.index is
+ relative to line. */
+int isValidLine(const char *const line, const size_t length) {
+	return checkLine(&syntax, line, length);
+}
+
+/** {@see isValidLine} with the error going to e instead of the global syntax;
+ it has no other state, so threads can check lines at the same time as long as
+ they have their own e.
+ <p>
+ Most lines are valid, so they're first put through {@see accept_line},
+ which only says yes or no, and e is not touched. The ones it doesn't accept
+ are checked again by {@see diagnose_line}, which says why. */
+int checkLine(struct Error *const e, const char *const line,
+	const size_t length) {
+	int is_valid;
+	STATS_DECLARE(t);
+
+	STATS_START(t);
+	is_valid = accept_line(line, length, 0);
+	STATS_STOP(PHASE_ACCEPT, t);
+	return is_valid ? 1 : diagnose_line(e, line, length);
+}
+
+/** @return	How the token with id, by the order in grammar.txt, is printed,
+			or null if there's no such token. */
+const char *tokenName(const unsigned id) {
+	return id < TOKEN_NO ? token_names[id] : 0;
+}
+
+/** @return	A hash of grammar.txt, which this was built from, so that results
+			from another grammar aren't taken for these. */
+uint64_t grammarHash(void) {
+	return GRAMMAR_HASH;
+}
+
+/** Initialises nest before the first line of a script in the nested
+ dialect. */
+void initNest(struct Nest *const nest) {
+	nest->blocks   = 0;
+	nest->size     = nest->capacity = 0;
+	nest->line     = 0;
+	nest->is_error = 0;
+}
+
+/** Frees the blocks of nest and initialises it again. */
+void freeNest(struct Nest *const nest) {
+	free(nest->blocks);
+	initNest(nest);
+}
+
+/** {@see checkLine} in the extended dialect, where REPEAT and WHILE can be in
+ the body of another, and a body can go on over many lines; a line can have
+ any number of statements, but a statement, up to the start of a body, is on
+ one line. The lines of a script are given in order, and then
+ {@see endNested}.
+ <p>
+ It's the same transition[] as a pushdown automaton, in one pass over the
+ tokens: a state that goes to itself on COMMAND and accepts after END is a
+ body, so rather than going into it, the block is pushed on nest and the body
+ is statements from S_START, until END pops it. The stack is as deep as the
+ blocks are, however long the script. An END that has nothing to close is
+ reported where it is; a line that is not valid counts up to the mistake,
+ and the rest of it is ignored.
+ @return	Whether the line is valid; on no memory, nest->is_error is set
+			and the blocks are not all known. */
+int checkNested(struct Error *const e, struct Nest *const nest,
+	const char *const line, const size_t length) {
+	const struct Token *token;
+	struct Scan scan;
+	const char *tok, *bad = 0, *tok_end = line;
+	size_t tok_len, bad_len = 0;
+	long start = 0;
+	unsigned state = S_START, next, first = Y_SYMBOL_NO, bad_state = S_START,
+		bad_symbol = Y_SYMBOL_NO;
+
+	nest->line++;
+	initScan(&scan, e, line, length);
+	e->index = -1;
+	e->suggestion[0] = '\0';
+	while((tok = nextScan(&scan, &tok_len)) || scan.bad) {
+		if(!(token = tok ? match_token(e, tok, tok_len) : 0)) {
+			e->index = (tok ? tok : scan.bad) - line;
+			nest_expect(e, nest, bad ? bad_state : state);
 			return 0;
 		}
-		*(a++) = token->avatar;
-		*a     = '\0';
+		/* an invalid token is reported first, wherever it is */
+		if(bad) continue;
+		/* a statement that is finished is followed by another */
+		if(state != S_START && accept & (1u << state)
+			&& !transition[state][token->symbol]) state = S_START;
+		if(state == S_START) start = tok - line, first = token->symbol;
+		if((next = transition[state][token->symbol])) {
+			if(is_body(next)) nest_push(nest, start, first, token->symbol,
+				next), next = S_START;
+		} else if(state == S_START && token->symbol == Y_END && nest->size) {
+			next = transition[nest->blocks[--nest->size].body][Y_END];
+		} else {
+			bad = tok, bad_len = tok_len, bad_state = state,
+				bad_symbol = token->symbol;
+		}
+		state = next;
+		tok_end = tok + tok_len;
+	}
+	if(bad) {
+		e->index = bad - line;
+		snprintf(e->error, sizeof e->error, bad_state == S_START
+			&& bad_symbol == Y_END ? "[%.*s%s] does not close a block."
+			: "[%.*s%s] is not expected here.",
+			bad_len > 16 ? 16 : (int)bad_len, bad, bad_len > 16 ? "..." : "");
+		nest_expect(e, nest, bad_state);
+		return 0;
 	}
-	if(debug) fprintf(stderr, "isValidExp avatar before <%s>\n", avatar);
+	if(accept & (1u << state)) return 1;
+	/* the line ends in the middle of a statement */
+	e->index = tok_end - line;
+	snprintf(e->error, sizeof e->error,
+		"[%s ...] is not finished at the end of the line.", symbols[first]);
+	nest_expect(e, nest, state);
+	return 0;
+}
+
+/** The script that nest has been checking has ended; any block that is
+ still open is an error, which is where the innermost starts: on line, from
+ the start of the script, and at e->index. nest is ready for another script.
+ @return	Whether every block had an END. */
+int endNested(struct Error *const e, struct Nest *const nest,
+	unsigned long *const line) {
+	const struct NestBlock *b;
+	size_t i, size = 0;
+
+	if(!nest->size) { nest->line = 0; return 1; }
+	b = nest->blocks + nest->size - 1;
+	if(nest->size == 1) snprintf(e->error, sizeof e->error,
+		"[%s ... %s] has no END.", symbols[b->first], symbols[b->last]);
+	else snprintf(e->error, sizeof e->error,
+		"[%s ... %s] has no END, and %lu blocks are open.", symbols[b->first],
+		symbols[b->last], (unsigned long)nest->size);
+	*line    = b->line;
+	e->index = (int)b->column;
+	expect_symbols(e, 1u << Y_END, 0);
+	e->suggestion[0] = '\0';
+	for(i = 0; i < nest->size
+		&& suggest_put(e, &size, symbols[Y_END], strlen(symbols[Y_END])); i++);
+	nest->size = 0, nest->line = 0;
+	return 0;
+}
+
+/** {@see analyzeLine}, and if the line is valid, it's compiled onto the end
+ of robot, {@see robot.h}; a count of a REPEAT that is zero or more than
+ 2^64 - 1 is not valid.
+ @return	Whether the line is valid; whether it was compiled is in
+			robot->is_error. */
+int compileLine(struct Error *const e, struct Robot *const robot,
+	const char *const line, const size_t length) {
+	const struct Token *token;
+	struct LineCost cost;
+	struct Scan scan;
+	const char *tok;
+	size_t tok_len, i;
+	uint64_t count;
 
-	/* group tokens together; it could have been combined with the previous
-	 step for greater effecacity, but more confusion */
-	while((b = strrchr(avatar, 'E'))) {
-		for(a = b - 1; a >= avatar && *a == '$'; a--); a++;
-		for(shift = b - a, *(a++) = '%'; (*a = *(a + shift)); a++);
+	if(!analyzeLine(e, &cost, line, length)) return 0;
+	initScan(&scan, e, line, length);
+	while((tok = nextScan(&scan, &tok_len))) {
+		token = match_token(e, tok, tok_len);
+		switch(token->symbol) {
+		case Y_NUMBER:
+			/* it's known to fit */
+			for(count = 0, i = 0; i < tok_len; i++)
+				count = count * 10 + (uint64_t)(tok[i] - '0');
+			robotRepeat(robot, count);
+			break;
+		case Y_WHILE:   robotWhile(robot); break;
+		case Y_END:     robotEnd(robot); break;
+		case Y_STRING:  robotSay(robot, tok + 1, tok_len - 2); break;
+		case Y_COMMAND: robotCommand(robot, (enum RobotOp)token->op); break;
+		default: break;
+		}
 	}
-	if(debug) fprintf(stderr, "isValidExp avatar grouping <%s>\n", avatar);
+	return -1;
+}
+
+/** {@see checkLine}, and if the line is valid, what it costs when it runs
+ in cost. The count of a REPEAT is read exactly, and one that is zero, (the
+ assignment has it greater than zero,) or more than 2^64 - 1, is an error.
+ It's counted on the fast path, {@see accept_line}; only a line that's not
+ accepted there is gone over again.
+ @return	Whether the line is valid, with a count that can be run. */
+int analyzeLine(struct Error *const e, struct LineCost *const cost,
+	const char *const line, const size_t length) {
+	const struct Token *token;
+	struct Scan scan;
+	const char *tok;
+	size_t tok_len, i;
+	uint64_t count = 1, commands = 0, steps = 0;
+	const char *more;
+	int shown;
 
-	return match_expression(avatar) ? 1 : 0;
+	if(accept_line(line, length, cost)) return -1;
+	if(!diagnose_line(e, line, length)) return 0;
+	cost->is_unbounded = 0;
+	initScan(&scan, e, line, length);
+	while((tok = nextScan(&scan, &tok_len))) {
+		token = match_token(e, tok, tok_len);
+		switch(token->symbol) {
+		case Y_NUMBER:
+			for(count = 0, i = 0; i < tok_len; i++) {
+				const unsigned digit = (unsigned)(tok[i] - '0');
+				if(count > (UINT64_MAX - digit) / 10) break;
+				count = count * 10 + digit;
+			}
+			if(i >= tok_len && count) break;
+			e->index = tok - line;
+			shown = tok_len > 24 ? 24 : (int)tok_len;
+			more  = tok_len > 24 ? "..." : "";
+			if(i < tok_len) snprintf(e->error, sizeof e->error,
+				"[%.*s%s] is more times than the most there can be, %llu.",
+				shown, tok, more, (unsigned long long)UINT64_MAX);
+			else snprintf(e->error, sizeof e->error,
+				"[%.*s%s] is no times; REPEAT is one or more.",
+				shown, tok, more);
+			e->expected[0] = e->suggestion[0] = '\0';
+			return 0;
+		case Y_WHILE:   cost->is_unbounded = -1; break;
+		case Y_STRING:  commands++; break;
+		case Y_COMMAND:
+			commands++;
+			if(token->op == ROBOT_STEP) steps++;
+			break;
+		default: break;
+		}
+	}
+	cost->commands = costProduct(count, commands);
+	cost->steps    = costProduct(count, steps);
+	return -1;
 }
 
 /* private */
 
-/** Converts a string into a const struct Token or returns null and sets
- sytax.error. */
-static const struct Token *match_token(const char *const token) {
-	struct Token *t;
+/** The fast path of {@see checkLine}: whether line, of length, is valid, by
+ the same tokens and transition[], with nothing kept for diagnostics. It
+ doesn't touch the error, format anything, or classify the line in windows;
+ the few loops over bytes look up classes[], and a word is found a word at a
+ time, {@see load_word}, and hashed from the same loads. Anything
+ that isn't simply valid is left to {@see diagnose_line}, so it needn't be
+ handled here at all. If cost is not null, it's also what the line costs,
+ for {@see analyzeLine}, and a count of zero or that's too big is not valid.
+ <p>
+ Lines are short, so classifying them in windows costs more than it saves;
+ {@see nextScan} does and is slower. What's left is a few tens of cycles for
+ each token, which is what bounds it, a long way from memory bandwidth.
+ @return	Whether the line is valid. */
+static int accept_line(const char *const line, const size_t length,
+	struct LineCost *const cost) {
+	const unsigned char *a = (const unsigned char *)line,
+		*const end = a + length;
+	const struct Token *token;
+	unsigned state = S_START, symbol;
+	uint64_t count = 1, commands = 0, steps = 0;
+	int is_unbounded = 0;
+	STATS_ONLY(uint64_t ids[TOKEN_NO] = { 0 }; size_t n = 0;
+		unsigned first = Y_SYMBOL_NO;)
+
+	for( ; ; ) {
+		while(a < end && classes[*a] & (1 << C_DELIMITER)) a++;
+		if(a >= end) break;
+		if(*a == (unsigned char)quote) {
+			const char *at;
+			if(scanString((const char *)a, (const char *)end, &at)) return 0;
+			a = (const unsigned char *)at + 1;
+			symbol = Y_STRING;
+			commands++;
+			STATS_ONLY(ids[STRING]++;)
+		} else if(classes[*a] & (1 << C_DIGIT)) {
+			if(cost) {
+				for(count = 0; a < end && classes[*a] & (1 << C_DIGIT); a++) {
+					const unsigned digit = (unsigned)(*a - '0');
+					if(count > (UINT64_MAX - digit) / 10) return 0;
+					count = count * 10 + digit;
+				}
+				if(!count) return 0;
+			} else {
+				while(++a < end && classes[*a] & (1 << C_DIGIT));
+			}
+			symbol = Y_NUMBER;
+			STATS_ONLY(ids[NUMBER]++;)
+		} else {
+			uint64_t word[2];
+			const size_t word_length = load_word(word, a, end);
+			if(!word_length || !(token = find_keyword(word, word_length)))
+				return 0;
+			a += word_length;
+			symbol = token->symbol;
+			if(symbol == Y_COMMAND)
+				commands++, steps += token->op == ROBOT_STEP;
+			else if(symbol == Y_WHILE) is_unbounded = -1;
+			STATS_ONLY(ids[token->id]++;)
+		}
+		if(a < end && !(classes[*a] & (1 << C_DELIMITER))) return 0;
+		if(!(state = transition[state][symbol])) return 0;
+		STATS_ONLY(if(++n == 1) first = symbol;)
+	}
+	if(!(accept & (1u << state))) return 0;
+	if(cost) {
+		cost->commands     = costProduct(count, commands);
+		cost->steps        = costProduct(count, steps);
+		cost->is_unbounded = is_unbounded;
+	}
+#ifdef Q1_STATS
+	{
+		size_t i;
+		for(i = 0; i < TOKEN_NO; i++) STATS_THIS->tokens[i] += ids[i];
+		STATS_HISTOGRAM(line_bytes, length);
+		STATS_HISTOGRAM(line_tokens, n);
+		STATS_COUNT(forms, first == Y_COMMAND ? FORM_COMMAND
+			: first == Y_REPEAT ? FORM_REPEAT : first == Y_WHILE ? FORM_WHILE
+			: first == Y_SAY ? FORM_SAY : FORM_BLANK);
+	}
+#endif
+	return -1;
+}
+
+/** The slow path of {@see checkLine}: the tokens go straight from the
+ tokeniser into transition[] in one pass, so it's linear in the length of the
+ line, and what's needed to say what's wrong is kept on the way. An invalid
+ token, or one the tokeniser can't read, like a string that isn't closed, is
+ reported first, wherever it is, so it keeps going to the end after the DFA
+ has rejected. On error, e also has the tokens that were expected and
+ the suggestion; the last state before the DFA died is kept for an invalid
+ token, and a line that is not a valid expression is repaired,
+ {@see expression_error}.
+ @return	Whether the line is valid. */
+static int diagnose_line(struct Error *const e, const char *const line,
+	const size_t length) {
+	const struct Token *token;
+	struct Scan scan;
+	struct Group g = { { 0 }, 0, 0, 0 };
+	const char *tok;
+	size_t tok_len, n = 0;
+	unsigned state = S_START, live = S_START; /* the last state not dead */
+	STATS_DECLARE(t);
+	STATS_ONLY(unsigned first = Y_SYMBOL_NO;) /* the form of the line */
+
+	STATS_HISTOGRAM(line_bytes, length);
+	initScan(&scan, e, line, length);
+	e->index = -1;
+	while((tok = nextScan(&scan, &tok_len)) || scan.bad) {
+		e->index = (tok ? tok : scan.bad) - line;
+		STATS_START(t);
+		token = tok ? match_token(e, tok, tok_len) : 0;
+		STATS_STOP(PHASE_MATCH, t);
+		STATS_COUNT(tokens, token ? token->id : NOT_TOKEN);
+		if(!token) {
+			STATS_COUNT(errors, ERROR_TOKEN);
+			STATS_COUNT(forms, FORM_INVALID);
+			STATS_HISTOGRAM(line_tokens, n + 1);
+			expect(e, state ? state : live);
+			return 0;
+		}
+		n++;
+		STATS_START(t);
+		if(state) live = state;
+		state = transition[state][token->symbol];
+		STATS_STOP(PHASE_EXPRESSION, t);
+		STATS_START(t);
+		group_push(&g, token->symbol);
+		STATS_STOP(PHASE_GROUP, t);
+		STATS_ONLY(if(n == 1) first = token->symbol;)
+	}
+	STATS_HISTOGRAM(line_tokens, n);
+	if(accept & (1u << state)) {
+		STATS_COUNT(forms, first == Y_COMMAND ? FORM_COMMAND
+			: first == Y_REPEAT ? FORM_REPEAT : first == Y_WHILE ? FORM_WHILE
+			: first == Y_SAY ? FORM_SAY : FORM_BLANK);
+		return 1;
+	}
+	STATS_COUNT(errors, ERROR_EXPRESSION);
+	STATS_COUNT(forms, FORM_INVALID);
+	STATS_START(t);
+	group_end(&g);
+	expression_error(e, &g, line, length, n);
+	STATS_STOP(PHASE_REPAIR, t);
+	return 0;
+}
+
+
+/** Converts a string of length into a const struct Token or returns null and
+ sets e. */
+static const struct Token *match_token(struct Error *const e,
+	const char *const token, const size_t length) {
+	const struct Token *t;
 
 	/* strings and numbers; we've already vetted them in parse.c */
-	if(!token)           return 0;
-	if(*token == quote)  return tok_string;
-	if(isdigit(*token)) return tok_number;
+	if(!length)                        return 0;
+	if(*token == quote)                return tok_string;
+	if(isdigit((unsigned char)*token)) return tok_number;
 	/* or else it's, maybe, a token */
-	if(!(t = bsearch(token, tokens, tokens_size, sizeof(struct Token), &token_compare))) {
-		snprintf(syntax.error, sizeof syntax.error,
-			"[%.16s%s] is not a valid command; did you mean, [%s]?", token,
-			strlen(token) > 16 ? "..." : "", suggest_token(token));
+	if(!(t = match_keyword(token, length))) {
+		const char *const suggest = suggest_token(token, length);
+		if(suggest) {
+			strcpy(e->suggestion, suggest);
+			snprintf(e->error, sizeof e->error,
+				"[%.*s%s] is not a valid command; did you mean, [%s]?",
+				length > 16 ? 16 : (int)length, token,
+				length > 16 ? "..." : "", suggest);
+		} else {
+			e->suggestion[0] = '\0';
+			snprintf(e->error, sizeof e->error,
+				"[%.*s%s] is not a valid command.",
+				length > 16 ? 16 : (int)length, token,
+				length > 16 ? "..." : "");
+		}
 		/* index is set in parse */
 		return 0;
 	}
 	return t;
 }
 
-/** This is used in {@see match_token}. */
-static int token_compare(const void *a, const void *b) {
-	const char *key = a;
-	const struct Token *elem = b;
-	return tokstrcmp(key, elem->string);
+/** Looks up a word in the perfect hash from keywords.h, comparing the whole
+ word at once, case-insensitive, instead of a character at a time. Used in
+ {@see match_token}.
+ @return The token or null if it's not a keyword. */
+static const struct Token *match_keyword(const char *const token,
+	const size_t length) {
+	uint64_t word[2] = { 0, 0 };
+
+	if(length > KEYWORD_MAX) return 0;
+	pack_word(word, token, length);
+	return find_keyword(word, length);
+}
+
+/** The hash of {@see match_keyword} on a word that's already packed; word is
+ case-folded in place.
+ @return The token or null if it's not a keyword. */
+static const struct Token *find_keyword(uint64_t *const word,
+	const size_t length) {
+	const uint64_t fold = 0xdfdfdfdfdfdfdfdfu;
+	const struct Keyword *k;
+
+	if(length > KEYWORD_MAX) return 0;
+	word[0] &= fold, word[1] &= fold;
+	k = keywords + (((word[0] ^ word[1] * KEYWORD_MIX) * KEYWORD_MULTIPLY)
+		>> KEYWORD_SHIFT);
+	return k->length == length && k->word[0] == word[0]
+		&& k->word[1] == word[1] ? tok_keywords + k->rank : 0;
 }
 
-/** Takes an expression avatar and compares with the list of valid; it returns
- the avatars entry or null. */
-static const char *match_expression(const char *const avatar) {
-	const char *match;
+/** Packs the letters at a, before end, into word as {@see pack_word} would,
+ for {@see accept_line}. A keyword is only letters, and they're the only
+ ASCII with bit 6 set that fold to a letter, so on little-endian machines the
+ end is found in the two words at once: the first byte without bit 6, or with
+ bit 7, including the zeros past end. It is then up to the caller to check
+ that what follows is a delimiter.
+ @return	The number of letters, or KEYWORD_MAX + 1 if there are more than
+ there are in any keyword. */
+static size_t load_word(uint64_t *const word, const unsigned char *const a,
+	const unsigned char *const end) {
+	const size_t left = (size_t)(end - a);
+	size_t length;
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__ \
+	&& defined(__GNUC__)
+	const uint64_t six = 0x4040404040404040u, seven = 0x8080808080808080u;
+	uint64_t stop;
+	word[0] = word[1] = 0;
+	pack_word(word, (const char *)a, left < 16 ? left : 16);
+	if((stop = (~word[0] & six) | (word[0] & seven))) {
+		length = (unsigned)__builtin_ctzll(stop) >> 3;
+		word[0] &= ((uint64_t)1 << 8 * length) - 1, word[1] = 0;
+	} else if((stop = (~word[1] & six) | (word[1] & seven))) {
+		length = (unsigned)__builtin_ctzll(stop) >> 3;
+		word[1] &= ((uint64_t)1 << 8 * length) - 1, length += 8;
+	} else {
+		return KEYWORD_MAX + 1;
+	}
+#else
+	for(length = 0; length < left && (a[length] & 0xc0) == 0x40; length++)
+		if(length >= KEYWORD_MAX) return KEYWORD_MAX + 1;
+	word[0] = word[1] = 0;
+	pack_word(word, (const char *)a, length);
+#endif
+	return length > KEYWORD_MAX ? KEYWORD_MAX + 1 : length;
+}
 
-	if(!(match = bsearch(avatar, avatars, avatars_size, sizeof(char *), &expression_compare))) {
-		snprintf(syntax.error, sizeof syntax.error,
-			"[%.64s%s] is not a valid expression; did you mean, [%s]?",
-			expand_expression(avatar), strlen(avatar) > 64 ? "..." : "",
-			expand_expression(suggest_expression(avatar)));
-		/* set the index to a negative because we don't have info on where */
-		syntax.index = -1;
-		return 0;
+/** Copies a, length up to 16, into word as memcpy would, without a call; on
+ little-endian machines, it loads overlapping pieces that are shifted into
+ place, never reading outside of a. */
+static void pack_word(uint64_t *const word, const char *const a,
+	const size_t length) {
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+	uint64_t x, y;
+	uint32_t u, v;
+	if(length >= 8) {
+		memcpy(&x, a, 8);
+		memcpy(&y, a + length - 8, 8);
+		word[0] = x;
+		word[1] = length > 8 ? y >> (8 * (16 - length)) : 0;
+	} else if(length >= 4) {
+		memcpy(&u, a, 4);
+		memcpy(&v, a + length - 4, 4);
+		word[0] = (uint64_t)u | (uint64_t)v << (8 * (length - 4));
+	} else if(length) {
+		word[0] = (uint64_t)(unsigned char)a[0]
+			| (uint64_t)(unsigned char)a[length >> 1] << (8 * (length >> 1))
+			| (uint64_t)(unsigned char)a[length - 1] << (8 * (length - 1));
 	}
-	return match;
+#else
+	memcpy(word, a, length);
+#endif
 }
 
-/** {@see match_expression} bsearch. */
-static int expression_compare(const void *a, const void *b) {
-	const char *key = a;
-	const char *const*elem_ptr = b;
-	const char *const elem = *elem_ptr;
-	return strcmp(key, elem);
+/** Adds the symbol of the next token to g; a run of commands is held until
+ it's known whether it's followed by END. */
+static void group_push(struct Group *const g, const unsigned symbol) {
+	if(symbol == Y_COMMAND) {
+		g->run++;
+	} else if(symbol == Y_END) {
+		g->run = 0;
+		group_emit(g, Y_GROUP, 1);
+	} else {
+		group_end(g);
+		group_emit(g, symbol, 1);
+	}
+}
+
+/** There are no more tokens, or the run of commands is not grouped. */
+static void group_end(struct Group *const g) {
+	group_emit(g, Y_COMMAND, g->run);
+	g->run = 0;
 }
 
-/** Takes "Sa#D" and expands it into "SAY <string> <number> DO" in a static
- buffer. There are four of them, so you could call it a maximum of four times at
- once without overruning. */
-static char *expand_expression(const char *const avatar) {
-	static char expand[4][1024];
-	static int z;
-	int y;
-	const int n = strlen(avatar);
-	int i;
+/** Appends n of symbol to g. */
+static void group_emit(struct Group *const g, const unsigned symbol,
+	const size_t n) {
+	size_t i;
+	for(i = 0; i < n && g->prefix_size < sizeof g->prefix; i++)
+		g->prefix[g->prefix_size++] = (unsigned char)symbol;
+	g->size += n;
+}
 
-	for(expand[z][0] = '\0', i = 0; i < n; i++) {
-		snprintf(expand[z], sizeof expand[z], "%s%s%s", expand[z], i ? " " : "", reverse_token(avatar[i]));
+/** Sets e for a line, of length, whose n tokens, grouped in g, are not a valid
+ expression. The suggestion is the line with the fewest tokens inserted,
+ replaced, or deleted that is, {@see repair_edits}; if it's too long, it
+ starts a few tokens before the first edit instead. e->index is where that
+ edit is, and e->expected is what could have been there. The tokens are
+ scanned again, which is only done on error; they are known to be valid.
+ What the repair needs grows with n, and it's in e->arena, which is reset
+ first; if there's no memory for it, there's no suggestion. */
+static void expression_error(struct Error *const e,
+	const struct Group *const g, const char *const line,
+	const size_t length, const size_t n) {
+	const size_t context = 2; /* the tokens shown before the first edit */
+	struct Arena own, *const arena = e->arena ? e->arena : &own;
+	unsigned char *symbol;
+	struct Repair *edits;
+	unsigned (*cost)[S_STATE_NO];
+	struct Scan scan;
+	const char *tok;
+	char got[1024];
+	size_t tok_len, i = 0, edits_size, first;
+
+	if(arena == &own) initArena(&own); else resetArena(arena);
+	/* there are at most n insertions, since deleting them all is valid */
+	if(!(symbol = arenaAlloc(arena, n, sizeof *symbol))
+		|| !(edits = arenaAlloc(arena, n, 2 * sizeof *edits))
+		|| !(cost = arenaAlloc(arena, n + 1, sizeof *cost))) {
+		e->index = -1;
+		e->expected[0] = e->suggestion[0] = '\0';
+		snprintf(e->error, sizeof e->error,
+			"[%.64s%s] is not a valid expression.",
+			expand_expression(got, sizeof got, g), g->size > 64 ? "..." : "");
+		if(arena == &own) freeArena(&own);
+		return;
 	}
-	y = z;
-	z = (z + 1) & 3;
-	return expand[y];
+	initScan(&scan, e, line, length);
+	while((tok = nextScan(&scan, &tok_len)) && i < n)
+		symbol[i++] = match_token(e, tok, tok_len)->symbol;
+	edits_size = repair_edits(edits, cost, symbol, n);
+	for(first = 0; first < edits_size && edits[first].edit == EDIT_KEEP;
+		first++);
+	if(!suggest_repair(e, line, length, edits, edits_size, first, 0)
+		&& first > context)
+		suggest_repair(e, line, length, edits, edits_size, first,
+			first - context);
+	snprintf(e->error, sizeof e->error,
+		"[%.64s%s] is not a valid expression; did you mean, [%s]?",
+		expand_expression(got, sizeof got, g),
+		g->size > 64 ? "..." : "", e->suggestion);
+	if(arena == &own) freeArena(&own);
 }
 
-/** Takes a char and returns the meaning according to reverse; used in
- {@see expand_expression}. */
-static char *reverse_token(const char avatar) {
-	const struct Reverse *const r = bsearch(&avatar, reverse, reverse_size, sizeof(struct Reverse), &reverse_compare);
-	return r ? r->string : "null";
+/** Finds the fewest edits to the n symbols of a line so that transition[]
+ accepts it: a symbol is inserted, replaced, or deleted. The edits, in order,
+ go in edits, which must hold 2n, and cost must hold n + 1.
+ <p>
+ cost[i][s] is the fewest edits that take the rest of the line from symbol i
+ to an accepting state from s. It's filled in from the end; with insert[]
+ standing in for any number of insertions at once, that's a fixed amount of
+ work per symbol, and linear in the line. The edits are then read from the
+ start, keeping a symbol whenever that's as good, so the first edit is as
+ late as it can be, and otherwise preferring to insert, replace, and delete,
+ in that order.
+ @return	The number of edits. */
+static size_t repair_edits(struct Repair *const edits,
+	unsigned (*const cost)[S_STATE_NO], const unsigned char *const symbol,
+	const size_t n) {
+	unsigned here[S_STATE_NO];
+	size_t i, edits_size = 0;
+	unsigned s, t, y, c;
+
+	for(s = S_START; s < S_STATE_NO; s++) {
+		for(c = none, t = S_START; t < S_STATE_NO; t++)
+			if(accept & (1u << t) && insert[s][t] < c) c = insert[s][t];
+		cost[n][s] = c;
+	}
+	for(i = n; i; i--) {
+		const unsigned *const next = cost[i];
+		/* symbol i - 1 from s: kept, deleted, or replaced */
+		for(s = S_START; s < S_STATE_NO; s++) {
+			c = next[s] + 1u;
+			if((t = transition[s][symbol[i - 1]]) && next[t] < c) c = next[t];
+			for(y = 0; y < Y_SYMBOL_NO; y++)
+				if((t = transition[s][y]) && next[t] + 1u < c) c = next[t] + 1u;
+			here[s] = c;
+		}
+		/* any number of insertions before it */
+		for(s = S_START; s < S_STATE_NO; s++) {
+			for(c = here[s], t = S_START; t < S_STATE_NO; t++)
+				if(insert[s][t] != none && insert[s][t] + here[t] < c)
+					c = insert[s][t] + here[t];
+			cost[i - 1][s] = c;
+		}
+	}
+	for(i = 0, s = S_START; ; ) {
+		struct Repair *const r = edits + edits_size;
+		c = cost[i][s];
+		if(i < n && (t = transition[s][symbol[i]]) && cost[i + 1][t] == c) {
+			r->edit = EDIT_KEEP, r->symbol = symbol[i++], s = t;
+		} else if(i == n && accept & (1u << s)) {
+			break;
+		} else {
+			for(y = 0; y < Y_SYMBOL_NO; y++)
+				if((t = transition[s][y]) && cost[i][t] + 1u == c) break;
+			if(y < Y_SYMBOL_NO) {
+				r->edit = EDIT_INSERT, r->symbol = (unsigned char)y, s = t;
+			} else {
+				for(y = 0; y < Y_SYMBOL_NO; y++)
+					if((t = transition[s][y]) && cost[i + 1][t] + 1u == c) break;
+				if(y < Y_SYMBOL_NO) {
+					r->edit = EDIT_REPLACE, r->symbol = (unsigned char)y, s = t;
+				} else {
+					r->edit = EDIT_DELETE, r->symbol = symbol[i];
+				}
+				i++;
+			}
+		}
+		edits_size++;
+	}
+	return edits_size;
 }
 
-/** {@see reverse_token} bsearch. */
-static int reverse_compare(const void *a, const void *b) {
-	const char key = *(const char *)a;
-	const struct Reverse *elem = b;
-	return key - elem->avatar;
+/** Writes the line, of length, with edits applied to e->suggestion, starting
+ from edits[from] and "..." if that's not the start, and sets e->index and
+ e->expected for edits[first].
+ @return	Whether the first edit fit. */
+static int suggest_repair(struct Error *const e, const char *const line,
+	const size_t length, const struct Repair *const edits,
+	const size_t edits_size, const size_t first, const size_t from) {
+	struct Scan scan;
+	const char *tok, *end = line;
+	size_t tok_len, i, size = 0;
+	unsigned state = S_START;
+	int is_room = -1, is_first = 0;
+
+	e->suggestion[0] = '\0';
+	initScan(&scan, e, line, length);
+	tok = nextScan(&scan, &tok_len);
+	if(from) is_room = suggest_put(e, &size, "...", 3);
+	for(i = 0; i < edits_size; i++) {
+		const struct Repair *const r = edits + i;
+		if(i >= from && is_room) {
+			if(r->edit == EDIT_KEEP)
+				is_room = suggest_put(e, &size, tok, tok_len);
+			else if(r->edit != EDIT_DELETE)
+				is_room = suggest_put(e, &size, symbols[r->symbol],
+					strlen(symbols[r->symbol]));
+		}
+		if(i == first) {
+			e->index = (tok ? tok : end) - line;
+			expect(e, state);
+			is_first = is_room;
+		}
+		if(r->edit != EDIT_DELETE) state = transition[state][r->symbol];
+		if(r->edit != EDIT_INSERT)
+			end = tok + tok_len, tok = nextScan(&scan, &tok_len);
+	}
+	return is_first;
 }
 
-/** O(n), but simple. Suggest, based on an arbitry token string, an actual
- token string. */
-static const char *suggest_token(const char *const token) {
-	const int max = tokens_size - 1;
-	int lo = 0, hi = max, n = strlen(token), i;
+/** Appends n of s to e->suggestion, which is size, after a space unless it's
+ the first; if it doesn't fit, it ends with "..." instead.
+ @return	Whether there is room for more. */
+static int suggest_put(struct Error *const e, size_t *const size,
+	const char *const s, const size_t n) {
+	const size_t max = sizeof e->suggestion - sizeof " ...";
+	char *x = e->suggestion + *size;
 
-	for(i = 0; i < n && lo != hi; i++) {
-		while(hi > 0   && tokstrcmp(token, tokens[hi].string) < 0) hi--;
-		while(lo < max && tokstrcmp(token, tokens[lo].string) > 0) lo++;
+	if(*size + !!*size + n > max) {
+		strcpy(x, *size ? " ..." : "...");
+		*size += strlen(x);
+		return 0;
 	}
+	if(*size) *(x++) = ' ';
+	memcpy(x, s, n), x[n] = '\0';
+	*size = x + n - e->suggestion;
+	return -1;
+}
+
+/** Sets e->expected to the symbols that transition[] accepts in state, and
+ the end of the line if state is accepting. */
+static void expect(struct Error *const e, const unsigned state) {
+	unsigned set = 0, y;
 
-	return tokens[lo].string;
+	for(y = 0; y < Y_SYMBOL_NO; y++)
+		if(transition[state][y]) set |= 1u << y;
+	expect_symbols(e, set, accept & (1u << state) ? -1 : 0);
 }
 
-/** Suggest, based on an arbitry avatar expression, an actual avatar
- expression. */
-static const char *suggest_expression(const char *const avatar) {
-	const int max = avatars_size - 1;
-	int lo = 0, hi = max, n = strlen(avatar), i;
+/** Sets e->expected to the symbols that are bits of set, by enum Symbol, in
+ order, and then the end of the line if is_end. */
+static void expect_symbols(struct Error *const e, const unsigned set,
+	const int is_end) {
+	char *x = e->expected;
+	const char *s;
+	unsigned y;
 
-	for(i = 0; i < n && lo != hi; i++) {
-		while(hi > 0   && avatar[i] < avatars[hi][i]) hi--;
-		while(lo < max && avatar[i] > avatars[lo][i]) lo++;
+	for(y = 0; y <= Y_SYMBOL_NO; y++) {
+		if(y < Y_SYMBOL_NO ? !(set & (1u << y)) : !is_end) continue;
+		if(x != e->expected) *(x++) = ' ';
+		for(s = y < Y_SYMBOL_NO ? symbols[y] : "<end-of-line>"; *s; s++)
+			*(x++) = *s;
 	}
+	*x = '\0';
+}
 
-	return avatars[lo];
-}
-
-/* ANSI C89 does NOT have strcasecmp, stricmp, strcmpi, etc; that's POSIX, C++,
- Windows, or an extension -- just make our own; used in {@see tokstrcmp}. */
-static char upper[] = {
-	0,  1,  2,  3,  4,  5,  6,  7,  8,  9,  10, 11, 12, 13, 14, 15,
-	16, 17, 18, 19, 20, 21, 22, 23, 24, 25, 26, 27, 28, 29, 30, 31,
-	32, 33, 34, 35, 36, 37, 38, 39, 40, 41, 42, 43, 44, 45, 46, 47,
-	48, 49, 50, 51, 52, 53, 54, 55, 56, 57, 58, 59, 60, 61, 62, 63,
-	64, 65, 66, 67, 68, 69, 70, 71, 72, 73, 74, 75, 76, 77, 78, 79,
-	80, 81, 82, 83, 84, 85, 86, 87, 88, 89, 90, 91, 92, 93, 94, 95,
-	96, 65, 66, 67, 68, 69, 70, 71, 72, 73, 74, 75, 76, 77, 78, 79,
-	80, 81, 82, 83, 84, 85, 86, 87, 88, 89, 90,123,124,125,126,127,
-	-0x80,-0x7f,-0x7e,-0x7d,-0x7c,-0x7b,-0x7a,-0x79,
-	-0x78,-0x77,-0x76,-0x75,-0x74,-0x73,-0x72,-0x71,
-	-0x70,-0x6f,-0x6e,-0x6d,-0x6c,-0x6b,-0x6a,-0x69,
-	-0x68,-0x67,-0x66,-0x65,-0x64,-0x63,-0x62,-0x61,
-	-0x60,-0x5f,-0x5e,-0x5d,-0x5c,-0x5b,-0x5a,-0x59,
-	-0x58,-0x57,-0x56,-0x55,-0x54,-0x53,-0x52,-0x51,
-	-0x50,-0x4f,-0x4e,-0x4d,-0x4c,-0x4b,-0x4a,-0x49,
-	-0x48,-0x47,-0x46,-0x45,-0x44,-0x43,-0x42,-0x41,
-	-0x40,-0x3f,-0x3e,-0x3d,-0x3c,-0x3b,-0x3a,-0x39,
-	-0x38,-0x37,-0x36,-0x35,-0x34,-0x33,-0x32,-0x31,
-	-0x30,-0x2f,-0x2e,-0x2d,-0x2c,-0x2b,-0x2a,-0x29,
-	-0x28,-0x27,-0x26,-0x25,-0x24,-0x23,-0x22,-0x21,
-	-0x20,-0x1f,-0x1e,-0x1d,-0x1c,-0x1b,-0x1a,-0x19,
-	-0x18,-0x17,-0x16,-0x15,-0x14,-0x13,-0x12,-0x11,
-	-0x10,-0x0f,-0x0e,-0x0d,-0x0c,-0x0b,-0x0a,-0x09,
-	-0x08,-0x07,-0x06,-0x05,-0x04,-0x03,-0x02,-0x01
-};
+/** @return	Whether state is the body of a block: it stays on COMMAND, and
+			END finishes it. */
+static int is_body(const unsigned state) {
+	return state && transition[state][Y_COMMAND] == state
+		&& accept & (1u << transition[state][Y_END]) ? -1 : 0;
+}
+
+/** {@see expect} in the nested dialect: a statement that's finished can be
+ followed by another, or an END if a block is open. */
+static void nest_expect(struct Error *const e, const struct Nest *const nest,
+	const unsigned state) {
+	unsigned set = 0, y;
+	const int is_end = accept & (1u << state) ? -1 : 0;
+
+	for(y = 0; y < Y_SYMBOL_NO; y++)
+		if(transition[state][y] || (is_end && transition[S_START][y]))
+			set |= 1u << y;
+	if(is_end && nest->size) set |= 1u << Y_END;
+	expect_symbols(e, set, is_end);
+}
+
+/** Opens a block at column of the current line of nest that starts with
+ first and goes into body on last. */
+static void nest_push(struct Nest *const nest, const long column,
+	const unsigned first, const unsigned last, const unsigned body) {
+	struct NestBlock *b;
+
+	if(nest->size >= nest->capacity) {
+		const size_t c = nest->capacity ? nest->capacity << 1 : 16;
+		if(!(b = realloc(nest->blocks, c * sizeof *b)))
+			{ nest->is_error = -1; return; }
+		nest->blocks   = b;
+		nest->capacity = c;
+	}
+	b = nest->blocks + nest->size++;
+	b->line   = nest->line;
+	b->column = column;
+	b->first  = (unsigned char)first;
+	b->last   = (unsigned char)last;
+	b->body   = (unsigned char)body;
+}
+
+/** Takes the grouped symbols of g, Y_SAY Y_STRING Y_NUMBER Y_DO, and expands
+ them into "SAY <message> <number> DO" in expand, which is expand_size and is
+ returned; it truncates if it doesn't fit. */
+static char *expand_expression(char *const expand, const size_t expand_size,
+	const struct Group *const g) {
+	const char *r;
+	char *x = expand, *const x_end = expand + expand_size - 1 /*null*/;
+	size_t i;
+
+	for(i = 0; i < g->prefix_size && x < x_end; i++) {
+		if(i) *(x++) = ' ';
+		for(r = symbols[g->prefix[i]]; *r && x < x_end; r++) *(x++) = *r;
+	}
+	*x = '\0';
+	return expand;
+}
+
+/** Suggests the keyword nearest to token, of length, by Damerau-Levenshtein
+ distance (with transpositions of neighbours,) ignoring case; ties go to the
+ first alphabetically.
+ <p>
+ The distance to every keyword is found at once with Myers' bit-parallel
+ algorithm, as extended to transpositions by Hyyrö: the keywords are lanes of
+ bits, one bit per letter, in SUGGEST_WORDS words that keywords.h packs, and a
+ column of the distance matrix, a character of token, is a dozen operations
+ on each word. The carry of the addition is kept in each lane by adding
+ without the high bits and putting them back, and the shifts bring in the top
+ row of every lane at its low bit. The distance to every keyword, along the
+ bottom row of the matrix, is counted at the same time by the horizontal
+ differences at the top bit of its lane, starting from its length: four bit
+ planes hold it, since a token longer than fifteen is not compared, and all
+ the counts go up or down together in a few operations for each column. At
+ the end, the keywords that are more than three away are one mask, and
+ only the others are read.
+ @return	The keyword, or null if none is close enough. */
+static const char *suggest_token(const char *const token,
+	const size_t length) {
+	uint64_t vp[SUGGEST_WORDS], vn[SUGGEST_WORDS], d0[SUGGEST_WORDS],
+		last[SUGGEST_WORDS], c0[SUGGEST_WORDS], c1[SUGGEST_WORDS],
+		c2[SUGGEST_WORDS], c3[SUGGEST_WORDS];
+	const size_t lanes_size = sizeof suggest_lanes / sizeof *suggest_lanes;
+	const char *best = 0;
+	unsigned w, best_distance = suggest_max + 1;
+	size_t i;
+
+	if(length > KEYWORD_MAX + suggest_max) return 0;
+	for(w = 0; w < SUGGEST_WORDS; w++)
+		vp[w] = ~(uint64_t)0, vn[w] = d0[w] = last[w] = 0,
+		c0[w] = suggest_length[0][w], c1[w] = suggest_length[1][w],
+		c2[w] = suggest_length[2][w], c3[w] = suggest_length[3][w];
+	for(i = 0; i < length; i++) {
+		const uint64_t *const eq = suggest_eq[(unsigned char)token[i]];
+		for(w = 0; w < SUGGEST_WORDS; w++) {
+			const uint64_t lo = suggest_low[w], hi = suggest_high[w],
+				x = eq[w] & vp[w],
+				tr = ((~d0[w] & eq[w]) << 1) & ~lo & last[w];
+			uint64_t hp, hn, up, down;
+			d0[w] = ((((x & ~hi) + (vp[w] & ~hi)) ^ ((x ^ vp[w]) & hi)) ^ vp[w])
+				| eq[w] | vn[w] | tr;
+			hp = vn[w] | ~(d0[w] | vp[w]);
+			hn = vp[w] & d0[w];
+			/* add one to the counts at up and take one from them at down */
+			up = hp & hi, down = hn & hi;
+			c0[w] ^= up | down, up &= ~c0[w], down &= c0[w];
+			c1[w] ^= up | down, up &= ~c1[w], down &= c1[w];
+			c2[w] ^= up | down, up &= ~c2[w], down &= c2[w];
+			c3[w] ^= up | down;
+			hp = (hp << 1) | lo;
+			hn = (hn << 1) & ~lo;
+			vp[w] = hn | ~(d0[w] | hp);
+			vn[w] = d0[w] & hp;
+			last[w] = eq[w];
+		}
+	}
+	/* the counts that are more than three */
+	for(w = 0; w < SUGGEST_WORDS; w++) c2[w] |= c3[w];
+	for(i = 0; i < lanes_size; i++) {
+		const struct SuggestLane *const l = suggest_lanes + i;
+		const unsigned top = l->shift + l->length - 1u;
+		unsigned d;
+		if(c2[l->word] >> top & 1) continue;
+		d = (unsigned)(c0[l->word] >> top & 1)
+			| (unsigned)(c1[l->word] >> top & 1) << 1;
+		if(d <= suggest_cutoff(l->length) && d < best_distance)
+			best = tok_keywords[i].string, best_distance = d;
+	}
+	return best;
+}
 
-/** This is used in {@see token_compare} and {@see suggest_token}. b is in
- uppercase. */
-static int tokstrcmp(const char *a, const char *b) {
-	for( ; upper[(unsigned char)*a] == *b; a++, b++) if(*a == '\0') return 0;
-	return upper[(unsigned char)*a] - *b;
+/** @return	How far a token can be from a keyword of length to suggest it. */
+static unsigned suggest_cutoff(const unsigned length) {
+	return length < 3 ? 1 : length / 3 < suggest_max ? length / 3 : suggest_max;
 }
@@ -1,7 +1,47 @@
+#include <stddef.h> /* size_t */
+#include <stdint.h> /* uint64_t */
+
+struct Arena;
+
 extern struct Error {
 	char error[256];
 	int index;
+	char expected[96];   /* what could have come instead, space-separated */
+	char suggestion[128]; /* what's in "did you mean," or empty */
+	struct Arena *arena; /* scratch that's reused for each line that's not
+		valid, {@see arenaAlloc}, or null to allocate it every time */
 } syntax;
 
 int isValidCommand(const char *const token);
 int isValidExpression(const char *const expression);
+int isValidLine(const char *const line, const size_t length);
+int checkLine(struct Error *const e, const char *const line,
+	const size_t length);
+const char *tokenName(const unsigned id);
+uint64_t grammarHash(void);
+
+/* the blocks that are open in the nested dialect, innermost last, and the
+ number of lines so far, {@see checkNested} */
+struct Nest {
+	struct NestBlock *blocks;
+	size_t size, capacity;
+	unsigned long line;
+	int is_error;
+};
+
+void initNest(struct Nest *const nest);
+void freeNest(struct Nest *const nest);
+int checkNested(struct Error *const e, struct Nest *const nest,
+	const char *const line, const size_t length);
+int endNested(struct Error *const e, struct Nest *const nest,
+	unsigned long *const line);
+
+struct Robot;
+
+int compileLine(struct Error *const e, struct Robot *const robot,
+	const char *const line, const size_t length);
+
+struct LineCost;
+
+int analyzeLine(struct Error *const e, struct LineCost *const cost,
+	const char *const line, const size_t length);
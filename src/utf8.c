@@ -0,0 +1,334 @@
+/* UTF-8 for the messages of SAY, {@see utf8Valid}. A message is checked a
+ window at a time with the lookup tables of Keiser and Lemire, "Validating
+ UTF-8 In Less Than One Instruction Per Byte," 2021: the high and low nibbles
+ of each byte and the high nibble of the one after it are looked up with a
+ shuffle, and the three are anded, so all but two of the errors come out in
+ one pass; the other two, a missing third or fourth byte, are from the bytes
+ two and three back. A window of ASCII only has to check that the one before
+ it didn't end in the middle of a character. It's AVX2 or SSSE3, as the
+ processor has it, or else plain C that skips ASCII eight bytes at a time;
+ the classifier in classify.c that's picked, by Q1_CLASSIFY or -DQ1_SCALAR,
+ narrows this the same way. Only the window with the first error is decoded a
+ character at a time, to say where it is.
+
+ @author	Neil
+ @version	1; 2016-03
+ @since		1; 2016-03 */
+
+#define _POSIX_C_SOURCE 200809L /* pthread_once */
+
+#include <string.h>		/* memcpy memset strcmp */
+#include <stdint.h>		/* uint64_t */
+#include <pthread.h>	/* pthread_once */
+#include "classify.h"	/* classifyName */
+#include "utf8.h"
+
+#if !defined(Q1_SCALAR) && defined(__GNUC__) \
+	&& (defined(__x86_64__) || defined(__i386__)) && defined(__SSE2__)
+#define Q1_X86
+#include <immintrin.h>	/* _mm_* _mm256_* */
+#endif
+
+typedef size_t (*Valid)(const char *const a, const size_t length);
+
+#ifdef Q1_X86
+
+/* what can be wrong with a pair of bytes, the last one and the one before,
+ by the nibbles; an error is a bit that's set in all three tables */
+enum {
+	TOO_SHORT      = 1 << 0, /* a lead or ASCII after a lead */
+	TOO_LONG       = 1 << 1, /* a continuation after ASCII */
+	OVERLONG_3     = 1 << 2, /* E0 80-9F */
+	TOO_LARGE      = 1 << 3, /* F4 90-BF, F5-FF */
+	SURROGATE      = 1 << 4, /* ED A0-BF */
+	OVERLONG_2     = 1 << 5, /* C0-C1 */
+	TOO_LARGE_1000 = 1 << 6, /* F5-FF 80-8F */
+	OVERLONG_4     = 1 << 6, /* F0 80-8F */
+	TWO_CONTINUE   = 1 << 7, /* a continuation after a continuation */
+	CARRY          = TOO_SHORT | TOO_LONG | TWO_CONTINUE
+};
+
+/* the high nibble of the byte before */
+static const unsigned char first_high[16] = {
+	TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG,
+	TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG,
+	TWO_CONTINUE, TWO_CONTINUE, TWO_CONTINUE, TWO_CONTINUE,
+	TOO_SHORT | OVERLONG_2,
+	TOO_SHORT,
+	TOO_SHORT | OVERLONG_3 | SURROGATE,
+	TOO_SHORT | TOO_LARGE | TOO_LARGE_1000 | OVERLONG_4
+};
+
+/* the low nibble of the byte before */
+static const unsigned char first_low[16] = {
+	CARRY | OVERLONG_3 | OVERLONG_2 | OVERLONG_4,
+	CARRY | OVERLONG_2,
+	CARRY,
+	CARRY,
+	CARRY | TOO_LARGE,
+	CARRY | TOO_LARGE | TOO_LARGE_1000,
+	CARRY | TOO_LARGE | TOO_LARGE_1000,
+	CARRY | TOO_LARGE | TOO_LARGE_1000,
+	CARRY | TOO_LARGE | TOO_LARGE_1000,
+	CARRY | TOO_LARGE | TOO_LARGE_1000,
+	CARRY | TOO_LARGE | TOO_LARGE_1000,
+	CARRY | TOO_LARGE | TOO_LARGE_1000,
+	CARRY | TOO_LARGE | TOO_LARGE_1000,
+	CARRY | TOO_LARGE | TOO_LARGE_1000 | SURROGATE,
+	CARRY | TOO_LARGE | TOO_LARGE_1000,
+	CARRY | TOO_LARGE | TOO_LARGE_1000
+};
+
+/* the high nibble of the byte */
+static const unsigned char second_high[16] = {
+	TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT,
+	TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT,
+	TOO_LONG | OVERLONG_2 | TWO_CONTINUE | OVERLONG_3 | TOO_LARGE_1000
+		| OVERLONG_4,
+	TOO_LONG | OVERLONG_2 | TWO_CONTINUE | OVERLONG_3 | TOO_LARGE,
+	TOO_LONG | OVERLONG_2 | TWO_CONTINUE | SURROGATE | TOO_LARGE,
+	TOO_LONG | OVERLONG_2 | TWO_CONTINUE | SURROGATE | TOO_LARGE,
+	TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT
+};
+
+#endif
+
+/* static data */
+static pthread_once_t once = PTHREAD_ONCE_INIT;
+static Valid best;
+static const char *best_name;
+
+/* private prototypes */
+static void choose(void);
+static size_t valid_scalar(const char *const a, const size_t length);
+static size_t decode(const char *const a, const size_t length, size_t i);
+#ifdef Q1_X86
+static size_t locate(const char *const a, const size_t length,
+	const size_t i);
+static size_t valid_ssse3(const char *const a, const size_t length);
+static size_t valid_avx2(const char *const a, const size_t length);
+#endif
+
+/* public */
+
+/** @return	The number of bytes at a, up to length, that are UTF-8; that's
+			length if it all is, or else where the first character that
+			isn't starts. Overlong forms, surrogates, and code points
+			past U+10FFFF are not UTF-8. */
+size_t utf8Valid(const char *const a, const size_t length) {
+	pthread_once(&once, &choose);
+	return best(a, length);
+}
+
+/** @return	The number of bytes in the UTF-8 character at a, before end, or
+			zero if it's not one; overlong and surrogate forms are
+			not. */
+size_t utf8Length(const char *const a, const char *const end) {
+	const unsigned char *const s = (const unsigned char *)a;
+	const size_t left = (size_t)(end - a);
+	unsigned long c;
+	size_t n, i;
+
+	if(s[0] < 0x80) return 1;
+	else if(s[0] >= 0xc2 && s[0] < 0xe0) n = 2, c = s[0] & 0x1f;
+	else if(s[0] >= 0xe0 && s[0] < 0xf0) n = 3, c = s[0] & 0x0f;
+	else if(s[0] >= 0xf0 && s[0] < 0xf5) n = 4, c = s[0] & 0x07;
+	else return 0;
+	if(left < n) return 0;
+	for(i = 1; i < n; i++) {
+		if((s[i] & 0xc0) != 0x80) return 0;
+		c = c << 6 | (s[i] & 0x3f);
+	}
+	if((n == 3 && (c < 0x800 || (c >= 0xd800 && c < 0xe000)))
+		|| (n == 4 && (c < 0x10000 || c > 0x10ffff))) return 0;
+	return n;
+}
+
+/** Writes the code point c, which must be at most U+10FFFF, to u as UTF-8.
+ @return	The number of bytes, one to four. */
+size_t utf8Encode(char *const u, const unsigned long c) {
+	if(c < 0x80) { u[0] = (char)c; return 1; }
+	if(c < 0x800) {
+		u[0] = (char)(0xc0 | c >> 6), u[1] = (char)(0x80 | (c & 0x3f));
+		return 2;
+	}
+	if(c < 0x10000) {
+		u[0] = (char)(0xe0 | c >> 12), u[1] = (char)(0x80 | (c >> 6 & 0x3f));
+		u[2] = (char)(0x80 | (c & 0x3f));
+		return 3;
+	}
+	u[0] = (char)(0xf0 | c >> 18), u[1] = (char)(0x80 | (c >> 12 & 0x3f));
+	u[2] = (char)(0x80 | (c >> 6 & 0x3f)), u[3] = (char)(0x80 | (c & 0x3f));
+	return 4;
+}
+
+/** @return	The name of the validator {@see utf8Valid} uses. */
+const char *utf8Name(void) {
+	pthread_once(&once, &choose);
+	return best_name;
+}
+
+/* private */
+
+static void choose(void) {
+	const char *const classify = classifyName();
+
+	best = &valid_scalar, best_name = "scalar";
+#ifdef Q1_X86
+	if(!strcmp(classify, "scalar") || !__builtin_cpu_supports("ssse3"))
+		return;
+	best = &valid_ssse3, best_name = "ssse3";
+	if(!strcmp(classify, "avx2")) best = &valid_avx2, best_name = "avx2";
+#else
+	(void)classify;
+#endif
+}
+
+/** ASCII eight bytes at a time, and the rest a character at a time. */
+static size_t valid_scalar(const char *const a, const size_t length) {
+	return decode(a, length, 0);
+}
+
+/** Decodes a, length, from i, which must be the start of a character.
+ @return	Where the first character that isn't UTF-8 starts, or length. */
+static size_t decode(const char *const a, const size_t length, size_t i) {
+	const uint64_t high = 0x8080808080808080u;
+	uint64_t word;
+	size_t n;
+
+	while(i < length) {
+		if(length - i >= 8) {
+			memcpy(&word, a + i, 8);
+			if(!(word & high)) { i += 8; continue; }
+		}
+		if(!(n = utf8Length(a + i, a + length))) return i;
+		i += n;
+	}
+	return length;
+}
+
+#ifdef Q1_X86
+
+/** The window at i has an error, and everything before it is UTF-8 except
+ maybe a character that it cuts; decodes from the start of that character.
+ @return	Where the first character that isn't UTF-8 starts. */
+static size_t locate(const char *const a, const size_t length,
+	const size_t i) {
+	size_t back;
+
+	for(back = 1; back <= 3 && back <= i; back++) {
+		const unsigned char c = (unsigned char)a[i - back];
+		if(c < 0x80) break;
+		if(c < 0xc0) continue;
+		if(back < (c >= 0xf0 ? 4u : c >= 0xe0 ? 3u : 2u))
+			return decode(a, length, i - back);
+		break;
+	}
+	return decode(a, length, i);
+}
+
+/** Sixteen bytes at a time; the end is padded with null, so a character that
+ is cut off by the end is an error in the last window. */
+__attribute__((target("ssse3")))
+static size_t valid_ssse3(const char *const a, const size_t length) {
+	const __m128i t1 = _mm_loadu_si128((const __m128i *)first_high),
+		t2 = _mm_loadu_si128((const __m128i *)first_low),
+		t3 = _mm_loadu_si128((const __m128i *)second_high),
+		nibble = _mm_set1_epi8(0x0f), zero = _mm_setzero_si128(),
+		/* the last three bytes can't start a character that's cut off */
+		max = _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+		-1, (char)(0xf0 - 1), (char)(0xe0 - 1), (char)(0xc0 - 1));
+	__m128i x, prev = zero, cut = zero, error;
+	char pad[16];
+	size_t i;
+
+	for(i = 0; ; i += 16) {
+		const size_t left = length - i;
+		if(left >= 16) {
+			x = _mm_loadu_si128((const __m128i *)(a + i));
+		} else {
+			memset(pad, 0, sizeof pad), memcpy(pad, a + i, left);
+			x = _mm_loadu_si128((const __m128i *)pad);
+		}
+		if(!_mm_movemask_epi8(x)) {
+			error = cut, cut = zero;
+		} else {
+			const __m128i prev1 = _mm_alignr_epi8(x, prev, 15),
+				prev2 = _mm_alignr_epi8(x, prev, 14),
+				prev3 = _mm_alignr_epi8(x, prev, 13);
+			const __m128i special = _mm_and_si128(_mm_and_si128(
+				_mm_shuffle_epi8(t1,
+				_mm_and_si128(_mm_srli_epi16(prev1, 4), nibble)),
+				_mm_shuffle_epi8(t2, _mm_and_si128(prev1, nibble))),
+				_mm_shuffle_epi8(t3,
+				_mm_and_si128(_mm_srli_epi16(x, 4), nibble)));
+			/* the third byte after E0-EF or the fourth after F0-F7 */
+			const __m128i must = _mm_or_si128(
+				_mm_subs_epu8(prev2, _mm_set1_epi8((char)(0xe0 - 0x80))),
+				_mm_subs_epu8(prev3, _mm_set1_epi8((char)(0xf0 - 0x80))));
+			error = _mm_xor_si128(special,
+				_mm_and_si128(must, _mm_set1_epi8((char)0x80)));
+			cut = _mm_subs_epu8(x, max);
+		}
+		if(_mm_movemask_epi8(_mm_cmpeq_epi8(error, zero)) != 0xffff)
+			return locate(a, length, i);
+		if(left < 16) return length;
+		prev = x;
+	}
+}
+
+/** The same with thirty-two bytes; the bytes before are from across the
+ lanes. */
+__attribute__((target("avx2")))
+static size_t valid_avx2(const char *const a, const size_t length) {
+	const __m256i t1 = _mm256_broadcastsi128_si256(
+		_mm_loadu_si128((const __m128i *)first_high)),
+		t2 = _mm256_broadcastsi128_si256(
+		_mm_loadu_si128((const __m128i *)first_low)),
+		t3 = _mm256_broadcastsi128_si256(
+		_mm_loadu_si128((const __m128i *)second_high)),
+		nibble = _mm256_set1_epi8(0x0f), zero = _mm256_setzero_si256(),
+		max = _mm256_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+		-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+		-1, (char)(0xf0 - 1), (char)(0xe0 - 1), (char)(0xc0 - 1));
+	__m256i x, prev = zero, cut = zero, error;
+	char pad[32];
+	size_t i;
+
+	for(i = 0; ; i += 32) {
+		const size_t left = length - i;
+		if(left >= 32) {
+			x = _mm256_loadu_si256((const __m256i *)(a + i));
+		} else {
+			memset(pad, 0, sizeof pad), memcpy(pad, a + i, left);
+			x = _mm256_loadu_si256((const __m256i *)pad);
+		}
+		if(!_mm256_movemask_epi8(x)) {
+			error = cut, cut = zero;
+		} else {
+			/* the high lane of prev and the low lane of x */
+			const __m256i across = _mm256_permute2x128_si256(prev, x, 0x21);
+			const __m256i prev1 = _mm256_alignr_epi8(x, across, 15),
+				prev2 = _mm256_alignr_epi8(x, across, 14),
+				prev3 = _mm256_alignr_epi8(x, across, 13);
+			const __m256i special = _mm256_and_si256(_mm256_and_si256(
+				_mm256_shuffle_epi8(t1,
+				_mm256_and_si256(_mm256_srli_epi16(prev1, 4), nibble)),
+				_mm256_shuffle_epi8(t2, _mm256_and_si256(prev1, nibble))),
+				_mm256_shuffle_epi8(t3,
+				_mm256_and_si256(_mm256_srli_epi16(x, 4), nibble)));
+			const __m256i must = _mm256_or_si256(_mm256_subs_epu8(prev2,
+				_mm256_set1_epi8((char)(0xe0 - 0x80))),
+				_mm256_subs_epu8(prev3,
+				_mm256_set1_epi8((char)(0xf0 - 0x80))));
+			error = _mm256_xor_si256(special,
+				_mm256_and_si256(must, _mm256_set1_epi8((char)0x80)));
+			cut = _mm256_subs_epu8(x, max);
+		}
+		if(!_mm256_testz_si256(error, error)) return locate(a, length, i);
+		if(left < 32) return length;
+		prev = x;
+	}
+}
+
+#endif
@@ -0,0 +1,6 @@
+#include <stddef.h> /* size_t */
+
+size_t utf8Valid(const char *const a, const size_t length);
+size_t utf8Length(const char *const a, const char *const end);
+size_t utf8Encode(char *const u, const unsigned long c);
+const char *utf8Name(void);
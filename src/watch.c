@@ -0,0 +1,878 @@
+/* Watches the scripts under directories and checks them again as they're
+ saved, {@see watchServe}, instead of q1 being run over all of them in a loop.
+ It's on inotify, so only on Linux: every directory has a watch for files
+ that are written and closed, moved in or out, or deleted, and for the
+ directories in it that come and go; between changes, the process is asleep
+ in poll.
+
+ The last version of every file is kept, with where its lines start and what
+ was found of each one that's not valid. When a file changes, the lines at the
+ start and at the end that are the same as before keep what they had. Of the
+ ones in between, a line that is, byte for byte, one of the old ones in
+ between, looked up by a hash, takes what was found of it, since every line is
+ valid or not by itself, wherever it is; only the rest are checked, with
+ checkLine. What's written is only the diagnostics that appeared, at their
+ lines, and the ones that went away, at the lines they were on in the version
+ before.
+
+ @author	Neil
+ @version	1; 2016-03
+ @since		1; 2016-03 */
+
+#define _POSIX_C_SOURCE 200809L /* sigaction lstat strdup clock_gettime */
+
+#include <errno.h>		/* errno */
+#include "watch.h"
+
+#ifdef __linux__
+
+#include <stdio.h>		/* fprintf */
+#include <stdlib.h>		/* malloc realloc free qsort */
+#include <string.h>		/* strlen strcmp strncmp strdup strerror memcpy
+						 memcmp memchr memmove memset */
+#include <stdint.h>		/* uint64_t uint32_t */
+#include <signal.h>		/* sigaction sig_atomic_t */
+#include <time.h>		/* clock_gettime */
+#include <fcntl.h>		/* open */
+#include <unistd.h>		/* read close */
+#include <poll.h>		/* poll */
+#include <dirent.h>		/* opendir readdir closedir */
+#include <sys/stat.h>	/* fstat stat lstat */
+#include <sys/inotify.h>	/* inotify_* */
+#include "syntax.h"		/* checkLine struct Error */
+#include "hash.h"		/* hash64 */
+#include "arena.h"		/* struct Arena initArena freeArena */
+#include "emit.h"		/* emitDiagnostic emitFixed emitFailure flushEmit */
+
+/* constants */
+static const char *const programme = "q1";
+static const uint64_t line_seed = 0x7761746368713100u;
+static const uint32_t events = IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM
+	| IN_DELETE | IN_CREATE;
+static const int settle_ms = 5; /* of quiet before the files are checked */
+static const unsigned settle_rounds = 20; /* but no more waits than this */
+static const size_t common_block = 256; /* compared at once */
+
+/* what was found of a line that's not valid; the message, what was expected,
+ and the suggestion are one after the other in strings */
+struct Finding {
+	long column;
+	size_t expected, suggestion;
+	char strings[];
+};
+
+/* where a line starts in the text of its file, and what was found of it if
+ it's not valid */
+struct WatchLine {
+	size_t offset;
+	struct Finding *finding;
+};
+
+/* the last version of a file; the lines are followed by one more that's the
+ end of the last new line, which is before the end of the text if it's
+ missing one. A file that is_named was given by itself, not found in a
+ directory, so it stays even when it's not there */
+struct WatchFile {
+	char *path;
+	char *text;
+	size_t size;
+	struct WatchLine *lines;
+	size_t lines_size, lines_capacity;
+	int is_named, is_dirty;
+};
+
+/* a directory with a watch; the paths of the files in it are prefix and
+ their name. Only the files that are named are looked at, unless is_all, and
+ then the directories in it are watched too */
+struct WatchDir {
+	int wd;
+	char *prefix;
+	int is_all;
+};
+
+struct Watch {
+	int fd;
+	struct Emit *out;
+	struct WatchDir *dirs;
+	size_t dirs_size, dirs_capacity;
+	struct WatchFile **files; /* by path */
+	size_t files_size, files_capacity;
+	struct WatchFile **dirty;
+	size_t dirty_size, dirty_capacity;
+	struct WatchLine *next; /* the lines of the new version */
+	size_t next_capacity;
+	size_t *heads, *links; /* the old lines that aren't the same, by hash */
+	size_t heads_capacity, links_capacity;
+	unsigned char *fresh; /* the new lines that weren't there before */
+	size_t fresh_capacity;
+	struct Arena arena; /* for the lines that aren't valid */
+	unsigned long lines, invalid, changed, checked, appeared, fixed;
+};
+
+/* set by a signal to stop */
+static volatile sig_atomic_t is_stopped;
+
+/* private prototypes */
+static void stop(const int number);
+static int add_path(struct Watch *const w, const char *const path);
+static int watch_directory(struct Watch *const w, const char *const prefix,
+	const int is_all);
+static int scan(struct Watch *const w, const size_t index);
+static int rescan(struct Watch *const w);
+static void forget(struct Watch *const w, const char *const prefix);
+static struct WatchDir *find_dir(const struct Watch *const w, const int wd,
+	size_t *const index);
+static void remove_dir(struct Watch *const w, const size_t index);
+static int handle(struct Watch *const w,
+	const struct inotify_event *const event);
+static struct WatchFile *find_file(const struct Watch *const w,
+	const char *const path, size_t *const at);
+static struct WatchFile *add_file(struct Watch *const w,
+	const char *const path, const int is_named);
+static void remove_file(struct Watch *const w, struct WatchFile *const f);
+static void free_file(struct WatchFile *const f);
+static int dirty(struct Watch *const w, struct WatchFile *const f);
+static int update_dirty(struct Watch *const w);
+static int update(struct Watch *const w, struct WatchFile *const f);
+static int load(const char *const fn, char **const text, size_t *const size);
+static int split(struct Watch *const w, const char *const text,
+	const size_t size, size_t *const lines_size);
+static size_t common(const char *const a, const char *const b,
+	const size_t size);
+static size_t common_end(const char *const a, const char *const b,
+	const size_t size);
+static int match(struct Watch *const w, const char *const a,
+	struct WatchLine *const old, const size_t n, const char *const b,
+	struct WatchLine *const now, const size_t k);
+static int check(struct Watch *const w, const char *const text,
+	struct WatchLine *const line);
+static void *grow(void *const a, size_t *const capacity, const size_t n,
+	const size_t size);
+static int file_compare(const void *a, const void *b);
+static int string_compare(const void *a, const void *b);
+
+/* public */
+
+/** Checks the files in paths, which are directories, with everything under
+ them, or files, writing the diagnostics to out; then, whenever one is
+ saved, it's checked again and only the diagnostics that appeared or went
+ away are written. It goes on until it's interrupted or there's nothing left
+ to watch. If is_timed, the time that each change took goes to stderr.
+ @return	Success; otherwise errno is set and it's been said why. */
+int watchServe(char *const*const paths, const size_t paths_size,
+	struct Emit *const out, const int is_timed) {
+	struct Watch w = { 0 };
+	struct sigaction sa, sa_int, sa_term;
+	union { struct inotify_event event; char bytes[1 << 16]; } buffer;
+	struct pollfd pfd;
+	struct timespec t0, t1;
+	const char *fn = 0, *b;
+	ssize_t r;
+	size_t i;
+	unsigned rounds;
+	int is_ok = 0, is_signal = 0, e = 0;
+
+	w.fd = -1, w.out = out;
+	initArena(&w.arena);
+	is_stopped = 0;
+	/* try */ do {
+
+		if((w.fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC)) == -1) break;
+		if(is_timed) clock_gettime(CLOCK_MONOTONIC, &t0);
+		for(i = 0; i < paths_size; i++)
+			if(!add_path(&w, paths[i])) { fn = paths[i]; break; }
+		if(i < paths_size || !update_dirty(&w) || !flushEmit(out)) break;
+		fprintf(stderr, "%s: watching %lu files in %lu directories; %lu "
+			"lines, %lu not valid", programme, (unsigned long)w.files_size,
+			(unsigned long)w.dirs_size, w.lines, w.invalid);
+		if(is_timed) {
+			clock_gettime(CLOCK_MONOTONIC, &t1);
+			fprintf(stderr, " in %.3f s", (t1.tv_sec - t0.tv_sec)
+				+ (t1.tv_nsec - t0.tv_nsec) * 1e-9);
+		}
+		fputs(".\n", stderr);
+
+		/* poll is interrupted to stop */
+		sa.sa_handler = &stop;
+		sigemptyset(&sa.sa_mask);
+		sa.sa_flags = 0;
+		sigaction(SIGINT, &sa, &sa_int), sigaction(SIGTERM, &sa, &sa_term);
+		is_signal = -1;
+		pfd.fd = w.fd, pfd.events = POLLIN;
+		for( ; ; ) {
+			if(is_stopped || !w.dirs_size) { is_ok = -1; break; }
+			if(poll(&pfd, 1, -1) == -1) {
+				if(errno == EINTR) continue;
+				break;
+			}
+			if(is_timed) clock_gettime(CLOCK_MONOTONIC, &t0);
+			/* everything until it's quiet for a moment, so a file that's
+			 written beside another and moved over it, as editors save, is
+			 checked once, where it ends up */
+			for(rounds = 0; ; ) {
+				while((r = read(w.fd, buffer.bytes, sizeof buffer)) > 0) {
+					for(b = buffer.bytes; b < buffer.bytes + r;
+						b += sizeof buffer.event
+						+ ((const struct inotify_event *)b)->len)
+						if(!handle(&w, (const struct inotify_event *)b)) break;
+					if(b < buffer.bytes + r) break;
+				}
+				if(r > 0 || (r == -1 && errno != EAGAIN && errno != EINTR))
+					break;
+				if(++rounds >= settle_rounds || poll(&pfd, 1, settle_ms) != 1)
+					{ r = 0; break; }
+			}
+			if(r) break;
+			w.checked = w.appeared = w.fixed = 0;
+			if(!update_dirty(&w) || !flushEmit(out)) break;
+			if(!is_timed || !w.changed) continue;
+			clock_gettime(CLOCK_MONOTONIC, &t1);
+			fprintf(stderr, "%s: %lu files changed; %lu of %lu lines checked, "
+				"%lu appeared and %lu fixed in %.3f ms.\n", programme,
+				w.changed, w.checked, w.lines, w.appeared, w.fixed,
+				(t1.tv_sec - t0.tv_sec) * 1e3
+				+ (t1.tv_nsec - t0.tv_nsec) * 1e-6);
+		}
+
+	} while(0); /* finally */ {
+
+		e = errno;
+		if(is_signal)
+			sigaction(SIGINT, &sa_int, 0), sigaction(SIGTERM, &sa_term, 0);
+		if(w.fd != -1) close(w.fd);
+		for(i = 0; i < w.files_size; i++) free_file(w.files[i]);
+		free(w.files);
+		for(i = 0; i < w.dirs_size; i++) free(w.dirs[i].prefix);
+		free(w.dirs);
+		free(w.dirty), free(w.next), free(w.heads), free(w.links);
+		free(w.fresh);
+		freeArena(&w.arena);
+
+	} /* catch */ if(!is_ok) {
+
+		if(fn) emitFailure(out, fn, 0, strerror(e));
+		else fprintf(stderr, "%s: watch: %s.\n", programme, strerror(e));
+		errno = e;
+
+	}
+	return is_ok;
+}
+
+/* private */
+
+/** A signal to stop. */
+static void stop(const int number) {
+	(void)number;
+	is_stopped = 1;
+}
+
+/** Watches path, which is a directory, and everything under it, or a file.
+ @return	Success; otherwise errno is set. */
+static int add_path(struct Watch *const w, const char *const path) {
+	struct stat st;
+	struct WatchFile *f;
+	const char *slash;
+	char *prefix;
+	size_t size;
+	int is_ok;
+
+	if(stat(path, &st) == -1) return 0;
+	if(S_ISDIR(st.st_mode)) {
+		size = strlen(path);
+		if(!(prefix = malloc(size + 2))) return 0;
+		memcpy(prefix, path, size);
+		if(!size || path[size - 1] != '/') prefix[size++] = '/';
+		prefix[size] = '\0';
+		is_ok = watch_directory(w, prefix, -1);
+		free(prefix);
+		return is_ok;
+	}
+	if(!S_ISREG(st.st_mode)) { errno = EINVAL; return 0; }
+	/* its directory, for when it's replaced */
+	size = (slash = strrchr(path, '/')) ? (size_t)(slash - path) + 1 : 0;
+	if(!(prefix = malloc(size + 1))) return 0;
+	memcpy(prefix, path, size);
+	prefix[size] = '\0';
+	is_ok = watch_directory(w, prefix, 0);
+	free(prefix);
+	return is_ok && (f = add_file(w, path, -1)) && dirty(w, f);
+}
+
+/** Watches the directory at prefix, which is empty or ends in a slash; if
+ is_all, every file in it is checked, and the directories in it are watched
+ the same way.
+ @return	Success; otherwise errno is set. */
+static int watch_directory(struct Watch *const w, const char *const prefix,
+	const int is_all) {
+	struct WatchDir *d;
+	size_t index;
+	void *grown;
+	int wd;
+
+	if((wd = inotify_add_watch(w->fd, *prefix ? prefix : ".",
+		events | IN_ONLYDIR)) == -1) return 0;
+	if((d = find_dir(w, wd, &index))) {
+		if(d->is_all || !is_all) return -1;
+		d->is_all = -1;
+		return scan(w, index);
+	}
+	if(!(grown = grow(w->dirs, &w->dirs_capacity, w->dirs_size + 1,
+		sizeof *w->dirs))) return 0;
+	w->dirs = grown;
+	d = w->dirs + w->dirs_size;
+	if(!(d->prefix = strdup(prefix))) return 0;
+	d->wd     = wd;
+	d->is_all = is_all;
+	index = w->dirs_size++;
+	return is_all ? scan(w, index) : -1;
+}
+
+/** Adds the regular files in the directory at index that aren't there
+ already, and watches the directories in it. One that can't be watched is a
+ failure, but it goes on.
+ @return	Success; otherwise errno is set. */
+static int scan(struct Watch *const w, const size_t index) {
+	const char *const prefix = w->dirs[index].prefix;
+	const size_t prefix_size = strlen(prefix);
+	DIR *dir;
+	struct dirent *de;
+	struct stat st;
+	struct WatchFile *f;
+	char **names = 0, *path = 0;
+	size_t names_size = 0, names_capacity = 0, path_capacity = 0, i;
+	void *grown;
+	int is_ok = 0;
+
+	/* it's already gone */
+	if(!(dir = opendir(*prefix ? prefix : "."))) return errno != ENOMEM;
+
+	/* try */ do {
+
+		for( ; ; ) {
+			errno = 0;
+			if(!(de = readdir(dir))) break;
+			if(!strcmp(de->d_name, ".") || !strcmp(de->d_name, "..")) continue;
+			if(!(grown = grow(names, &names_capacity, names_size + 1,
+				sizeof *names))) break;
+			names = grown;
+			if(!(names[names_size] = strdup(de->d_name))) break;
+			names_size++;
+		}
+		if(errno) break;
+		qsort(names, names_size, sizeof *names, &string_compare);
+
+		for(i = 0; i < names_size; i++) {
+			const size_t size = prefix_size + strlen(names[i]) + 2;
+			if(!(grown = grow(path, &path_capacity, size, 1))) break;
+			path = grown;
+			memcpy(path, prefix, prefix_size);
+			strcpy(path + prefix_size, names[i]);
+			if(lstat(path, &st) == -1) continue;
+			if(S_ISDIR(st.st_mode)) {
+				strcat(path, "/");
+				if(watch_directory(w, path, -1)) continue;
+				if(errno == ENOMEM) break;
+				emitFailure(w->out, path, 0, strerror(errno));
+			} else if(S_ISREG(st.st_mode) || (S_ISLNK(st.st_mode)
+				&& stat(path, &st) != -1 && S_ISREG(st.st_mode))) {
+				if(!(f = find_file(w, path, 0)) && !(f = add_file(w, path, 0)))
+					break;
+				if(!dirty(w, f)) break;
+			}
+		}
+		if(i < names_size) break;
+		is_ok = -1;
+
+	} while(0); /* finally */ {
+
+		const int e = errno;
+		for(i = 0; i < names_size; i++) free(names[i]);
+		free(names);
+		free(path);
+		closedir(dir);
+		errno = e;
+
+	}
+	return is_ok;
+}
+
+/** The events were too many for the queue and some were lost, so every file
+ is checked again, which is only a compare if it hasn't changed, and every
+ directory is looked in for new files. */
+static int rescan(struct Watch *const w) {
+	const size_t dirs_size = w->dirs_size;
+	size_t i;
+
+	for(i = 0; i < w->files_size; i++) if(!dirty(w, w->files[i])) return 0;
+	for(i = 0; i < dirs_size; i++)
+		if(w->dirs[i].is_all && !scan(w, i)) return 0;
+	return -1;
+}
+
+/** The directory at prefix has been moved away or deleted; the files under
+ it are checked, so they're found to be gone, and the directories under it
+ aren't watched. */
+static void forget(struct Watch *const w, const char *const prefix) {
+	const size_t size = strlen(prefix);
+	size_t i;
+
+	for(i = 0; i < w->files_size; i++)
+		if(!strncmp(w->files[i]->path, prefix, size))
+			dirty(w, w->files[i]);
+	for(i = 0; i < w->dirs_size; ) {
+		if(strncmp(w->dirs[i].prefix, prefix, size)) { i++; continue; }
+		inotify_rm_watch(w->fd, w->dirs[i].wd);
+		remove_dir(w, i);
+	}
+}
+
+/** @return	The directory watched by wd, and its index, or null. */
+static struct WatchDir *find_dir(const struct Watch *const w, const int wd,
+	size_t *const index) {
+	size_t i;
+
+	for(i = 0; i < w->dirs_size; i++)
+		if(w->dirs[i].wd == wd) { *index = i; return w->dirs + i; }
+	return 0;
+}
+
+/** Forgets the directory at index; the last takes its place. */
+static void remove_dir(struct Watch *const w, const size_t index) {
+	free(w->dirs[index].prefix);
+	w->dirs[index] = w->dirs[--w->dirs_size];
+}
+
+/** Marks the files that event says have changed, and watches the
+ directories that it says are new.
+ @return	Success; otherwise errno is set. */
+static int handle(struct Watch *const w,
+	const struct inotify_event *const event) {
+	const struct WatchDir *d;
+	struct WatchFile *f;
+	struct stat st;
+	char *path;
+	size_t index, size;
+	int is_ok = -1;
+
+	if(event->mask & IN_Q_OVERFLOW) return rescan(w);
+	if(!(d = find_dir(w, event->wd, &index))) return -1;
+	if(event->mask & IN_IGNORED) { remove_dir(w, index); return -1; }
+	/* a file that's created is looked at when it's closed */
+	if(!event->len || (event->mask & (IN_CREATE | IN_ISDIR)) == IN_CREATE)
+		return -1;
+	size = strlen(d->prefix);
+	if(!(path = malloc(size + strlen(event->name) + 2))) return 0;
+	memcpy(path, d->prefix, size);
+	strcpy(path + size, event->name);
+	if(event->mask & IN_ISDIR) {
+		strcat(path, "/");
+		if(d->is_all && event->mask & (IN_CREATE | IN_MOVED_TO))
+			is_ok = watch_directory(w, path, -1) || errno != ENOMEM;
+		else if(d->is_all) forget(w, path);
+	} else if((f = find_file(w, path, 0))) {
+		is_ok = dirty(w, f);
+	} else if(d->is_all && event->mask & (IN_CLOSE_WRITE | IN_MOVED_TO)
+		&& stat(path, &st) != -1 && S_ISREG(st.st_mode)) {
+		is_ok = (f = add_file(w, path, 0)) && dirty(w, f);
+	}
+	free(path);
+	return is_ok;
+}
+
+/** @return	The file with path, or null, and where it is or would go in
+			at, if it's not null. */
+static struct WatchFile *find_file(const struct Watch *const w,
+	const char *const path, size_t *const at) {
+	size_t lo = 0, hi = w->files_size, mid;
+	int c;
+
+	while(lo < hi) {
+		mid = lo + ((hi - lo) >> 1);
+		if(!(c = strcmp(path, w->files[mid]->path))) {
+			if(at) *at = mid;
+			return w->files[mid];
+		}
+		if(c < 0) hi = mid;
+		else lo = mid + 1;
+	}
+	if(at) *at = lo;
+	return 0;
+}
+
+/** @return	The file with path, which is new and empty if it wasn't
+			there, or null if there's no memory. */
+static struct WatchFile *add_file(struct Watch *const w,
+	const char *const path, const int is_named) {
+	struct WatchFile *f;
+	void *grown;
+	size_t at;
+
+	if((f = find_file(w, path, &at))) {
+		if(is_named) f->is_named = -1;
+		return f;
+	}
+	if(!(grown = grow(w->files, &w->files_capacity, w->files_size + 1,
+		sizeof *w->files))) return 0;
+	w->files = grown;
+	if(!(f = calloc(1, sizeof *f))) return 0;
+	if(!(f->path = strdup(path))) { free(f); return 0; }
+	f->is_named = is_named;
+	memmove(w->files + at + 1, w->files + at,
+		(w->files_size++ - at) * sizeof *w->files);
+	w->files[at] = f;
+	return f;
+}
+
+/** Forgets f. */
+static void remove_file(struct Watch *const w, struct WatchFile *const f) {
+	size_t at;
+
+	if(!find_file(w, f->path, &at)) return;
+	memmove(w->files + at, w->files + at + 1,
+		(--w->files_size - at) * sizeof *w->files);
+	/* emit knows a file name by where it is */
+	if(w->out->fn == f->path) w->out->fn = 0;
+	free_file(f);
+}
+
+static void free_file(struct WatchFile *const f) {
+	size_t i;
+
+	for(i = 0; i < f->lines_size; i++) free(f->lines[i].finding);
+	free(f->lines), free(f->text), free(f->path), free(f);
+}
+
+/** Marks f to be checked again.
+ @return	Success; otherwise errno is set. */
+static int dirty(struct Watch *const w, struct WatchFile *const f) {
+	void *grown;
+
+	if(f->is_dirty) return -1;
+	if(!(grown = grow(w->dirty, &w->dirty_capacity, w->dirty_size + 1,
+		sizeof *w->dirty))) return 0;
+	w->dirty = grown;
+	w->dirty[w->dirty_size++] = f;
+	f->is_dirty = -1;
+	return -1;
+}
+
+/** Checks every file that is marked again, in order of path.
+ @return	Success; otherwise errno is set. */
+static int update_dirty(struct Watch *const w) {
+	size_t i;
+	int is_ok = -1;
+
+	qsort(w->dirty, w->dirty_size, sizeof *w->dirty, &file_compare);
+	for(i = 0; i < w->dirty_size; i++) {
+		struct WatchFile *const f = w->dirty[i];
+		f->is_dirty = 0;
+		if(is_ok && !update(w, f)) is_ok = 0;
+	}
+	w->changed = (unsigned long)w->dirty_size;
+	w->dirty_size = 0;
+	return is_ok;
+}
+
+/** Reads f again and checks the lines that weren't there before, writing the
+ diagnostics that appeared and the ones that went away. A file that can't be
+ read is a failure, and what it was is kept; one that's gone is empty, and
+ is forgotten unless it's named.
+ @return	Success; otherwise errno is set. */
+static int update(struct Watch *const w, struct WatchFile *const f) {
+	struct WatchLine *const old = f->lines, *now, *lines;
+	const size_t m = f->lines_size;
+	char *text;
+	size_t size, k, c, p, s, i;
+	int is_gone = 0;
+
+	if(!load(f->path, &text, &size)) {
+		if(errno == ENOMEM) return 0;
+		if(errno != ENOENT && errno != ENOTDIR) {
+			emitFailure(w->out, f->path, 0, strerror(errno));
+			return -1;
+		}
+		if(!(text = malloc(1))) return 0;
+		size = 0, is_gone = -1;
+	}
+	/* it was saved again the same */
+	if(f->text && size == f->size && !memcmp(text, f->text, size)) {
+		free(text);
+		if(is_gone && !f->is_named) remove_file(w, f);
+		return -1;
+	}
+	if(!split(w, text, size, &k)) { free(text); return 0; }
+	now = w->next;
+	/* the lines of the new version go where the old ones were, if they fit
+	 well enough */
+	if(k + 1 <= f->lines_capacity && k + 1 >= f->lines_capacity >> 2) {
+		lines = f->lines;
+	} else if(!(lines = malloc((k + 1) * sizeof *lines))) {
+		free(text);
+		return 0;
+	}
+
+	/* the lines in the bytes that are the same at the start, and the ones
+	 after a new line in the bytes that are the same at the end, are the same
+	 lines */
+	p = s = 0;
+	if((c = m < k ? m : k)) {
+		const size_t a_end = old[m].offset, b_end = now[k].offset,
+			least = a_end < b_end ? a_end : b_end,
+			start = common(f->text, text, least),
+			end = common_end(f->text + a_end, text + b_end, least - start);
+		for( ; p < c && old[p + 1].offset <= start; p++)
+			now[p].finding = old[p].finding, old[p].finding = 0;
+		for( ; s < c - p && old[m - 1 - s].offset > a_end - end; s++)
+			now[k - 1 - s].finding = old[m - 1 - s].finding,
+			old[m - 1 - s].finding = 0;
+	}
+	/* and in between, the ones that were there before */
+	if(!match(w, f->text, old + p, m - p - s, text, now + p, k - p - s)) {
+		for(i = 0; i < k; i++) free(now[i].finding);
+		if(lines != f->lines) free(lines);
+		free(text);
+		return 0;
+	}
+
+	/* the ones that went away, at the lines that they were on */
+	for(i = p; i < m - s; i++) {
+		struct Finding *const g = old[i].finding;
+		if(!g) continue;
+		emitFixed(w->out, f->path, (unsigned long)i + 1, f->text
+			+ old[i].offset, old[i + 1].offset - old[i].offset, g->column,
+			g->strings, g->strings + g->expected, g->strings + g->suggestion);
+		free(g), old[i].finding = 0;
+		w->fixed++, w->invalid--;
+	}
+	for(i = p; i < k - s; i++) {
+		const struct Finding *const g = now[i].finding;
+		if(!w->fresh[i - p] || !g) continue;
+		emitDiagnostic(w->out, f->path, (unsigned long)i + 1, text
+			+ now[i].offset, now[i + 1].offset - now[i].offset, g->column,
+			g->strings, g->strings + g->expected, g->strings + g->suggestion);
+		w->appeared++, w->invalid++;
+	}
+
+	w->lines = w->lines - m + k;
+	if(lines != f->lines) {
+		free(f->lines);
+		f->lines          = lines;
+		f->lines_capacity = k + 1;
+	}
+	memcpy(lines, now, (k + 1) * sizeof *lines);
+	f->lines_size = k;
+	free(f->text), f->text = text, f->size = size;
+	if(lines[k].offset < size) emitFailure(w->out, f->path,
+		(unsigned long)k + 1, "not followed by new line.");
+	if(is_gone && !f->is_named) remove_file(w, f);
+	return -1;
+}
+
+/** Reads all of the regular file fn into text, which is a new copy of size.
+ @return	Success; otherwise errno is set. */
+static int load(const char *const fn, char **const text, size_t *const size) {
+	struct stat st;
+	char *t = 0;
+	size_t n = 0;
+	ssize_t r;
+	int fd, e = 0;
+
+	if((fd = open(fn, O_RDONLY | O_CLOEXEC)) == -1) return 0;
+	/* try */ do {
+		if(fstat(fd, &st) == -1) { e = errno; break; }
+		if(!S_ISREG(st.st_mode)) { e = EINVAL; break; }
+		if(!(t = malloc((size_t)st.st_size + 1))) { e = errno; break; }
+		while(n < (size_t)st.st_size
+			&& (r = read(fd, t + n, (size_t)st.st_size - n))) {
+			if(r == -1) {
+				if(errno == EINTR) continue;
+				e = errno;
+				break;
+			}
+			n += (size_t)r;
+		}
+	} while(0); /* finally */ {
+		close(fd);
+	} /* catch */ if(e) {
+		free(t);
+		errno = e;
+		return 0;
+	}
+	*text = t, *size = n;
+	return -1;
+}
+
+/** Finds where the lines of text, of size, start, in w->next, with what
+ was found of them cleared, and the end of the last new line after them.
+ Only the last line can be missing one, and then it's left out, the same as
+ when there's no watch.
+ @return	Success; otherwise errno is set. */
+static int split(struct Watch *const w, const char *const text,
+	const size_t size, size_t *const lines_size) {
+	const char *s, *nl, *const end = text + size;
+	size_t k = 0;
+	void *grown;
+
+	for(s = text; ; s = nl + 1) {
+		if(k >= w->next_capacity) {
+			if(!(grown = grow(w->next, &w->next_capacity, k + 1,
+				sizeof *w->next))) return 0;
+			w->next = grown;
+		}
+		w->next[k].offset  = (size_t)(s - text);
+		w->next[k].finding = 0;
+		if(!(nl = memchr(s, '\n', (size_t)(end - s)))) break;
+		k++;
+	}
+	/* a carriage return by itself at the end is a new line */
+	if(s < end && end[-1] == '\r') {
+		if(!(grown = grow(w->next, &w->next_capacity, k + 2,
+			sizeof *w->next))) return 0;
+		w->next = grown;
+		w->next[++k].offset = size;
+		w->next[k].finding  = 0;
+	}
+	*lines_size = k;
+	return -1;
+}
+
+/** @return	The number of bytes, up to size, that a and b start with that
+			are the same. */
+static size_t common(const char *const a, const char *const b,
+	const size_t size) {
+	size_t i = 0;
+
+	while(i + common_block <= size && !memcmp(a + i, b + i, common_block))
+		i += common_block;
+	while(i < size && a[i] == b[i]) i++;
+	return i;
+}
+
+/** @return	The number of bytes, up to size, that end at a and b that are
+			the same. */
+static size_t common_end(const char *const a, const char *const b,
+	const size_t size) {
+	size_t i = 0;
+
+	while(i + common_block <= size && !memcmp(a - i - common_block,
+		b - i - common_block, common_block)) i += common_block;
+	while(i < size && *(a - i - 1) == *(b - i - 1)) i++;
+	return i;
+}
+
+/** Each of the k lines, now, in b, that's byte for byte one of the n lines,
+ old, in a, takes what was found of it; the rest are checked, and marked in
+ w->fresh. A line that's there more than once is matched once for each.
+ @return	Success; otherwise errno is set. */
+static int match(struct Watch *const w, const char *const a,
+	struct WatchLine *const old, const size_t n, const char *const b,
+	struct WatchLine *const now, const size_t k) {
+	size_t buckets = 16, i, j = 0, *slot;
+	void *grown;
+
+	if(!(grown = grow(w->fresh, &w->fresh_capacity, k, sizeof *w->fresh)))
+		return 0;
+	w->fresh = grown;
+	if(n && k) {
+		while(buckets < n << 1) buckets <<= 1;
+		if(!(grown = grow(w->heads, &w->heads_capacity, buckets,
+			sizeof *w->heads))) return 0;
+		w->heads = grown;
+		if(!(grown = grow(w->links, &w->links_capacity, n,
+			sizeof *w->links))) return 0;
+		w->links = grown;
+		memset(w->heads, 0, buckets * sizeof *w->heads);
+		/* backwards, so the first of the same lines is first */
+		for(i = n; i; i--) {
+			const size_t h = hash64(a + old[i - 1].offset, old[i].offset
+				- old[i - 1].offset, line_seed) & (buckets - 1);
+			w->links[i - 1] = w->heads[h], w->heads[h] = i;
+		}
+	}
+	for(i = 0; i < k; i++) {
+		const char *const line = b + now[i].offset;
+		const size_t size = now[i + 1].offset - now[i].offset;
+		w->fresh[i] = 0;
+		if(n) {
+			for(slot = w->heads + (hash64(line, size, line_seed)
+				& (buckets - 1)); *slot; slot = w->links + j) {
+				j = *slot - 1;
+				if(old[j + 1].offset - old[j].offset == size
+					&& !memcmp(a + old[j].offset, line, size)) break;
+			}
+			if(*slot) {
+				now[i].finding = old[j].finding, old[j].finding = 0;
+				*slot = w->links[j];
+				continue;
+			}
+		}
+		w->fresh[i] = 1;
+		if(!check(w, b, now + i)) return 0;
+	}
+	return -1;
+}
+
+/** Checks line, in text, and keeps what was found if it's not valid.
+ @return	Success; otherwise errno is set. */
+static int check(struct Watch *const w, const char *const text,
+	struct WatchLine *const line) {
+	struct Error e;
+	struct Finding *g;
+	size_t m, x, s;
+
+	e.arena = &w->arena;
+	w->checked++;
+	if(checkLine(&e, text + line->offset, line[1].offset - line->offset))
+		return -1;
+	m = strlen(e.error) + 1, x = strlen(e.expected) + 1,
+		s = strlen(e.suggestion) + 1;
+	if(!(g = malloc(sizeof *g + m + x + s))) return 0;
+	g->column     = e.index;
+	g->expected   = m;
+	g->suggestion = m + x;
+	memcpy(g->strings, e.error, m);
+	memcpy(g->strings + m, e.expected, x);
+	memcpy(g->strings + m + x, e.suggestion, s);
+	line->finding = g;
+	return -1;
+}
+
+/** @return	a, or a copy of it with room for at least n things of size, if
+			it had less, with its room in capacity; or null if there's no
+			memory, and a is as it was. */
+static void *grow(void *const a, size_t *const capacity, const size_t n,
+	const size_t size) {
+	size_t c = *capacity ? *capacity : 64;
+	void *b;
+
+	if(a && n <= *capacity) return a;
+	while(c < n) c <<= 1;
+	if(!(b = realloc(a, c * size))) return 0;
+	*capacity = c;
+	return b;
+}
+
+/** {@see qsort} on files by path. */
+static int file_compare(const void *a, const void *b) {
+	const struct WatchFile *const*fa = a, *const*fb = b;
+	return strcmp((*fa)->path, (*fb)->path);
+}
+
+/** {@see qsort} on strings. */
+static int string_compare(const void *a, const void *b) {
+	const char *const*sa = a, *const*sb = b;
+	return strcmp(*sa, *sb);
+}
+
+#else /* __linux__ */
+
+/** inotify is only on Linux.
+ @return	False, and errno is ENOSYS. */
+int watchServe(char *const*const paths, const size_t paths_size,
+	struct Emit *const out, const int is_timed) {
+	(void)paths, (void)paths_size, (void)out, (void)is_timed;
+	errno = ENOSYS;
+	return 0;
+}
+
+#endif /* __linux__ */
@@ -0,0 +1,6 @@
+#include <stddef.h> /* size_t */
+
+struct Emit;
+
+int watchServe(char *const*const paths, const size_t paths_size,
+	struct Emit *const out, const int is_timed);